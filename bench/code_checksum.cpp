@@ -0,0 +1,89 @@
+#include "cached_store.hpp"
+#include "code_checksum.hpp"
+#include "sqlite_store.hpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// Time to answer a code that does not exist, as typos and scanners send them, the way the
+// redirect handler does: parse, then the cache and SQLite, with and without the code checksum
+// rejecting the code first. Existing codes are looked up in both cases.
+// Usage: code_checksum [lookups]
+
+static const int links = 100000;
+
+template <typename F>
+static void measure(const char* label, const std::vector<std::string>& requests, F&& lookup) {
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& text : requests) {
+        found += lookup(text);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-22s %8.1f ns per lookup (%zu found)\n", label, ns / requests.size(), found);
+}
+
+int main(int argc, char** argv) {
+    size_t lookups = argc > 1 ? std::stoul(argv[1]) : 200000;
+    configure_code_checksum(7, "bench", 0);
+    std::mt19937_64 rng(7);
+    auto random_code = [&rng](size_t length) {
+        std::string code(length, '0');
+        for (auto& c : code) {
+            c = base62_digits[rng() % 62];
+        }
+        return code;
+    };
+
+    sqlite3* handle = nullptr;
+    sqlite3_open(":memory:", &handle);
+    CachedStore cache(std::make_unique<SqliteStore>(handle), links);
+    std::vector<std::pair<ShortCode, std::string>> entries;
+    for (int i = 0; i < links; ++i) {
+        std::string code = random_code(6);
+        code += code_check_char(code.data(), 6);
+        entries.emplace_back(code, "https://example.com/page/" + std::to_string(i));
+    }
+    cache.insert_batch(entries);
+    for (const auto& entry : entries) {
+        cache.get(entry.first);
+    }
+
+    // Scanner paths of mixed lengths and codes with one character mistyped.
+    std::vector<std::string> missing;
+    for (size_t i = 0; i < lookups; ++i) {
+        if (i % 2 == 0) {
+            missing.push_back(random_code(4 + rng() % 8));
+        } else {
+            std::string typo = entries[rng() % links].first.str();
+            char& c = typo[rng() % typo.size()];
+            c = base62_digits[(base62_values[c] + 1 + rng() % 61) % 62];
+            missing.push_back(typo);
+        }
+    }
+    std::vector<std::string> existing;
+    for (size_t i = 0; i < lookups; ++i) {
+        existing.push_back(entries[rng() % links].first.str());
+    }
+
+    std::string url;
+    for (bool checksum : {false, true}) {
+        auto lookup = [&cache, &url, checksum](const std::string& text) {
+            ShortCode code;
+            if (!ShortCode::parse(text, code) || (checksum && !code_may_exist(code))) {
+                return false;
+            }
+            if (cache.get_cached(code, url)) {
+                return true;
+            }
+            url = cache.get(code);
+            return !url.empty();
+        };
+        measure(checksum ? "missing, checksum" : "missing, no checksum", missing, lookup);
+        measure(checksum ? "existing, checksum" : "existing, no checksum", existing, lookup);
+    }
+    sqlite3_close(handle);
+    return 0;
+}
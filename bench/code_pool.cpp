@@ -0,0 +1,62 @@
+#include "cached_store.hpp"
+#include "code_pool.hpp"
+#include "database.hpp"
+#include "sqlite_store.hpp"
+#include "utils.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Time to get a new code for /shorten: generate_short, which looks each candidate up in storage,
+// against taking one from the pre-generated pool. The store is SQLite behind the cache, as in
+// the server, with links codes already taken.
+// Usage: code_pool [links] [codes]
+
+static void cleanup(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+int main(int argc, char** argv) {
+    int links = argc > 1 ? std::stoi(argv[1]) : 200000;
+    size_t codes = argc > 2 ? std::stoul(argv[2]) : 10000;
+    std::string path = "bench_code_pool.db";
+    cleanup(path);
+    sqlite3_open(path.c_str(), &db);
+    set_journal_mode(db, "WAL");
+    set_store(std::make_unique<CachedStore>(std::make_unique<SqliteStore>(db), 100000));
+    std::vector<std::pair<ShortCode, std::string>> entries;
+    for (int i = 0; i < links; ++i) {
+        entries.emplace_back(random_short(6), "https://example.com/page/" + std::to_string(i));
+    }
+    current_store()->insert_batch(entries);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < codes; ++i) {
+        generate_short(6);
+    }
+    double generate_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    start_code_pool(path, 6, codes, codes / 4, 1000);
+    while (code_pool_stats().available < codes) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < codes; ++i) {
+        next_short_code(6);
+    }
+    double pool_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    CodePoolStats stats = code_pool_stats();
+    stop_code_pool();
+
+    std::printf("generate_short %8.1f ns per code\n", generate_ns / codes);
+    std::printf("pool           %8.1f ns per code (%llu misses)\n", pool_ns / codes,
+                static_cast<unsigned long long>(stats.misses));
+    set_store(nullptr);
+    sqlite3_close(db);
+    cleanup(path);
+    return 0;
+}
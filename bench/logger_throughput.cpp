@@ -0,0 +1,68 @@
+#include "clock.hpp"
+#include "logger.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Log calls/sec across threads: the old localtime + put_time prefix against the
+// cached clock, and full log() calls with stdout discarded.
+
+static std::string legacy_line(const std::string& message) {
+    auto now = std::chrono::system_clock::now();
+    auto time_t = std::chrono::system_clock::to_time_t(now);
+    std::ostringstream out;
+    out << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") << " - " << message;
+    return out.str();
+}
+
+static std::string cached_line(const std::string& message) {
+    return current_timestamp() + " - " + message;
+}
+
+template <typename F>
+static double run(int threads, F&& f) {
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> calls{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            uint64_t local = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                f();
+                ++local;
+            }
+            calls += local;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    stop.store(true);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return calls.load() / 0.5;
+}
+
+int main() {
+    std::freopen("/dev/null", "w", stdout);
+    std::vector<std::string> lines;
+    for (int threads : {1, 2, 4, 8}) {
+        std::atomic<size_t> sink{0};
+        double legacy = run(threads, [&] { sink += legacy_line("Redirect request for: abc123").size(); });
+        double cached = run(threads, [&] { sink += cached_line("Redirect request for: abc123").size(); });
+        double logged = run(threads, [] { log("Redirect request for: abc123"); });
+        char line[160];
+        std::snprintf(line, sizeof(line), "threads=%d legacy_format=%.0f/s cached_format=%.0f/s log()=%.0f/s\n",
+                      threads, legacy, cached, logged);
+        lines.push_back(line);
+    }
+    for (const auto& line : lines) {
+        std::fputs(line.c_str(), stderr);
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "cached_store.hpp"
+#include "sqlite_store.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Heap allocations and time per redirect lookup once the route parameter is in hand: parse the
+// code and answer from CachedStore into a reused URL buffer. The two map rows isolate the key
+// type: a plain hash map keyed by ShortCode, and the same map keyed by std::string with the code
+// copied by value, as the handler and cache did before. Codes of 6 and 16 characters, the latter
+// past the small-string buffer.
+// Usage: redirect_alloc [lookups]
+
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static const int links = 20000;
+
+static std::string code_for(int i, size_t length) {
+    uint64_t x = static_cast<uint64_t>(i + 1) * 0x9e3779b97f4a7c15ULL;
+    std::string code(length, '0');
+    for (auto& c : code) {
+        c = base62_digits[x % 62];
+        x = x / 62 + static_cast<uint64_t>(i) * 31;
+    }
+    return code;
+}
+
+static std::string url_for(int i) {
+    return "https://example.com/products/item?id=" + std::to_string(i);
+}
+
+template <typename F>
+static void measure(const char* label, size_t length, const std::vector<std::string>& requests, F&& lookup) {
+    size_t found = 0;
+    uint64_t before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& text : requests) {
+        found += lookup(text);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocated = allocations.load() - before;
+    std::printf("%-13s %2zu chars: %6.1f ns, %.2f allocations per redirect (%zu found)\n", label, length,
+                ns / requests.size(), static_cast<double>(allocated) / requests.size(), found);
+}
+
+int main(int argc, char** argv) {
+    size_t lookups = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    for (size_t length : {6, 16}) {
+        sqlite3* handle = nullptr;
+        sqlite3_open(":memory:", &handle);
+        CachedStore cache(std::make_unique<SqliteStore>(handle), 2 * links);
+        std::unordered_map<ShortCode, std::string> by_code;
+        std::unordered_map<std::string, std::string> by_string;
+        std::vector<std::pair<ShortCode, std::string>> entries;
+        for (int i = 0; i < links; ++i) {
+            entries.emplace_back(code_for(i, length), url_for(i));
+            by_code[entries.back().first] = url_for(i);
+            by_string[code_for(i, length)] = url_for(i);
+        }
+        cache.insert_batch(entries);
+        for (const auto& entry : entries) {
+            cache.get(entry.first);
+        }
+
+        // Route parameters as the router hands them over, built before counting starts.
+        std::mt19937 rng(7);
+        std::vector<std::string> requests;
+        requests.reserve(lookups);
+        for (size_t i = 0; i < lookups; ++i) {
+            requests.push_back(code_for(rng() % links, length));
+        }
+
+        std::string url;
+        url.reserve(256);
+        measure("cache", length, requests, [&cache, &url](const std::string& text) {
+            ShortCode code;
+            return ShortCode::parse(text, code) && cache.get_cached(code, url);
+        });
+        measure("ShortCode map", length, requests, [&by_code, &url](const std::string& text) {
+            ShortCode code;
+            if (!ShortCode::parse(text, code)) {
+                return false;
+            }
+            auto it = by_code.find(code);
+            if (it == by_code.end()) {
+                return false;
+            }
+            url = it->second;
+            return true;
+        });
+        measure("string map", length, requests, [&by_string, &url](const std::string& text) {
+            std::string code = text;
+            auto it = by_string.find(code);
+            if (it == by_string.end()) {
+                return false;
+            }
+            url = it->second;
+            return true;
+        });
+        sqlite3_close(handle);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "database.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Measures the latency of a redirect as the handler used to perform it:
+// two log rows plus a get_url, with extra threads adding background log traffic.
+// "shared" reproduces the old layout: logs written synchronously into urls.db.
+// "separate" uses logs.db with its own connection and writer thread.
+
+static const int url_count = 100000;
+static const int reader_threads = 4;
+static const int logger_threads = 2;
+
+static void remove_db(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+static std::string code_for(int i) {
+    return "c" + std::to_string(i);
+}
+
+static void run(const std::string& mode, int seconds) {
+    const std::string urls_path = "bench_urls.db";
+    const std::string logs_path = "bench_logs.db";
+    remove_db(urls_path);
+    remove_db(logs_path);
+
+    sqlite3_open(urls_path.c_str(), &db);
+    set_journal_mode(db, "WAL");
+    init_db();
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    for (int i = 0; i < url_count; ++i) {
+        insert_url(code_for(i), "https://example.com/page/" + std::to_string(i));
+    }
+    sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+
+    if (mode == "shared") {
+        open_log_db(urls_path, "WAL", 0);
+    } else {
+        open_log_db(logs_path, "WAL", 10000);
+    }
+
+    std::atomic<bool> stop{false};
+    std::vector<std::vector<double>> samples(reader_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < reader_threads; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937 gen(t);
+            std::uniform_int_distribution<> dis(0, url_count - 1);
+            while (!stop.load()) {
+                std::string code = code_for(dis(gen));
+                auto start = std::chrono::steady_clock::now();
+                log_to_db("INFO", "Redirect request for: " + code, "127.0.0.1", "bench");
+                std::string url = get_url(code);
+                log_to_db("INFO", "Redirecting to: " + url, "127.0.0.1", "bench");
+                auto end = std::chrono::steady_clock::now();
+                samples[t].push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            }
+        });
+    }
+    for (int t = 0; t < logger_threads; ++t) {
+        threads.emplace_back([&] {
+            while (!stop.load()) {
+                log_to_db("INFO", "Background event", "127.0.0.1", "bench");
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop.store(true);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    close_log_db();
+    sqlite3_close(db);
+
+    std::vector<double> all;
+    for (const auto& s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto pct = [&](double p) { return all.empty() ? 0.0 : all[static_cast<size_t>(p * (all.size() - 1))]; };
+    std::printf("%-8s redirects=%zu p50=%.1fus p99=%.1fus p99.9=%.1fus\n",
+                mode.c_str(), all.size(), pct(0.50), pct(0.99), pct(0.999));
+
+    remove_db(urls_path);
+    remove_db(logs_path);
+}
+
+int main(int argc, char** argv) {
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 3;
+    if (argc > 1) {
+        run(argv[1], seconds);
+    } else {
+        run("shared", seconds);
+        run("separate", seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "cached_store.hpp"
+#include "database.hpp"
+#include "handlers.hpp"
+#include "request_arena.hpp"
+#include "sqlite_store.hpp"
+#include "utils.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Heap allocations and time per request for the routes the server answers most, run through the
+// real handlers with and without the per-request arena. The counts include what Crow allocates
+// for routing and the response headers, which the arena does not cover.
+// Usage: request_alloc [requests]
+
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// std::pmr::new_delete_resource() allocates through the aligned forms.
+void* operator new(size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+static const int links = 1000;
+
+static crow::request make_request(crow::HTTPMethod method, const std::string& url, const std::string& body = "") {
+    crow::request req;
+    req.method = method;
+    req.raw_url = url;
+    req.url = url.substr(0, url.find('?'));
+    req.url_params = crow::query_string(url);
+    req.body = body;
+    req.add_header("X-Admin-Token", "bench");
+    req.add_header("X-Forwarded-For", "203.0.113.7");
+    return req;
+}
+
+static void measure(App& app, const char* label, crow::request req, size_t requests) {
+    for (size_t arena_size : {size_t(16 * 1024), size_t(0)}) {
+        set_request_arena_size(arena_size);
+        int status = 0;
+        uint64_t before = allocations.load();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < requests; ++i) {
+            crow::response res;
+            begin_request_arena();
+            app.handle_full(req, res);
+            end_request_arena();
+            status = res.code;
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        uint64_t allocated = allocations.load() - before;
+        std::printf("%-14s %-6s %7.1f ns, %5.2f allocations per request (status %d)\n", label,
+                    arena_size > 0 ? "arena" : "heap", ns / requests, static_cast<double>(allocated) / requests, status);
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t requests = argc > 1 ? std::stoul(argv[1]) : 200000;
+    sqlite3* handle = nullptr;
+    sqlite3_open(":memory:", &handle);
+    auto cache = std::make_unique<CachedStore>(std::make_unique<SqliteStore>(handle), 2 * links);
+    std::vector<std::pair<ShortCode, std::string>> entries;
+    for (int i = 0; i < links; ++i) {
+        entries.emplace_back(generate_short(6), "https://docs.example.com/guides/page-" + std::to_string(i));
+    }
+    cache->insert_batch(entries);
+    set_store(std::move(cache));
+    std::string code = entries[0].first.str();
+    get_url(code);
+
+    App app;
+    setup_health_routes(app);
+    setup_routes(app, 6);
+    setup_admin_routes(app, "bench");
+    app.validate();
+
+    measure(app, "redirect", make_request(crow::HTTPMethod::Get, "/" + code), requests);
+    measure(app, "shorten", make_request(crow::HTTPMethod::Post, "/shorten", R"({"url":")" + entries[0].second + R"("})"),
+            requests);
+    measure(app, "readyz", make_request(crow::HTTPMethod::Get, "/readyz"), requests);
+    measure(app, "admin/logging", make_request(crow::HTTPMethod::Get, "/admin/logging"), requests / 10);
+    measure(app, "admin/domains", make_request(crow::HTTPMethod::Get, "/admin/domains?host=docs.example.com&limit=50"),
+            requests / 100);
+
+    set_store(nullptr);
+    sqlite3_close(handle);
+    return 0;
+}
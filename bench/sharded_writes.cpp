@@ -0,0 +1,73 @@
+#include "database.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Concurrent single-link inserts (one transaction each, as /shorten does) against the
+// single-file SQLite store and the sharded store with 1, 2, 4 and 8 shards.
+// Usage: sharded_writes [seconds] [threads]
+
+static void cleanup() {
+    std::filesystem::remove_all("bench_shards");
+    std::remove("bench_single.db");
+    std::remove("bench_single.db-wal");
+    std::remove("bench_single.db-shm");
+}
+
+static void run(const std::string& label, const Config& config, int seconds, int threads) {
+    cleanup();
+    sqlite3_open("bench_single.db", &db);
+    set_journal_mode(db, "WAL");
+    sqlite3_busy_timeout(db, 5000);
+    auto store = create_store(config);
+    if (!store) {
+        std::printf("%s: failed to open\n", label.c_str());
+        sqlite3_close(db);
+        return;
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<long> inserts{0};
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threads; ++t) {
+        writers.emplace_back([&, t] {
+            long i = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                std::string id = std::to_string(t) + "_" + std::to_string(i++);
+                store->insert("w" + id, "https://example.com/page?id=" + id);
+                inserts.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    done.store(true);
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    std::printf("%-10s threads=%d inserts=%.0f/s\n", label.c_str(), threads, inserts.load() / static_cast<double>(seconds));
+
+    store.reset();
+    sqlite3_close(db);
+    cleanup();
+}
+
+int main(int argc, char** argv) {
+    int seconds = argc > 1 ? std::stoi(argv[1]) : 5;
+    int threads = argc > 2 ? std::stoi(argv[2]) : 8;
+
+    Config single;
+    single.storage_engine = "sqlite";
+    run("sqlite", single, seconds, threads);
+    for (size_t shards : {1, 2, 4, 8}) {
+        Config config;
+        config.storage_engine = "sharded";
+        config.shard_dir = "bench_shards";
+        config.shard_count = shards;
+        run("sharded/" + std::to_string(shards), config, seconds, threads);
+    }
+    return 0;
+}
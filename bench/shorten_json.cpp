@@ -0,0 +1,55 @@
+#include "crow_all.h"
+#include "fast_json.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Parses POST /shorten bodies and builds the {"short_url": ...} response the way the handler
+// used to (crow::json::load + wvalue) and with the fast_json scanner and writer.
+
+static const std::vector<std::string> payloads = {
+    R"({"url":"https://example.com/"})",
+    R"({"url":"https://www.example.com/articles/2024/05/how-to-shorten-urls?utm_source=newsletter&utm_medium=email&utm_campaign=spring"})",
+    R"({"url": "https:\/\/shop.example.org\/catalog\/item\/123456?ref=app&lang=en-US", "client": "ios", "version": 3})",
+    R"({"campaign":{"id":42,"tags":["a","b"]},"url":"https://example.net/landing/page-with-a-fairly-long-path/and/more/segments/index.html#section-2"})",
+};
+
+static volatile size_t sink;
+
+template <typename F>
+static void run(const char* name, int iterations, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        sink += f(payloads[i % payloads.size()]);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-8s %8.1f ns/request\n", name, seconds * 1e9 / iterations);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 1000000;
+    const std::string short_code = "aZ3kQ9";
+
+    run("crow", iterations, [&short_code](const std::string& body) -> size_t {
+        auto json = crow::json::load(body);
+        if (!json || !json.has("url")) {
+            return 0;
+        }
+        std::string url = json["url"].s();
+        crow::json::wvalue response;
+        response["short_url"] = "http://localhost:8080/" + short_code;
+        return url.size() + response.dump().size();
+    });
+
+    run("fast", iterations, [&short_code](const std::string& body) -> size_t {
+        ShortenRequest request;
+        if (!parse_shorten_request(body, request)) {
+            return 0;
+        }
+        JsonWriter<256> writer;
+        std::string response(writer.field("short_url", "http://localhost:8080/", short_code).finish());
+        return request.url.size() + response.size();
+    });
+    return 0;
+}
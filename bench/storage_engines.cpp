@@ -0,0 +1,124 @@
+#include "database.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+// Runs the same workload against each storage engine through the UrlStore interface:
+// batched inserts, reopen time, then get / get_by_url latency percentiles.
+// Codes are scrambled ids so inserts arrive in random key order, as generated codes do.
+// Usage: storage_engines [links] [engine...], e.g. storage_engines 100000000 lsm
+
+static double elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string code_for(int i) {
+    static const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    uint64_t x = static_cast<uint64_t>(i) * 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 29;
+    std::string code(8, '0');
+    for (auto& c : code) {
+        c = charset[x % 62];
+        x /= 62;
+    }
+    return code + std::to_string(i % 10);
+}
+
+static std::string url_for(int i) {
+    return "https://example.com/products/item?id=" + std::to_string(i);
+}
+
+static Config bench_config(const std::string& engine) {
+    Config config;
+    config.storage_engine = engine;
+    config.mmap_dir = "bench_store_mmap";
+    config.mmap_initial_capacity = 16;
+    config.lsm_dir = "bench_store_lsm";
+    config.shard_dir = "bench_store_shards";
+    return config;
+}
+
+static void cleanup() {
+    std::filesystem::remove_all("bench_store_mmap");
+    std::filesystem::remove_all("bench_store_lsm");
+    std::filesystem::remove_all("bench_store_shards");
+    std::remove("bench_store.db");
+    std::remove("bench_store.db-wal");
+    std::remove("bench_store.db-shm");
+}
+
+template <typename F>
+static void percentiles(const char* label, int links, F&& lookup) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> dis(0, links - 1);
+    std::vector<double> samples;
+    int count = std::min(links * 2, 500000);
+    samples.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        int id = dis(gen);
+        auto start = std::chrono::steady_clock::now();
+        lookup(id);
+        samples.push_back(elapsed_us(start));
+    }
+    std::sort(samples.begin(), samples.end());
+    std::printf("  %-10s p50=%.2fus p99=%.2fus p99.9=%.2fus\n", label,
+                samples[count / 2], samples[count * 99 / 100], samples[count * 999 / 1000]);
+}
+
+static void run(const std::string& engine, int links) {
+    cleanup();
+    sqlite3_open("bench_store.db", &db);
+    set_journal_mode(db, "WAL");
+    auto store = create_store(bench_config(engine));
+    if (!store) {
+        std::printf("%s: failed to open\n", engine.c_str());
+        sqlite3_close(db);
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const int batch_size = 1000;
+    std::vector<std::pair<ShortCode, std::string>> batch;
+    for (int i = 0; i < links; ++i) {
+        batch.emplace_back(code_for(i), url_for(i));
+        if (static_cast<int>(batch.size()) == batch_size || i == links - 1) {
+            store->insert_batch(batch);
+            batch.clear();
+        }
+    }
+    double insert_us = elapsed_us(start);
+    store.reset();
+    sqlite3_close(db);
+
+    start = std::chrono::steady_clock::now();
+    sqlite3_open("bench_store.db", &db);
+    store = create_store(bench_config(engine));
+    double open_us = elapsed_us(start);
+
+    std::printf("%s: links=%d inserts=%.0f/s open=%.0fus\n", engine.c_str(), links, links / (insert_us / 1e6), open_us);
+    percentiles("get", links, [&](int id) { store->get(code_for(id)); });
+    percentiles("get_by_url", links, [&](int id) { store->get_by_url(url_for(id)); });
+
+    store.reset();
+    sqlite3_close(db);
+    cleanup();
+}
+
+int main(int argc, char** argv) {
+    int links = argc > 1 ? std::stoi(argv[1]) : 100000;
+    std::vector<std::string> engines;
+    for (int i = 2; i < argc; ++i) {
+        engines.push_back(argv[i]);
+    }
+    if (engines.empty()) {
+        engines = {"sqlite", "mmap", "lsm"};
+    }
+    for (const auto& engine : engines) {
+        run(engine, links);
+    }
+    return 0;
+}
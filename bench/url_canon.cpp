@@ -0,0 +1,75 @@
+#include "url_canon.hpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// Canonicalizes two corpora with each scan level the CPU supports and reports input
+// throughput: "mixed" URLs with uppercase hosts, default ports and escapes, which stop the
+// scans often, and "clean" URLs with long already-canonical paths, where the scans run freely.
+
+static std::vector<std::string> make_mixed(size_t count) {
+    static const char* hosts[] = {"example.com", "WWW.Example.org:443", "shop.example.net:80", "cdn.Example-Images.co.uk"};
+    static const char* segments[] = {"articles", "2024", "05", "how-to-shorten-urls", "catalog", "item", "index.html", "a%2fb", "caf%C3%A9"};
+    static const char* queries[] = {"", "?utm_source=newsletter&utm_medium=email&utm_campaign=spring", "?id=123456&ref=app", "?q=%7euser"};
+    std::mt19937 rng(42);
+    std::vector<std::string> corpus;
+    for (size_t i = 0; i < count; ++i) {
+        std::string url = rng() % 2 ? "https://" : "HTTP://";
+        url += hosts[rng() % 4];
+        size_t depth = 1 + rng() % 6;
+        for (size_t d = 0; d < depth; ++d) {
+            url += '/';
+            url += segments[rng() % 9];
+        }
+        url += queries[rng() % 4];
+        corpus.push_back(url);
+    }
+    return corpus;
+}
+
+static std::vector<std::string> make_clean(size_t count) {
+    std::mt19937 rng(7);
+    std::vector<std::string> corpus;
+    for (size_t i = 0; i < count; ++i) {
+        std::string url = "https://static.example-content-delivery.com/";
+        size_t length = 150 + rng() % 200;
+        while (url.size() < length) {
+            url += "assets/v" + std::to_string(rng() % 1000) + "/bundle-" + std::to_string(rng()) + ".js?";
+        }
+        corpus.push_back(url);
+    }
+    return corpus;
+}
+
+static void run(const char* name, const std::vector<std::string>& corpus, int rounds) {
+    size_t bytes = 0;
+    for (const auto& url : corpus) {
+        bytes += url.size();
+    }
+    std::printf("%s: %zu urls, %.1f bytes on average\n", name, corpus.size(), static_cast<double>(bytes) / corpus.size());
+    std::string out;
+    for (int level = 0; level <= static_cast<int>(supported_url_scan_level()); ++level) {
+        set_url_scan_level(static_cast<UrlScanLevel>(level));
+        size_t valid = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; ++round) {
+            for (const auto& url : corpus) {
+                valid += canonicalize_url(url, out);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("  %-8s %6.2f GB/s  %6.1f ns/url  (%zu valid)\n", url_scan_level_name(static_cast<UrlScanLevel>(level)),
+                    bytes * static_cast<double>(rounds) / seconds / 1e9, seconds * 1e9 / (corpus.size() * rounds),
+                    valid / rounds);
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1000;
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 2000;
+    run("mixed", make_mixed(count), rounds);
+    run("clean", make_clean(count), rounds);
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include "compressed_store.hpp"
+#include "database.hpp"
+#include "sqlite_store.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+// Stores the same URLs raw and through CompressedStore in SQLite: dictionary training time,
+// bytes saved, database file size, encode / decode cost and redirect (get) latency without a
+// cache in front.
+// Usage: url_compression [links]
+
+static double elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Campaign links: a few hosts, shared path shapes and UTM parameters.
+static std::vector<std::string> make_urls(int count) {
+    static const char* hosts[] = {"https://www.example.com", "https://shop.example.org", "https://blog.example.net",
+                                  "https://news.example.co.uk"};
+    static const char* sections[] = {"/articles/", "/products/item/", "/catalog/category/", "/2024/05/posts/"};
+    static const char* sources[] = {"newsletter", "twitter", "facebook", "partner"};
+    static const char* mediums[] = {"email", "social", "cpc"};
+    std::mt19937 rng(42);
+    std::vector<std::string> urls;
+    urls.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        std::string url = hosts[rng() % 4];
+        url += sections[rng() % 4];
+        url += std::to_string(i);
+        if (rng() % 3 != 0) {
+            url += "?utm_source=";
+            url += sources[rng() % 4];
+            url += "&utm_medium=";
+            url += mediums[rng() % 3];
+            url += "&utm_campaign=spring_sale_" + std::to_string(rng() % 20);
+        }
+        urls.push_back(url);
+    }
+    return urls;
+}
+
+static void cleanup(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+static double get_latency_us(UrlStore& store, int links) {
+    std::mt19937 rng(7);
+    int count = std::min(links, 100000);
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (int i = 0; i < count; ++i) {
+        found += !store.get("c" + std::to_string(rng() % links)).empty();
+    }
+    double us = elapsed_us(start) / count;
+    if (found != static_cast<size_t>(count)) {
+        std::printf("missing urls: %zu of %d found\n", found, count);
+    }
+    return us;
+}
+
+int main(int argc, char** argv) {
+    int links = argc > 1 ? std::stoi(argv[1]) : 200000;
+    auto urls = make_urls(links);
+    std::vector<std::pair<ShortCode, std::string>> entries;
+    size_t raw = 0;
+    for (int i = 0; i < links; ++i) {
+        entries.emplace_back("c" + std::to_string(i), urls[i]);
+        raw += urls[i].size();
+    }
+    std::printf("%d urls, %.1f bytes on average\n", links, static_cast<double>(raw) / links);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> sample(urls.begin(), urls.begin() + std::min<size_t>(urls.size(), 20000));
+    UrlDictionary dictionary = UrlDictionary::train(sample);
+    std::printf("training on %zu urls: %.1f ms, %zu tokens\n", sample.size(), elapsed_us(start) / 1000, dictionary.size());
+
+    size_t encoded_bytes = 0;
+    std::vector<std::string> encoded;
+    encoded.reserve(links);
+    start = std::chrono::steady_clock::now();
+    for (const auto& url : urls) {
+        encoded.push_back(dictionary.encode(url));
+    }
+    double encode_ns = elapsed_us(start) * 1000 / links;
+    for (const auto& value : encoded) {
+        encoded_bytes += value.size();
+    }
+    start = std::chrono::steady_clock::now();
+    size_t decoded_bytes = 0;
+    for (const auto& value : encoded) {
+        decoded_bytes += dictionary.decode(value).size();
+    }
+    double decode_ns = elapsed_us(start) * 1000 / links;
+    std::printf("url bytes: %zu -> %zu (%.1f%% saved), encode %.0f ns, decode %.0f ns per url\n", raw, encoded_bytes,
+                100.0 * (raw - encoded_bytes) / raw, encode_ns, decode_ns);
+    if (decoded_bytes != raw) {
+        std::printf("decode mismatch\n");
+        return 1;
+    }
+
+    for (bool compressed : {false, true}) {
+        std::string path = compressed ? "bench_compressed.db" : "bench_raw.db";
+        cleanup(path);
+        sqlite3* handle = nullptr;
+        sqlite3_open(path.c_str(), &handle);
+        set_journal_mode(handle, "WAL");
+        std::unique_ptr<UrlStore> store = std::make_unique<SqliteStore>(handle);
+        if (compressed) {
+            store = std::make_unique<CompressedStore>(std::move(store), dictionary);
+        }
+        start = std::chrono::steady_clock::now();
+        store->insert_batch(entries);
+        double insert_us = elapsed_us(start) / links;
+        double get_us = get_latency_us(*store, links);
+        checkpoint_wal(handle);
+        sqlite3_close(handle);
+        std::printf("%-10s db %6.1f MB, insert %.2f us, get %.2f us per url\n", compressed ? "compressed" : "raw",
+                    std::filesystem::file_size(path) / 1e6, insert_us, get_us);
+        cleanup(path);
+    }
+    UrlCompressionStats stats = url_compression_stats();
+    std::printf("decode during gets: %.0f ns on average over %llu decodes\n",
+                stats.decodes > 0 ? static_cast<double>(stats.decode_ns) / stats.decodes : 0.0,
+                static_cast<unsigned long long>(stats.decodes));
+    return 0;
+}
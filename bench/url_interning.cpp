@@ -0,0 +1,114 @@
+#include "cached_store.hpp"
+#include "database.hpp"
+#include "interned_store.hpp"
+#include "sqlite_store.hpp"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+// Stores the same links in SQLite whole and with interned prefixes: database size, bytes the
+// cache holds for the hottest links, get latency, and the cost of listing one host's links by
+// scanning every row versus a range on the url index.
+// Usage: url_interning [links]
+
+static double elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A handful of hosts with a few sections each, as a shop or a news site would have. The docs
+// host, which the per-host query lists, gets 1% of the links.
+static std::vector<std::string> make_urls(int count) {
+    static const char* hosts[] = {"https://www.ourshop.example", "https://blog.ourshop.example", "https://news.example.org",
+                                  "https://cdn.example-images.net", "https://docs.example.com"};
+    static const char* sections[] = {"/products/", "/categories/", "/articles/", "/static/img/", "/guides/"};
+    std::mt19937 rng(42);
+    std::vector<std::string> urls;
+    for (int i = 0; i < count; ++i) {
+        std::string url = hosts[rng() % 100 == 0 ? 4 : rng() % 4];
+        url += sections[rng() % 5];
+        url += "item-" + std::to_string(i) + "-" + std::to_string(rng() % 1000);
+        if (rng() % 2 == 0) {
+            url += "?ref=home";
+        }
+        urls.push_back(url);
+    }
+    return urls;
+}
+
+static void cleanup(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+int main(int argc, char** argv) {
+    int links = argc > 1 ? std::stoi(argv[1]) : 200000;
+    auto urls = make_urls(links);
+    std::vector<std::pair<ShortCode, std::string>> entries;
+    for (int i = 0; i < links; ++i) {
+        entries.emplace_back("c" + std::to_string(i), urls[i]);
+    }
+    const size_t cached = 20000;
+
+    for (bool interned : {false, true}) {
+        std::string path = interned ? "bench_interned.db" : "bench_whole.db";
+        cleanup(path);
+        sqlite3* handle = nullptr;
+        sqlite3_open(path.c_str(), &handle);
+        set_journal_mode(handle, "WAL");
+        auto cached_store = std::make_unique<CachedStore>(std::make_unique<SqliteStore>(handle), cached);
+        CachedStore* cache = cached_store.get();
+        std::unique_ptr<UrlStore> store = std::move(cached_store);
+        if (interned) {
+            store = open_interned_store(std::move(store), handle, 65536);
+        }
+        store->insert_batch(entries);
+
+        // Fill the cache, then count what it holds.
+        std::vector<ShortCode> hot;
+        for (size_t i = 0; i < cached; ++i) {
+            hot.push_back("c" + std::to_string(i));
+        }
+        store->get_batch(hot);
+        size_t cache_bytes = 0;
+        for (const auto& code : hot) {
+            std::string value;
+            if (cache->get_cached(code, value)) {
+                cache_bytes += value.size();
+            }
+        }
+
+        std::mt19937 rng(7);
+        int gets = std::min(links, 100000);
+        auto start = std::chrono::steady_clock::now();
+        size_t found = 0;
+        for (int i = 0; i < gets; ++i) {
+            found += !store->get("c" + std::to_string(rng() % links)).empty();
+        }
+        double get_us = elapsed_us(start) / gets;
+
+        size_t on_host = 0;
+        start = std::chrono::steady_clock::now();
+        store->for_each_on_host("docs.example.com", [&on_host](const ShortCode&, const std::string&) { ++on_host; });
+        double range_ms = elapsed_us(start) / 1000;
+        size_t scanned = 0;
+        start = std::chrono::steady_clock::now();
+        store->for_each([&scanned](const ShortCode&, const std::string& url) {
+            scanned += url.compare(0, 25, "https://docs.example.com/") == 0;
+        });
+        double scan_ms = elapsed_us(start) / 1000;
+
+        checkpoint_wal(handle);
+        store.reset();
+        sqlite3_close(handle);
+        std::printf("%-8s db %6.1f MB, cache %5.2f MB for %zu links, get %.2f us (%zu found), "
+                    "one host: range %.1f ms, scan %.1f ms (%zu/%zu links)\n",
+                    interned ? "interned" : "whole", std::filesystem::file_size(path) / 1e6, cache_bytes / 1e6, cached,
+                    get_us, found, range_ms, scan_ms, on_host, scanned);
+        cleanup(path);
+    }
+    return 0;
+}
@@ -11213,7 +11213,8 @@ namespace crow // NOTE: Already documented in "crow/app.h"
              std::tuple<Middlewares...>* middlewares = nullptr,
              unsigned int concurrency = 1,
              uint8_t timeout = 5,
-             typename Adaptor::context* adaptor_ctx = nullptr):
+             typename Adaptor::context* adaptor_ctx = nullptr,
+             int listen_fd = -1):
           concurrency_(concurrency),
           task_queue_length_pool_(concurrency_ - 1),
           acceptor_(io_context_),
@@ -11232,6 +11233,17 @@ namespace crow // NOTE: Already documented in "crow/app.h"
 
             error_code ec;
 
+            if (listen_fd >= 0)
+            {
+                // Adopt a socket that is already bound and listening, e.g. one handed over by another process.
+                acceptor_.raw_acceptor().assign(endpoint.protocol(), listen_fd, ec);
+                if (ec) {
+                    CROW_LOG_ERROR << "Failed to assign listening socket: " << ec.message();
+                    startup_failed_ = true;
+                }
+                return;
+            }
+
             acceptor_.raw_acceptor().open(endpoint.protocol(), ec);
             if (ec) {
                 CROW_LOG_ERROR << "Failed to open acceptor: " << ec.message();
@@ -14798,6 +14810,13 @@ namespace crow
             return bindaddr_;
         }
 
+        /// \brief Accept on an already listening TCP socket instead of binding port() (the socket is owned by Crow afterwards)
+        self_t& listen_fd(int fd)
+        {
+            listen_fd_ = fd;
+            return *this;
+        }
+
         /// \brief Disable tcp/ip and use unix domain socket instead
         self_t& local_socket_path(std::string path)
         {
@@ -15015,7 +15034,7 @@ namespace crow
                         return;
                     }
                     TCPAcceptor::endpoint endpoint(addr, port_);
-                    server_ = std::move(std::unique_ptr<server_t>(new server_t(this, endpoint, server_name_, &middlewares_, concurrency_, timeout_, nullptr)));
+                    server_ = std::move(std::unique_ptr<server_t>(new server_t(this, endpoint, server_name_, &middlewares_, concurrency_, timeout_, nullptr, listen_fd_)));
                     server_->set_tick_function(tick_interval_, tick_function_);
                     for (auto snum : signals_)
                     {
@@ -15280,6 +15299,7 @@ namespace crow
         std::unique_ptr<unix_server_t> unix_server_;
 
         std::vector<int> signals_{SIGINT, SIGTERM};
+        int listen_fd_ = -1;
 
         bool server_started_{false};
         std::condition_variable cv_started_;
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class AccessEvent : uint8_t {
+    None = 0,
+    Shortened = 1,
+    ShortenExisting = 2,
+    ShortenInvalid = 3,
+    Redirect = 4,
+    RedirectNotFound = 5,
+    Deleted = 6,
+    DeleteNotFound = 7,
+    BadRequest = 8,
+    RateLimited = 9,
+    Shed = 10,
+    DeadlineExceeded = 11,
+    AliasTaken = 12,
+};
+
+// On-disk record, 48 bytes. `event` is written last so a reader never sees a half-written slot.
+struct AccessRecord {
+    uint64_t timestamp_us;
+    uint32_t user_agent_id;
+    uint16_t status;
+    uint8_t event;
+    uint8_t code_length;
+    uint8_t ip[16];
+    char code[16];
+};
+
+static_assert(sizeof(AccessRecord) == 48, "AccessRecord layout is part of the segment file format");
+
+struct AccessLogSegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    uint64_t created_us;
+    char reserved[32];
+};
+
+static_assert(sizeof(AccessLogSegmentHeader) == 64, "AccessLogSegmentHeader layout is part of the segment file format");
+
+class AccessLog {
+public:
+    ~AccessLog();
+
+    bool open(const std::string& dir, size_t segment_size, int max_segments);
+    void close();
+    void flush();
+    void write(AccessEvent event, int status, std::string_view code, std::string_view ip, const std::string& user_agent);
+
+private:
+    bool open_segment(uint64_t seq);
+    void close_segment();
+    void rotate(uint64_t seq);
+    uint32_t user_agent_id(const std::string& user_agent);
+
+    std::string dir_;
+    size_t segment_size_ = 0;
+    int max_segments_ = 0;
+
+    std::shared_mutex mutex_;
+    uint8_t* base_ = nullptr;
+    uint64_t capacity_ = 0;
+    uint64_t seq_ = 0;
+    std::atomic<uint64_t> next_{0};
+
+    std::shared_mutex ua_mutex_;
+    std::unordered_map<std::string, uint32_t> user_agents_;
+    std::ofstream ua_file_;
+};
+
+static const int access_event_count = 13;
+
+bool open_access_log(const std::string& dir, size_t segment_size, int max_segments);
+void close_access_log();
+// Callers check access_log_sampled() first so dropped events skip all argument building.
+bool access_log_sampled(AccessEvent event);
+void set_access_sample_rate(AccessEvent event, double rate);
+double access_sample_rate(AccessEvent event);
+void access_log(AccessEvent event, int status, std::string_view code, std::string_view ip, const std::string& user_agent);
+
+const char* access_event_name(AccessEvent event);
+AccessEvent parse_access_event(const std::string& name);
+std::string format_access_ip(const uint8_t ip[16]);
+std::vector<std::string> list_access_log_segments(const std::string& dir);
+std::vector<AccessRecord> read_access_log_segment(const std::string& path);
+std::vector<std::string> read_user_agents(const std::string& dir);
+std::string access_record_to_csv(const AccessRecord& record, const std::vector<std::string>& user_agents);
+std::string access_record_to_json(const AccessRecord& record, const std::vector<std::string>& user_agents);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Work that has to reach storage, cheapest to refuse first.
+enum class AdmissionClass : uint8_t {
+    Write = 0,
+    Read = 1,
+};
+
+// CoDel-style admission to storage. At most max_inflight requests use storage at once; the
+// rest wait, and their queueing delay drives a shed level: once the delay has stayed above
+// target_ms for interval_ms, waiting writes are refused, then waiting reads too. Each
+// interval spent below target lowers the level again. max_inflight 0 admits everything.
+void configure_admission(size_t max_inflight, int target_ms, int interval_ms);
+// 0 - nothing shed, 1 - writes shed, 2 - writes and reads shed.
+int admission_shed_level();
+
+// Holds a storage slot for its lifetime. A request that is not admitted should be answered
+// with 503 right away, or 504 if its deadline ran out while waiting.
+class StorageAdmission {
+public:
+    explicit StorageAdmission(AdmissionClass admission_class);
+    ~StorageAdmission();
+
+    StorageAdmission(const StorageAdmission&) = delete;
+    StorageAdmission& operator=(const StorageAdmission&) = delete;
+
+    bool admitted() const { return admitted_; }
+
+private:
+    bool admitted_ = false;
+    bool counted_ = false;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "short_code.hpp"
+#include <cstddef>
+#include <string_view>
+#include <sqlite3.h>
+
+// Custom short codes chosen by the client. An alias is claimed by storing its link with
+// insert_new_url(), which fails if the code or the URL is already taken, and is then recorded
+// in the aliases table of the main database. Aliases are base62 like every code, but never of
+// the length of generated codes, so they cannot collide with them. The recorded aliases are
+// also held in memory, reloaded from the table every second for those other processes add or
+// release, to answer availability checks without storage access.
+bool open_aliases(sqlite3* handle, size_t code_length, size_t legacy_length);
+void close_aliases();
+
+bool alias_valid(std::string_view name);
+// From memory and advisory only; up to a second behind other processes.
+bool alias_known(const ShortCode& alias);
+
+bool record_alias(const ShortCode& alias);
+void release_alias(const ShortCode& alias);
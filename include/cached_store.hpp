@@ -0,0 +1,72 @@
+#pragma once
+
+#include "url_store.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Sharded LRU cache of short code -> URL in front of another engine. Entries count their
+// hits so the hottest codes can be snapshotted and preloaded after a restart. Only writes through
+// this instance invalidate entries; with ttl_ms > 0 an entry is also reloaded once it is that old,
+// which bounds how long a change made by another process goes unseen.
+class CachedStore : public UrlStore {
+public:
+    CachedStore(std::unique_ptr<UrlStore> backend, size_t capacity, int64_t ttl_ms = 0);
+
+    void insert(const ShortCode& short_code, const std::string& url) override;
+    bool insert_new(const ShortCode& short_code, const std::string& url) override;
+    std::string get(const ShortCode& short_code) override;
+    ShortCode get_by_url(const std::string& url) override;
+    void remove(const ShortCode& short_code) override;
+    void for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+
+    void insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) override;
+    std::vector<std::string> get_batch(const std::vector<ShortCode>& short_codes) override;
+    void remove_batch(const std::vector<ShortCode>& short_codes) override;
+    bool healthy() override;
+    bool get_cached(const ShortCode& short_code, std::string& url) override;
+    void for_each_with_prefix(const std::string& prefix,
+                              const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+    bool has_url_index() override;
+
+    // Most-hit cached codes, hottest first.
+    std::vector<ShortCode> hottest(size_t count);
+    size_t size();
+    void clear();
+    UrlStore& backend();
+
+private:
+    struct Node {
+        ShortCode short_code;
+        std::string url;
+        uint32_t hits = 0;
+        // steady_clock nanoseconds; unused without a TTL.
+        int64_t expires_at = 0;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Node> lru;
+        std::unordered_map<ShortCode, std::list<Node>::iterator> index;
+        // Bumped by every invalidation so a miss cannot cache a URL that was replaced or
+        // deleted while it was being read from the backend.
+        uint64_t generation = 0;
+    };
+
+    static const size_t shard_count = 16;
+
+    Shard& shard_for(const ShortCode& short_code);
+    bool lookup(const ShortCode& short_code, std::string& url, uint64_t& generation);
+    void put(const ShortCode& short_code, const std::string& url, uint64_t generation);
+    void erase(const ShortCode& short_code);
+
+    std::unique_ptr<UrlStore> backend_;
+    size_t shard_capacity_;
+    int64_t ttl_ns_;
+    Shard shards_[shard_count];
+};
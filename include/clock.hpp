@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// UTC "YYYY-MM-DD HH:MM:SS.mmm". The seconds prefix is rebuilt at most once per second per thread.
+static const size_t timestamp_length = 23;
+
+uint64_t current_time_us();
+size_t format_timestamp(uint64_t time_us, char* out);
+std::string current_timestamp();
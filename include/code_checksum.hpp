@@ -0,0 +1,20 @@
+#pragma once
+
+#include "short_code.hpp"
+#include <cstddef>
+#include <string>
+
+// Optional check character at the end of generated short codes: a base62 digit of a keyed hash
+// of the rest of the code and its length. The redirect and delete handlers reject codes with the
+// wrong length or check character before touching the cache or storage, so typos and scanners
+// cost a hash instead of a lookup. code_length is the full length of checksummed codes, 0
+// disables the check; codes of legacy_length were issued before it and are looked up as before.
+void configure_code_checksum(size_t code_length, const std::string& key, size_t legacy_length);
+bool code_checksum_enabled();
+
+// The check character for the first length characters of chars.
+char code_check_char(const char* chars, size_t length);
+
+// False for codes that cannot have been issued: not of the checksummed or legacy length, or with
+// a check character that does not match. The same work for every code of a given length.
+bool code_may_exist(const ShortCode& code);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "short_code.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Bounded multi-producer multi-consumer queue of short codes without locks: each cell carries
+// a sequence number that tells producers and consumers whose turn it is (Vyukov's design).
+// Codes come out in the order they went in.
+class CodeQueue {
+public:
+    explicit CodeQueue(size_t capacity);
+
+    bool push(const ShortCode& code);
+    bool pop(ShortCode& code);
+    size_t capacity() const { return mask_ + 1; }
+    // Approximate while other threads push and pop.
+    size_t size() const;
+    // Codes popped so far.
+    uint64_t popped() const { return dequeue_pos_.load(std::memory_order_acquire); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        ShortCode code;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+};
+
+// Unused codes generated and checked against storage ahead of time by a background thread, so
+// /shorten takes one without a lookup (its insert still fails on a taken code). Each refill reserves a batch of codes in the
+// code_reservations table of db_path; once the pool has handed out a whole batch, its rows are
+// deleted. Each start owns its rows under a random token and holds a lease on them that the
+// thread keeps renewing; rows of a pool that stopped, or crashed and let its lease run out,
+// are checked against storage again and put back in the pool, at start and periodically. The thread refills whenever the pool drops
+// to low_water.
+bool start_code_pool(const std::string& db_path, int short_code_length, size_t pool_size, size_t low_water,
+                     size_t refill_batch);
+void stop_code_pool();
+
+// A code from the pool, or generate_short(short_code_length) when the pool is empty or off.
+ShortCode next_short_code(int short_code_length);
+
+struct CodePoolStats {
+    size_t available = 0;
+    uint64_t taken = 0;
+    // Requests that found the pool empty and generated a code themselves.
+    uint64_t misses = 0;
+    uint64_t recovered = 0;
+};
+
+CodePoolStats code_pool_stats();
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "short_code.hpp"
+#include <cstdint>
+#include <string>
+#include <sqlite3.h>
+
+// Short codes from an ID sequence shared by every process on the same database (hi-lo): a
+// process leases a block of IDs from the code_sequence table in one transaction and hands them
+// out from memory, so processes never pick the same code and the table is written once per
+// block. A background thread leases the next block when a quarter of the current one is left.
+// IDs map to codes through a fixed bijection, so consecutive IDs give unrelated-looking codes.
+
+// Leases block_size IDs starting at start. False if the transaction failed.
+bool lease_id_block(sqlite3* handle, uint64_t block_size, uint64_t& start);
+// How many IDs have distinct codes of short_code_length; at most 62^10.
+uint64_t sequence_capacity(int short_code_length);
+// The code of id, with the check character when the code checksum is enabled.
+ShortCode sequence_code(uint64_t id, int short_code_length);
+
+bool start_code_sequence(const std::string& db_path, int short_code_length, uint64_t block_size);
+void stop_code_sequence();
+// The next code of the leased block. When no block is ready, waits for the next lease attempt,
+// but not past the request deadline; false if there is still none, or the sequence is off or
+// used up.
+bool next_sequence_code(ShortCode& code);
+
+struct CodeSequenceStats {
+    uint64_t leases = 0;
+    uint64_t issued = 0;
+    // Requests that found no leased block ready, even after waiting, and took a random code.
+    uint64_t behind = 0;
+};
+
+CodeSequenceStats code_sequence_stats();
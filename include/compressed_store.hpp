@@ -0,0 +1,58 @@
+#pragma once
+
+#include "url_dictionary.hpp"
+#include "url_store.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Stores URLs encoded with a trained UrlDictionary in another engine and decodes them on the
+// way out. Meant to sit under CachedStore, so the cache keeps decoded URLs.
+class CompressedStore : public UrlStore {
+public:
+    CompressedStore(std::unique_ptr<UrlStore> backend, UrlDictionary dictionary);
+
+    void insert(const ShortCode& short_code, const std::string& url) override;
+    bool insert_new(const ShortCode& short_code, const std::string& url) override;
+    std::string get(const ShortCode& short_code) override;
+    ShortCode get_by_url(const std::string& url) override;
+    void remove(const ShortCode& short_code) override;
+    void for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+
+    void insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) override;
+    std::vector<std::string> get_batch(const std::vector<ShortCode>& short_codes) override;
+    void remove_batch(const std::vector<ShortCode>& short_codes) override;
+    bool healthy() override;
+    bool get_cached(const ShortCode& short_code, std::string& url) override;
+
+    // Rewrites rows that are still stored raw. Returns how many were rewritten.
+    size_t compress_existing();
+    const UrlDictionary& dictionary() const { return dictionary_; }
+    UrlStore& backend();
+
+private:
+    std::string encode(const std::string& url);
+    std::string decode(const std::string& value);
+
+    std::unique_ptr<UrlStore> backend_;
+    UrlDictionary dictionary_;
+};
+
+// Loads the dictionary at path, or trains one on up to sample_size URLs of the backend, saves
+// it and compresses the rows already stored. Returns the backend unchanged if there is nothing
+// to train on yet or the dictionary cannot be saved, and nullptr if rows are compressed but the
+// dictionary is gone.
+std::unique_ptr<UrlStore> open_compressed_store(std::unique_ptr<UrlStore> backend, const std::string& path,
+                                                size_t sample_size);
+
+struct UrlCompressionStats {
+    size_t tokens = 0;
+    // URLs written since startup, before and after encoding.
+    uint64_t raw_bytes = 0;
+    uint64_t stored_bytes = 0;
+    uint64_t decodes = 0;
+    uint64_t decode_ns = 0;
+};
+
+UrlCompressionStats url_compression_stats();
@@ -1,5 +1,75 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <utility>
 
+struct Config {
+    int short_code_length = 6;
+    // 1 - the last character of new codes is a check character; see code_checksum.hpp.
+    bool short_code_checksum = false;
+    std::string short_code_checksum_key;
+    // Length of codes issued before the checksum was enabled; 0 - there are none.
+    size_t short_code_legacy_length = 0;
+    // 0 - /shorten generates and checks each code itself.
+    size_t code_pool_size = 0;
+    size_t code_pool_low_water = 2500;
+    size_t code_pool_refill_batch = 1000;
+    // IDs leased per block from the shared code sequence; 0 - random codes.
+    uint64_t code_sequence_block = 0;
+    std::string storage_engine = "sqlite";
+    std::string mmap_dir = "urls_mmap";
+    uint64_t mmap_initial_capacity = 1 << 20;
+    std::string lsm_dir = "urls_lsm";
+    size_t lsm_memtable_bytes = 4 * 1024 * 1024;
+    size_t lsm_compaction_trigger = 4;
+    bool lsm_sync_wal = false;
+    std::string shard_dir = "urls_shards";
+    size_t shard_count = 4;
+    // Empty - URLs are stored uncompressed.
+    std::string url_dictionary;
+    size_t url_dictionary_sample = 20000;
+    // 0 - URLs are stored without interned prefixes.
+    size_t url_prefix_limit = 0;
+    size_t cache_size = 100000;
+    // 0 - cached links are only invalidated by writes through this process.
+    int cache_ttl_ms = 60000;
+    std::string hot_set_path = "hot_codes.txt";
+    size_t hot_set_size = 10000;
+    int hot_set_interval = 60;
+    int health_probe_interval_ms = 1000;
+    int health_probe_timeout_ms = 500;
+    double ready_max_log_queue_fill = 0.9;
+    // route -> (tokens per second, burst)
+    std::unordered_map<std::string, std::pair<double, double>> rate_limits;
+    size_t rate_limit_clients = 65536;
+    // 0 - Crow default (one thread per core).
+    int server_threads = 0;
+    // 0 - half of the request worker threads; -1 - no admission control.
+    int admission_max_inflight = 0;
+    int admission_target_ms = 5;
+    int admission_interval_ms = 100;
+    // 0 - requests have no deadline unless they send X-Request-Timeout.
+    int request_timeout_ms = 0;
+    // Per worker thread; 0 - request temporaries go to the heap.
+    size_t request_arena_size = 16 * 1024;
+    int shutdown_drain_timeout_ms = 10000;
+    // Empty - no hot restart. Only for engines that several processes can open: sqlite, sharded.
+    std::string hot_restart_socket;
+    std::string db_path = "urls.db";
+    std::string db_journal_mode = "WAL";
+    std::string log_db_path = "logs.db";
+    std::string log_db_journal_mode = "WAL";
+    size_t log_queue_size = 10000;
+    std::string log_level = "INFO";
+    std::unordered_map<std::string, double> log_sample_rates;
+    std::string admin_token;
+    std::string access_log_dir = "access_logs";
+    size_t access_log_segment_size = 64 * 1024 * 1024;
+    int access_log_max_segments = 16;
+};
+
+Config load_settings(const std::string& path = "config.txt");
 int load_config();
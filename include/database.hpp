@@ -1,12 +1,25 @@
 #pragma once
 
+#include "config.hpp"
+#include "url_store.hpp"
+#include <memory>
 #include <string>
 #include <sqlite3.h>
 
 extern sqlite3* db;
 
 void init_db();
-void insert_url(const std::string& short_code, const std::string& url);
-std::string get_url(const std::string& short_code);
-std::string get_short_code(const std::string& url);
-void delete_url(const std::string& short_code);
\ No newline at end of file
+bool set_journal_mode(sqlite3* handle, const std::string& journal_mode);
+// Copies the write-ahead log back into the database file and truncates it.
+bool checkpoint_wal(sqlite3* handle);
+
+std::unique_ptr<UrlStore> create_store(const Config& config);
+void set_store(std::unique_ptr<UrlStore> store);
+UrlStore* current_store();
+
+void insert_url(const ShortCode& short_code, const std::string& url);
+bool insert_new_url(const ShortCode& short_code, const std::string& url);
+std::string get_url(const ShortCode& short_code);
+bool get_cached_url(const ShortCode& short_code, std::string& url);
+ShortCode get_short_code(const std::string& url);
+void delete_url(const ShortCode& short_code);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <sqlite3.h>
+
+// Deadline of the request handled on the current thread, in steady_time_us() units; 0 means
+// none. Background threads never set one, so their storage work is never cut short.
+uint64_t steady_time_us();
+void set_request_deadline(uint64_t deadline_us);
+uint64_t request_deadline();
+bool deadline_expired();
+// True once storage work on this thread has been skipped or aborted because the deadline
+// passed.
+bool deadline_interrupted();
+// Checked before each storage call: marks the request interrupted and returns true once its
+// deadline has passed.
+bool stop_if_expired();
+
+// Statements on handle stop with SQLITE_INTERRUPT when the running thread's deadline passes.
+// Locks held by other connections or processes are waited out for up to about five seconds,
+// but not past the deadline either.
+void watch_deadline(sqlite3* handle);
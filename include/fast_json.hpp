@@ -0,0 +1,254 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Fast path for the small JSON bodies of the public API. The scanner validates the whole
+// document but materializes nothing: string fields come back as views into the request body.
+
+struct JsonField {
+    std::string_view key;
+    // For strings, the text between the quotes, still escaped if `escaped`; otherwise the raw
+    // value text.
+    std::string_view value;
+    bool key_escaped = false;
+    bool is_string = false;
+    bool escaped = false;
+};
+
+size_t json_skip_space(std::string_view text, size_t pos);
+// pos at the opening quote; on success pos is just past the closing one.
+bool json_scan_string(std::string_view text, size_t& pos, std::string_view& contents, bool& escaped);
+bool json_skip_value(std::string_view text, size_t& pos, int depth);
+// Decodes escapes (including \u surrogate pairs) of a scanned string into out.
+bool json_unescape(std::string_view contents, std::string& out);
+
+// Calls on_field(const JsonField&) for each member of a top-level object, in order. Returns
+// false if body is not a single well-formed JSON object.
+template <typename OnField>
+bool scan_json_object(std::string_view body, OnField&& on_field) {
+    size_t pos = json_skip_space(body, 0);
+    if (pos >= body.size() || body[pos] != '{') {
+        return false;
+    }
+    pos = json_skip_space(body, pos + 1);
+    if (pos < body.size() && body[pos] == '}') {
+        return json_skip_space(body, pos + 1) == body.size();
+    }
+    while (true) {
+        JsonField field;
+        if (pos >= body.size() || body[pos] != '"' || !json_scan_string(body, pos, field.key, field.key_escaped)) {
+            return false;
+        }
+        pos = json_skip_space(body, pos);
+        if (pos >= body.size() || body[pos] != ':') {
+            return false;
+        }
+        pos = json_skip_space(body, pos + 1);
+        if (pos < body.size() && body[pos] == '"') {
+            field.is_string = true;
+            if (!json_scan_string(body, pos, field.value, field.escaped)) {
+                return false;
+            }
+        } else {
+            size_t start = pos;
+            if (!json_skip_value(body, pos, 0)) {
+                return false;
+            }
+            field.value = body.substr(start, pos - start);
+        }
+        on_field(static_cast<const JsonField&>(field));
+        pos = json_skip_space(body, pos);
+        if (pos < body.size() && body[pos] == ',') {
+            pos = json_skip_space(body, pos + 1);
+            continue;
+        }
+        if (pos < body.size() && body[pos] == '}') {
+            return json_skip_space(body, pos + 1) == body.size();
+        }
+        return false;
+    }
+}
+
+struct ShortenRequest {
+    // Points into the request body, or into unescaped_url when the JSON string had escapes.
+    std::string_view url;
+    std::string unescaped_url;
+    // The optional custom code; the same applies.
+    bool has_alias = false;
+    std::string_view alias;
+    std::string unescaped_alias;
+};
+
+// Reads a POST /shorten body. Returns false for malformed JSON, a missing or non-string url
+// or a non-string alias.
+bool parse_shorten_request(std::string_view body, ShortenRequest& request);
+
+// Writes a flat object of string fields into a buffer of Capacity bytes, so the handler
+// builds its response on the stack. A value may be given in parts, which are concatenated.
+// Values are escaped; keys are written as given.
+template <size_t Capacity>
+class JsonWriter {
+public:
+    template <typename... Parts>
+    JsonWriter& field(std::string_view key, const Parts&... value) {
+        put(size_ == 0 ? '{' : ',');
+        put('"');
+        append(key);
+        append("\":\"");
+        (escape(std::string_view(value)), ...);
+        put('"');
+        return *this;
+    }
+
+    // The finished object; empty if it did not fit.
+    std::string_view finish() {
+        if (size_ == 0) {
+            put('{');
+        }
+        put('}');
+        return overflowed_ ? std::string_view() : std::string_view(buffer_, size_);
+    }
+
+private:
+    void escape(std::string_view value) {
+        for (char c : value) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put(c);
+            } else if (u < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                append("\\u00");
+                put(hex[u >> 4]);
+                put(hex[u & 0xF]);
+            } else {
+                put(c);
+            }
+        }
+    }
+
+    void put(char c) {
+        if (size_ < Capacity) {
+            buffer_[size_++] = c;
+        } else {
+            overflowed_ = true;
+        }
+    }
+
+    void append(std::string_view text) {
+        if (text.size() > Capacity - size_) {
+            overflowed_ = true;
+            return;
+        }
+        std::memcpy(buffer_ + size_, text.data(), text.size());
+        size_ += text.size();
+    }
+
+    char buffer_[Capacity];
+    size_t size_ = 0;
+    bool overflowed_ = false;
+};
+
+// Builds a JSON document of any size into out, usually a request_string(), for responses
+// whose size is not known up front. Commas are placed automatically; strings are escaped.
+class JsonBuilder {
+public:
+    explicit JsonBuilder(std::pmr::string& out) : out_(out) {}
+
+    JsonBuilder& begin_object() {
+        separate();
+        out_ += '{';
+        comma_ = false;
+        return *this;
+    }
+
+    JsonBuilder& end_object() {
+        out_ += '}';
+        comma_ = true;
+        return *this;
+    }
+
+    JsonBuilder& begin_array() {
+        separate();
+        out_ += '[';
+        comma_ = false;
+        return *this;
+    }
+
+    JsonBuilder& end_array() {
+        out_ += ']';
+        comma_ = true;
+        return *this;
+    }
+
+    JsonBuilder& key(std::string_view name) {
+        separate();
+        string(name);
+        out_ += ':';
+        comma_ = false;
+        return *this;
+    }
+
+    JsonBuilder& value(std::string_view text) {
+        separate();
+        string(text);
+        comma_ = true;
+        return *this;
+    }
+
+    JsonBuilder& value(const char* text) {
+        return value(std::string_view(text));
+    }
+
+    JsonBuilder& value(bool flag) {
+        separate();
+        out_ += flag ? "true" : "false";
+        comma_ = true;
+        return *this;
+    }
+
+    template <typename Number, typename = std::enable_if_t<std::is_arithmetic_v<Number>>>
+    JsonBuilder& value(Number number) {
+        separate();
+        char digits[32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), number);
+        out_.append(digits, result.ptr);
+        comma_ = true;
+        return *this;
+    }
+
+private:
+    void separate() {
+        if (comma_) {
+            out_ += ',';
+        }
+    }
+
+    void string(std::string_view text) {
+        out_ += '"';
+        for (char c : text) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\') {
+                out_ += '\\';
+                out_ += c;
+            } else if (u < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                out_ += "\\u00";
+                out_ += hex[u >> 4];
+                out_ += hex[u & 0xF];
+            } else {
+                out_ += c;
+            }
+        }
+        out_ += '"';
+    }
+
+    std::pmr::string& out_;
+    bool comma_ = false;
+};
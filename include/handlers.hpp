@@ -1,5 +1,44 @@
 #pragma once
 
 #include "crow_all.h"
+#include "rate_limiter.hpp"
+#include <string>
+#include <string_view>
 
-void setup_routes(crow::SimpleApp& app, int short_code_length);
\ No newline at end of file
+// Sets the deadline of the request on the handling thread: timeout_ms from config, shortened
+// by an X-Request-Timeout header (milliseconds) when the client gives up sooner.
+struct DeadlineMiddleware {
+    struct context {};
+
+    int timeout_ms = 0;
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+// Counts requests in flight so a graceful shutdown can wait for them. Listed first so its
+// after_handle runs even when a later middleware answers the request itself.
+struct DrainMiddleware {
+    struct context {};
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+// Gives the request the arena of its worker thread (request_arena.hpp) and rewinds it when the
+// response is complete.
+struct ArenaMiddleware {
+    struct context {};
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+using App = crow::App<DrainMiddleware, ArenaMiddleware, RateLimitMiddleware, DeadlineMiddleware>;
+
+// Client address as reported by the proxy: X-Forwarded-For, then X-Real-IP, then "unknown".
+std::string_view client_ip(const crow::request& req);
+
+void setup_routes(App& app, int short_code_length);
+void setup_admin_routes(App& app, const std::string& admin_token);
+void setup_health_routes(App& app);
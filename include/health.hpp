@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Liveness and readiness. The readiness answer is assembled from atomics updated in the
+// background, so /healthz and /readyz never wait on storage.
+struct HealthStatus {
+    bool storage = false;
+    bool warmed_up = false;
+    double log_queue_fill = 0;
+    uint64_t log_dropped = 0;
+    bool draining = false;
+    bool ready = false;
+};
+
+// Probes current_store()->healthy() every interval_ms. Storage counts as unavailable when
+// the last probe failed or the running one has taken longer than timeout_ms.
+void start_health_probe(int interval_ms, int timeout_ms, double max_log_queue_fill);
+void stop_health_probe();
+HealthStatus health_status();
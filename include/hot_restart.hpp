@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Hot restart: a new instance takes the listening socket of the running one over a Unix socket
+// (SCM_RIGHTS), so both accept from the same queue until the old one has drained.
+struct HotRestartHandoff {
+    int connection = -1;
+    int listen_fd = -1;
+};
+
+// Asks the instance serving path for its listening socket. listen_fd stays -1 when nobody
+// answers there.
+HotRestartHandoff request_listen_socket(const std::string& path);
+// Tells the old instance this one is ready, so it drains and exits, and waits (at most
+// timeout_ms) until it has closed the connection on its way out.
+bool finish_handoff(HotRestartHandoff& handoff, int timeout_ms);
+// Gives up on taking over, e.g. when shut down while warming up: closes the connection without
+// reporting ready, so the old instance keeps serving.
+void abort_handoff(HotRestartHandoff& handoff);
+
+// Serves one handoff on path for the running instance: calls before_handoff, sends the socket
+// listening on port and calls on_ready once the new instance reports ready.
+bool start_handoff_listener(const std::string& path, uint16_t port, std::function<void()> before_handoff,
+                            std::function<void()> on_ready);
+// Stops serving handoffs; the path is removed unless it was handed over. A connection that was
+// already handed over stays open until close_handoff_connection.
+void stop_handoff_listener();
+// Closes the handoff connection, which tells the new instance this one is gone.
+void close_handoff_connection();
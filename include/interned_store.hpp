@@ -0,0 +1,68 @@
+#pragma once
+
+#include "url_store.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sqlite3.h>
+
+// Stores each URL as an interned prefix id plus the rest of the URL. The prefix is the scheme
+// and host (with port), extended by the first path segment when more path follows, e.g.
+// "https://shop.example/products/". Prefixes live once in the url_prefixes table of the main
+// database, which assigns the ids, so processes sharing it agree on them. Meant to sit above
+// CachedStore, so the cache keeps the short form too and reassembly happens per lookup.
+class InternedStore : public UrlStore {
+public:
+    InternedStore(std::unique_ptr<UrlStore> backend, sqlite3* handle, size_t max_prefixes);
+
+    // Creates the prefix table and loads it. False if the database cannot be used.
+    bool open();
+
+    void insert(const ShortCode& short_code, const std::string& url) override;
+    bool insert_new(const ShortCode& short_code, const std::string& url) override;
+    std::string get(const ShortCode& short_code) override;
+    ShortCode get_by_url(const std::string& url) override;
+    void remove(const ShortCode& short_code) override;
+    void for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+
+    void insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) override;
+    std::vector<std::string> get_batch(const std::vector<ShortCode>& short_codes) override;
+    void remove_batch(const std::vector<ShortCode>& short_codes) override;
+    bool healthy() override;
+    bool get_cached(const ShortCode& short_code, std::string& url) override;
+    void for_each_with_prefix(const std::string& prefix,
+                              const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+    bool has_url_index() override;
+
+    // Rewrites rows that are still stored whole. Returns how many were rewritten.
+    size_t intern_existing();
+    size_t prefix_count();
+    UrlStore& backend();
+
+private:
+    // Returns url itself when its prefix is not interned and create is false or the table is full.
+    std::string encode(const std::string& url, bool create);
+    std::string decode(const std::string& value);
+    // 0 if the prefix has no id.
+    uint32_t prefix_id(const std::string& prefix, bool create);
+    bool prefix_for_id(uint32_t id, std::string& prefix);
+
+    std::unique_ptr<UrlStore> backend_;
+    sqlite3* handle_;
+    size_t max_prefixes_;
+    // Guards the maps and is never held during database work; create_mutex_ serializes adding
+    // prefixes.
+    std::shared_mutex mutex_;
+    std::mutex create_mutex_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::unordered_map<uint32_t, std::string> prefixes_;
+};
+
+// Opens an InternedStore over backend and, the first time prefixes are enabled, interns the
+// rows already stored. Returns nullptr if the prefix table cannot be opened.
+std::unique_ptr<UrlStore> open_interned_store(std::unique_ptr<UrlStore> backend, sqlite3* handle, size_t max_prefixes);
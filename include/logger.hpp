@@ -1,6 +1,36 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <sqlite3.h>
+
+extern sqlite3* log_db;
+
+enum class LogLevel {
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3,
+};
+
+// Case-insensitive; false for an unknown name.
+bool parse_log_level(const std::string& level, LogLevel& out);
+// INFO for an unknown name.
+LogLevel parse_log_level(const std::string& level);
+const char* log_level_name(LogLevel level);
+void set_min_log_level(LogLevel level);
+LogLevel min_log_level();
+bool log_enabled(const std::string& level);
+
+bool open_log_db(const std::string& path, const std::string& journal_mode, size_t queue_capacity);
+void flush_log_queue();
+void close_log_db();
+size_t log_queue_depth();
+size_t log_queue_capacity();
+// Entries not written to the log database because the queue was full, since start.
+uint64_t log_entries_dropped();
 
 void log_to_db(const std::string& level, const std::string& message, const std::string& ip = "", const std::string& user_agent = "");
-void log(const std::string& message, const std::string& level = "INFO", const std::string& ip = "", const std::string& user_agent = "");
\ No newline at end of file
+void log(std::string_view message, const std::string& level = "INFO", const std::string& ip = "", const std::string& user_agent = "");
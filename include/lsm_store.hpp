@@ -0,0 +1,101 @@
+#pragma once
+
+#include "url_store.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Log-structured merge engine. Writes go to a write-ahead log and a sorted memtable;
+// full memtables are frozen and written by a background thread as immutable sorted
+// segments with a sparse index and a Bloom filter; compaction_trigger segments of similar
+// size are merged into one (size-tiered). Both directions are stored in one keyspace:
+// "c:<code>" -> url and "u:<url>" -> code.
+class LsmStore : public UrlStore {
+public:
+    struct Options {
+        size_t memtable_bytes = 4 * 1024 * 1024;
+        size_t compaction_trigger = 4;
+        bool sync_wal = false;
+    };
+
+    ~LsmStore();
+
+    bool open(const std::string& dir, const Options& options);
+    void close();
+
+    void insert(const ShortCode& short_code, const std::string& url) override;
+    bool insert_new(const ShortCode& short_code, const std::string& url) override;
+    std::string get(const ShortCode& short_code) override;
+    ShortCode get_by_url(const std::string& url) override;
+    void remove(const ShortCode& short_code) override;
+    void for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+    void insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) override;
+    void remove_batch(const std::vector<ShortCode>& short_codes) override;
+    bool healthy() override;
+    void for_each_with_prefix(const std::string& prefix,
+                              const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+    bool has_url_index() override;
+
+    // Freezes the memtable and waits until every frozen memtable and pending compaction is on disk.
+    void flush();
+    size_t segment_count();
+
+    struct Segment;
+
+private:
+    struct Entry {
+        std::string value;
+        bool deleted = false;
+    };
+
+    using Memtable = std::map<std::string, Entry>;
+
+    struct FrozenMemtable {
+        Memtable entries;
+        std::vector<uint64_t> wal_ids;
+    };
+
+    bool lookup(const std::string& key, std::string& value);
+    void put_locked(const std::string& key, const std::string& value, bool deleted);
+    void insert_locked(const ShortCode& short_code, const std::string& url);
+    void remove_locked(const ShortCode& short_code);
+    bool open_wal();
+    void sync_wal();
+    void maybe_freeze();
+    void background_loop();
+    bool flush_one();
+    bool compact_segments();
+    bool replay_wal(const std::string& path);
+    std::string segment_path(uint64_t id) const;
+    std::string wal_path(uint64_t id) const;
+
+    std::string dir_;
+    Options options_;
+
+    std::mutex write_mutex_;
+    std::shared_mutex state_mutex_;
+    Memtable memtable_;
+    size_t memtable_size_ = 0;
+    std::vector<std::shared_ptr<FrozenMemtable>> frozen_;
+    std::vector<std::shared_ptr<Segment>> segments_;
+    std::vector<uint64_t> active_wal_ids_;
+    std::FILE* wal_ = nullptr;
+    uint64_t next_wal_id_ = 1;
+    uint64_t next_segment_id_ = 1;
+
+    std::mutex background_mutex_;
+    std::condition_variable background_cv_;
+    std::condition_variable idle_cv_;
+    bool stopping_ = false;
+    bool pending_ = false;
+    bool busy_ = false;
+    std::thread background_;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "url_store.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Open-addressing hash tables over memory-mapped files. index.bin holds a code table
+// (inline short code + heap offset) and a URL table (URL hash + heap offset); heap.bin
+// is an append-only log of (code, url) records. Readers never lock: slots are published
+// with a release store of their offset and retired mappings stay mapped until close().
+class MmapStore : public UrlStore {
+public:
+    static constexpr size_t max_code_length = ShortCode::max_length;
+
+    ~MmapStore();
+
+    bool open(const std::string& dir, uint64_t initial_capacity);
+    void close();
+    bool is_open() const;
+
+    void insert(const ShortCode& short_code, const std::string& url) override;
+    bool insert_new(const ShortCode& short_code, const std::string& url) override;
+    std::string get(const ShortCode& short_code) override;
+    ShortCode get_by_url(const std::string& url) override;
+    void remove(const ShortCode& short_code) override;
+    void for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+    bool healthy() override;
+    uint64_t size() const;
+
+private:
+    struct Mapping {
+        uint8_t* base = nullptr;
+        size_t size = 0;
+    };
+
+    struct Index {
+        Mapping mapping;
+        uint64_t capacity = 0;
+    };
+
+    struct Heap {
+        Mapping mapping;
+    };
+
+    bool map_file(const std::string& path, size_t size, bool truncate, Mapping& out);
+    bool create_index(const std::string& path, uint64_t capacity, Index& out);
+    bool grow_index();
+    bool grow_heap(size_t needed);
+    uint64_t append_record(const ShortCode& short_code, const std::string& url);
+    void publish(Index* index, uint64_t offset, const ShortCode& short_code, uint64_t url_hash);
+    bool remove_locked(Index* index, const ShortCode& short_code);
+    bool append_locked(Index* index, const ShortCode& short_code, const std::string& url);
+    std::string find_by_url(Index* index, const std::string& url) const;
+
+    std::string dir_;
+    std::mutex write_mutex_;
+    std::atomic<Index*> index_{nullptr};
+    std::atomic<Heap*> heap_{nullptr};
+    std::vector<Index*> retired_indexes_;
+    std::vector<Heap*> retired_heaps_;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "crow_all.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+enum class RateLimitRoute : uint8_t {
+    None = 0,
+    Shorten = 1,
+    Redirect = 2,
+    Delete = 3,
+};
+
+static const int rate_limit_route_count = 4;
+
+const char* rate_limit_route_name(RateLimitRoute route);
+RateLimitRoute parse_rate_limit_route(const std::string& name);
+
+// Token buckets keyed by (client, route) in a fixed-size open-addressing table. Each key
+// hashes to a window of probe_window slots; buckets are claimed and updated with CAS only.
+// When a window is full the least recently used slot in it is taken over, which bounds
+// memory and only ever forgets idle clients whose buckets have refilled anyway.
+class RateLimiter {
+public:
+    explicit RateLimiter(size_t capacity);
+
+    // rate tokens per second, at most burst tokens (up to 65535) saved up.
+    void set_limit(RateLimitRoute route, double rate, double burst);
+    bool limited(RateLimitRoute route) const;
+
+    // Takes a token. Returns 0 when the request may proceed, otherwise the number of
+    // seconds until the next token.
+    uint32_t acquire(const std::string& client, RateLimitRoute route, uint64_t now_us);
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> key{0};
+        // (ms since first acquire of the last update << 24) | tokens in 1/256ths; 0 means a full bucket.
+        std::atomic<uint64_t> state{0};
+    };
+
+    static const size_t probe_window = 8;
+
+    Slot* find_slot(uint64_t key, uint64_t now_ms);
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    std::atomic<uint64_t> origin_ms_{0};
+    double rate_[rate_limit_route_count] = {};
+    double burst_[rate_limit_route_count] = {};
+};
+
+// Global Crow middleware: answers 429 before routing, without touching storage.
+struct RateLimitMiddleware {
+    struct context {};
+
+    std::unique_ptr<RateLimiter> limiter;
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+RateLimitRoute classify_rate_limit_route(const crow::request& req);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+
+// Memory for the temporaries of the request handled on the current thread. Each worker thread
+// owns a buffer of request_arena_size bytes that a monotonic std::pmr resource hands out;
+// ending the request rewinds it, which costs nothing unless the request outgrew the buffer
+// and took more from the heap. Outside a request, or with the arena disabled,
+// request_memory() is the ordinary heap.
+void set_request_arena_size(size_t bytes);
+size_t request_arena_size();
+void begin_request_arena();
+void end_request_arena();
+std::pmr::memory_resource* request_memory();
+
+// A string for use within the current request.
+inline std::pmr::string request_string() {
+    return std::pmr::string(request_memory());
+}
+
+struct RequestArenaStats {
+    uint64_t requests = 0;
+    // Requests that needed heap memory beyond their thread's buffer.
+    uint64_t overflows = 0;
+    uint64_t overflow_bytes = 0;
+};
+
+RequestArenaStats request_arena_stats();
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "url_store.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+
+// Hash-partitions links across shard_count SQLite files (shard-<n>.db), each with its own
+// writer connection and lock. A mapping lives in the urls table of the shard chosen by its
+// code; the url_routes table of the shard chosen by the URL maps it back to the code.
+class ShardedSqliteStore : public UrlStore {
+public:
+    ~ShardedSqliteStore();
+
+    bool open(const std::string& dir, size_t shard_count, const std::string& journal_mode);
+    void close();
+
+    void insert(const ShortCode& short_code, const std::string& url) override;
+    bool insert_new(const ShortCode& short_code, const std::string& url) override;
+    std::string get(const ShortCode& short_code) override;
+    ShortCode get_by_url(const std::string& url) override;
+    void remove(const ShortCode& short_code) override;
+    void for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+
+    void insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) override;
+    void remove_batch(const std::vector<ShortCode>& short_codes) override;
+    bool healthy() override;
+    void for_each_with_prefix(const std::string& prefix,
+                              const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+    bool has_url_index() override;
+
+    size_t shard_count() const;
+    size_t shard_for_code(const ShortCode& short_code) const;
+    size_t shard_for_url(const std::string& url) const;
+
+private:
+    struct Shard {
+        sqlite3* reader = nullptr;
+        sqlite3* writer = nullptr;
+        // Prepared on the writer connection and only used while write_mutex is held.
+        sqlite3_stmt* select_url = nullptr;
+        sqlite3_stmt* select_route = nullptr;
+        sqlite3_stmt* upsert_url = nullptr;
+        sqlite3_stmt* upsert_route = nullptr;
+        sqlite3_stmt* delete_url = nullptr;
+        sqlite3_stmt* delete_route = nullptr;
+        std::mutex write_mutex;
+    };
+
+    std::vector<std::unique_lock<std::mutex>> lock_shards(const std::vector<size_t>& shards);
+    void begin(const std::vector<size_t>& shards);
+    void commit(const std::vector<size_t>& shards);
+    void insert_locked(const ShortCode& short_code, const std::string& url);
+    void remove_locked(const ShortCode& short_code, const std::string& url);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Base62 digits in code order and the reverse table; base62_values is -1 for other bytes.
+inline constexpr char base62_digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+struct Base62Values {
+    int8_t values[256];
+
+    constexpr Base62Values() : values() {
+        for (int c = 0; c < 256; ++c) {
+            values[c] = -1;
+        }
+        for (int i = 0; i < 62; ++i) {
+            values[static_cast<unsigned char>(base62_digits[i])] = static_cast<int8_t>(i);
+        }
+    }
+
+    constexpr int operator[](char c) const {
+        return values[static_cast<unsigned char>(c)];
+    }
+};
+
+inline constexpr Base62Values base62_values;
+
+// A short code of up to max_length base62 characters, stored inline and zero-padded, so
+// copies never allocate and comparison and hashing are two 64-bit loads. Text that is not a
+// valid code converts to the empty code, which is never stored.
+class ShortCode {
+public:
+    static constexpr size_t max_length = 16;
+
+    constexpr ShortCode() = default;
+    ShortCode(std::string_view text) {
+        parse(text, *this);
+    }
+    ShortCode(const std::string& text) : ShortCode(std::string_view(text)) {}
+    ShortCode(const char* text) : ShortCode(std::string_view(text)) {}
+
+    static constexpr bool valid(std::string_view text) {
+        if (text.empty() || text.size() > max_length) {
+            return false;
+        }
+        for (char c : text) {
+            if (base62_values[c] < 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Sets out to the empty code and returns false if text is not a valid code.
+    static bool parse(std::string_view text, ShortCode& out) {
+        out = ShortCode();
+        if (text.empty() || text.size() > max_length) {
+            return false;
+        }
+        // The characters are gathered into two words (little-endian) and stored whole, so
+        // hash() and == read them back without a store-forwarding stall.
+        uint64_t low = 0, high = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (base62_values[text[i]] < 0) {
+                return false;
+            }
+            uint64_t c = static_cast<unsigned char>(text[i]);
+            if (i < 8) {
+                low |= c << (i * 8);
+            } else {
+                high |= c << ((i - 8) * 8);
+            }
+        }
+        std::memcpy(out.chars_, &low, 8);
+        std::memcpy(out.chars_ + 8, &high, 8);
+        out.size_ = static_cast<uint8_t>(text.size());
+        return true;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const char* data() const { return chars_; }
+    const char* c_str() const { return chars_; }
+    std::string_view view() const { return std::string_view(chars_, size_); }
+    std::string str() const { return std::string(chars_, size_); }
+
+    size_t hash() const {
+        uint64_t low, high;
+        std::memcpy(&low, chars_, 8);
+        std::memcpy(&high, chars_ + 8, 8);
+        uint64_t h = (low ^ (high * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+        return static_cast<size_t>(h ^ (h >> 31));
+    }
+
+    friend bool operator==(const ShortCode& a, const ShortCode& b) {
+        return std::memcmp(a.chars_, b.chars_, max_length) == 0;
+    }
+    friend bool operator!=(const ShortCode& a, const ShortCode& b) {
+        return !(a == b);
+    }
+    friend bool operator<(const ShortCode& a, const ShortCode& b) {
+        return a.view() < b.view();
+    }
+    friend std::ostream& operator<<(std::ostream& out, const ShortCode& code) {
+        return out << code.view();
+    }
+
+private:
+    // One byte past max_length keeps c_str() terminated.
+    char chars_[max_length + 1] = {};
+    uint8_t size_ = 0;
+};
+
+static_assert(std::is_trivially_copyable_v<ShortCode>, "ShortCode is copied by value on the redirect path");
+static_assert(sizeof(ShortCode) == 18, "ShortCode is stored inline");
+
+namespace std {
+template <>
+struct hash<ShortCode> {
+    size_t operator()(const ShortCode& code) const {
+        return code.hash();
+    }
+};
+}
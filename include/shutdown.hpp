@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Requests currently being handled, maintained by DrainMiddleware.
+void request_started();
+void request_finished();
+size_t requests_in_flight();
+
+// True from the start of a graceful shutdown; /readyz reports not ready from then on.
+bool shutdown_draining();
+// Back to serving, for tests that run more than one server in a process.
+void reset_shutdown();
+
+// Listening socket bound to port in this process, or -1.
+int listening_socket(uint16_t port);
+
+// Marks the server draining, stops accepting connections on port and waits until no request
+// has been in flight for a short while, at most timeout_ms. The caller then stops the
+// server. Returns false if requests were still running at the timeout.
+bool drain_requests(uint16_t port, int timeout_ms);
+
+// Blocks SIGINT and SIGTERM in the calling thread and every thread started after it, so
+// wait_for_shutdown_signal() receives them instead of Crow's handlers. Call first in main().
+void block_shutdown_signals();
+int wait_for_shutdown_signal();
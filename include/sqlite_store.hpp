@@ -0,0 +1,41 @@
+#pragma once
+
+#include "url_store.hpp"
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <sqlite3.h>
+
+class SqliteStore : public UrlStore {
+public:
+    explicit SqliteStore(sqlite3* handle);
+    ~SqliteStore();
+
+    void insert(const ShortCode& short_code, const std::string& url) override;
+    bool insert_new(const ShortCode& short_code, const std::string& url) override;
+    std::string get(const ShortCode& short_code) override;
+    ShortCode get_by_url(const std::string& url) override;
+    void remove(const ShortCode& short_code) override;
+    void for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+
+    void insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) override;
+    std::vector<std::string> get_batch(const std::vector<ShortCode>& short_codes) override;
+    void remove_batch(const std::vector<ShortCode>& short_codes) override;
+    bool healthy() override;
+    void for_each_with_prefix(const std::string& prefix,
+                              const std::function<void(const ShortCode&, const std::string&)>& callback) override;
+    bool has_url_index() override;
+
+private:
+    // Runs sql once per entry, binding it with bind, in one transaction; rolled back as a whole
+    // if any step fails.
+    bool run_batch(const char* sql, size_t count, const std::function<void(sqlite3_stmt*, size_t)>& bind);
+    sqlite3* batch_handle();
+
+    sqlite3* handle_;
+    // Batches run on their own connection to the database file: a transaction on handle_, which
+    // other threads share, would take in (and could roll back) their statements too. An
+    // in-memory database cannot be opened twice, so its batches use handle_.
+    std::mutex batch_mutex_;
+    sqlite3* batch_handle_ = nullptr;
+};
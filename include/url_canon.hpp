@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Validates an http(s) URL and writes its canonical form, so equivalent spellings share one
+// row: scheme and host are lowercased, a default or empty port is dropped, an empty path
+// becomes "/", percent-escapes get uppercase hex and escaped unreserved characters are
+// decoded, and bytes above 0x7E are percent-encoded. Returns false for anything else that is
+// not a plain http(s) URL: other schemes, userinfo, bad host characters or ports, control
+// characters and spaces, and broken escapes.
+bool canonicalize_url(std::string_view url, std::string& out);
+
+// The byte scans behind canonicalize_url run 32 or 16 bytes at a time when the CPU allows.
+enum class UrlScanLevel {
+    Scalar = 0,
+    Sse42 = 1,
+    Avx2 = 2,
+};
+
+// The best level the CPU supports; used unless set_url_scan_level picks another.
+UrlScanLevel supported_url_scan_level();
+UrlScanLevel url_scan_level();
+// For benchmarks and tests; levels above the supported one are clamped.
+void set_url_scan_level(UrlScanLevel level);
+const char* url_scan_level_name(UrlScanLevel level);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Token table for compressing stored URLs. Each token is a frequent URL fragment (a scheme and
+// host prefix, a path segment, "&utm_source=" and the like) and is written as one byte that a
+// canonical URL never contains. Encoding is deterministic, so an encoded URL can be looked up
+// by value for dedup.
+class UrlDictionary {
+public:
+    static const size_t max_tokens = 157;
+
+    UrlDictionary() { index(); }
+
+    // Picks the fragments that save the most bytes over the sample.
+    static UrlDictionary train(const std::vector<std::string>& urls);
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    size_t size() const { return tokens_.size(); }
+    const std::vector<std::string>& tokens() const { return tokens_; }
+
+    // Returns url unchanged when encoding would not make it shorter.
+    std::string encode(const std::string& url) const;
+    // Values that were not encoded, such as rows written before compression was enabled, are
+    // returned as they are.
+    std::string decode(const std::string& value) const;
+    static bool is_encoded(const std::string& value);
+
+private:
+    void index();
+
+    std::vector<std::string> tokens_;
+    // Token ids by first byte, longest first.
+    std::vector<uint8_t> by_first_[256];
+    int16_t token_for_code_[256];
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "short_code.hpp"
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Storage engine for short code -> URL mappings. Lookups return an empty URL or code when
+// nothing is stored. insert() replaces any mapping that already uses the code or the URL.
+class UrlStore {
+public:
+    virtual ~UrlStore() = default;
+
+    virtual void insert(const ShortCode& short_code, const std::string& url) = 0;
+    // Stores the mapping only if neither the code nor the URL is mapped yet, as one atomic step;
+    // false if either is taken.
+    virtual bool insert_new(const ShortCode& short_code, const std::string& url) = 0;
+    virtual std::string get(const ShortCode& short_code) = 0;
+    virtual ShortCode get_by_url(const std::string& url) = 0;
+    virtual void remove(const ShortCode& short_code) = 0;
+    virtual void for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) = 0;
+
+    virtual void insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries);
+    virtual std::vector<std::string> get_batch(const std::vector<ShortCode>& short_codes);
+    virtual void remove_batch(const std::vector<ShortCode>& short_codes);
+
+    // Cheap check that the engine can serve requests; used by the readiness probe.
+    virtual bool healthy();
+    // Answers from memory only; false when the lookup would have to go to storage.
+    virtual bool get_cached(const ShortCode& short_code, std::string& url);
+
+    // Mappings whose URL starts with prefix. Engines with an index on URLs use a range scan;
+    // the default visits every mapping.
+    virtual void for_each_with_prefix(const std::string& prefix,
+                                      const std::function<void(const ShortCode&, const std::string&)>& callback);
+    // True when for_each_with_prefix is a range scan: sqlite, sharded and lsm, unless URLs are
+    // compressed on the way. mmap only hashes URLs.
+    virtual bool has_url_index();
+    // Mappings of URLs on host, over http and https and any port.
+    void for_each_on_host(const std::string& host, const std::function<void(const ShortCode&, const std::string&)>& callback);
+};
+
+// Rewrites the stored values for which needs_rewrite holds to rewrite(value), in batches through
+// insert_batch. Values rewrite leaves unchanged are not written. Returns how many were rewritten.
+size_t rewrite_values(UrlStore& store, const std::function<bool(const std::string&)>& needs_rewrite,
+                      const std::function<std::string(const std::string&)>& rewrite);
+
+// The smallest string greater than every string that starts with prefix; empty if there is none.
+std::string prefix_upper_bound(const std::string& prefix);
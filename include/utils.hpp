@@ -1,6 +1,14 @@
 #pragma once
 
-#include <string>
-#include <random>
+#include "short_code.hpp"
 
-std::string generate_short(int short_code_length);
\ No newline at end of file
+// A random base62 code of short_code_length characters, ending in the check character when the
+// code checksum is enabled. Not checked against storage.
+ShortCode random_short(int short_code_length);
+
+// The next code to try: from the leased ID block when the code sequence is running
+// (code_sequence.hpp), random_short otherwise. Not checked against storage.
+ShortCode candidate_short(int short_code_length);
+
+// candidate_short that is not stored yet.
+ShortCode generate_short(int short_code_length);
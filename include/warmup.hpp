@@ -0,0 +1,20 @@
+#pragma once
+
+#include "cached_store.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Hot-set snapshots: the most-hit cached codes, one per line, written via a temp file.
+bool save_hot_set(CachedStore& cache, const std::string& path, size_t count);
+std::vector<ShortCode> load_hot_set(const std::string& path);
+
+// Writes a snapshot every interval_seconds and once more when stopped.
+void start_hot_set_snapshots(CachedStore& cache, const std::string& path, size_t count, int interval_seconds);
+void stop_hot_set_snapshots();
+
+// Reads the codes listed in the snapshot through the store in a background thread, which
+// fills the cache and pulls the backing SQLite pages into memory.
+void start_warmup(UrlStore& store, const std::string& path);
+void stop_warmup();
+bool warmup_complete();
@@ -0,0 +1,429 @@
+#include "access_log.hpp"
+#include "clock.hpp"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static const char segment_magic[8] = {'S', 'U', 'A', 'C', 'C', 'L', 'O', 'G'};
+static const uint32_t segment_version = 1;
+// Clients choose their User-Agent, so both the strings and their number are bounded.
+static const uint32_t max_user_agents = 1 << 14;
+static const size_t max_user_agent_length = 256;
+static const uint32_t user_agent_overflow = 0xFFFFFFFF;
+
+static AccessLog global_access_log;
+static std::atomic<bool> global_access_log_open{false};
+// Complement of each event's sampling threshold, so the zero-initialised array, which is in place
+// before any dynamic initialisation, means every event is logged.
+static std::atomic<uint32_t> sample_skips[access_event_count];
+
+static uint32_t sample_threshold(AccessEvent event) {
+    return ~sample_skips[static_cast<uint8_t>(event) % access_event_count].load(std::memory_order_relaxed);
+}
+
+static std::string segment_path(const std::string& dir, uint64_t seq) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "segment-%020llu.log", static_cast<unsigned long long>(seq));
+    return (std::filesystem::path(dir) / name).string();
+}
+
+static uint64_t segment_seq(const std::string& path) {
+    auto name = std::filesystem::path(path).filename().string();
+    return std::stoull(name.substr(8, 20));
+}
+
+static void parse_ip(std::string_view header, uint8_t out[16]) {
+    std::memset(out, 0, 16);
+    std::string_view first = header.substr(0, header.find(','));
+    size_t begin = first.find_first_not_of(' ');
+    if (begin == std::string_view::npos) {
+        return;
+    }
+    first = first.substr(begin, first.find_last_not_of(' ') + 1 - begin);
+    if (first.size() >= INET6_ADDRSTRLEN) {
+        return;
+    }
+    char ip[INET6_ADDRSTRLEN];
+    std::memcpy(ip, first.data(), first.size());
+    ip[first.size()] = '\0';
+    in_addr v4;
+    if (inet_pton(AF_INET, ip, &v4) == 1) {
+        out[10] = 0xFF;
+        out[11] = 0xFF;
+        std::memcpy(out + 12, &v4, 4);
+        return;
+    }
+    inet_pton(AF_INET6, ip, out);
+}
+
+AccessLog::~AccessLog() {
+    close();
+}
+
+bool AccessLog::open(const std::string& dir, size_t segment_size, int max_segments) {
+    close();
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cout << "Failed to create access log directory: " << ec.message() << std::endl;
+        return false;
+    }
+    dir_ = dir;
+    segment_size_ = std::max(segment_size, sizeof(AccessLogSegmentHeader) + sizeof(AccessRecord));
+    max_segments_ = std::max(max_segments, 1);
+
+    {
+        std::unique_lock<std::shared_mutex> lock(ua_mutex_);
+        user_agents_.clear();
+        auto names = read_user_agents(dir_);
+        for (size_t i = 1; i < names.size(); ++i) {
+            user_agents_.emplace(names[i], static_cast<uint32_t>(i));
+        }
+        ua_file_.close();
+        ua_file_.clear();
+        ua_file_.open((std::filesystem::path(dir_) / "user_agents.txt").string(), std::ios::app);
+    }
+
+    auto segments = list_access_log_segments(dir_);
+    uint64_t seq = segments.empty() ? 0 : segment_seq(segments.back()) + 1;
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return open_segment(seq);
+}
+
+void AccessLog::close() {
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        close_segment();
+    }
+    std::unique_lock<std::shared_mutex> lock(ua_mutex_);
+    ua_file_.close();
+}
+
+void AccessLog::flush() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (base_) {
+        msync(base_, segment_size_, MS_SYNC);
+    }
+}
+
+bool AccessLog::open_segment(uint64_t seq) {
+    std::string path = segment_path(dir_, seq);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cout << "Failed to open access log segment: " << path << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(segment_size_)) != 0) {
+        std::cout << "Failed to size access log segment: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, segment_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cout << "Failed to map access log segment: " << path << std::endl;
+        return false;
+    }
+
+    base_ = static_cast<uint8_t*>(mapped);
+    capacity_ = (segment_size_ - sizeof(AccessLogSegmentHeader)) / sizeof(AccessRecord);
+    seq_ = seq;
+    next_.store(0);
+
+    AccessLogSegmentHeader header{};
+    std::memcpy(header.magic, segment_magic, sizeof(segment_magic));
+    header.version = segment_version;
+    header.record_size = sizeof(AccessRecord);
+    header.capacity = capacity_;
+    header.created_us = current_time_us();
+    std::memcpy(base_, &header, sizeof(header));
+
+    auto segments = list_access_log_segments(dir_);
+    for (size_t i = 0; i + max_segments_ < segments.size(); ++i) {
+        std::remove(segments[i].c_str());
+    }
+    return true;
+}
+
+void AccessLog::close_segment() {
+    if (base_) {
+        msync(base_, segment_size_, MS_ASYNC);
+        munmap(base_, segment_size_);
+        base_ = nullptr;
+    }
+}
+
+void AccessLog::rotate(uint64_t seq) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!base_ || seq_ != seq) {
+        return;
+    }
+    close_segment();
+    open_segment(seq + 1);
+}
+
+uint32_t AccessLog::user_agent_id(const std::string& user_agent) {
+    if (user_agent.empty()) {
+        return 0;
+    }
+    if (user_agent.size() > max_user_agent_length) {
+        return user_agent_id(user_agent.substr(0, max_user_agent_length));
+    }
+    {
+        std::shared_lock<std::shared_mutex> lock(ua_mutex_);
+        auto it = user_agents_.find(user_agent);
+        if (it != user_agents_.end()) {
+            return it->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(ua_mutex_);
+    auto it = user_agents_.find(user_agent);
+    if (it != user_agents_.end()) {
+        return it->second;
+    }
+    if (user_agents_.size() + 1 >= max_user_agents) {
+        return user_agent_overflow;
+    }
+    uint32_t id = static_cast<uint32_t>(user_agents_.size() + 1);
+    user_agents_.emplace(user_agent, id);
+
+    std::string line = user_agent;
+    std::replace(line.begin(), line.end(), '\n', ' ');
+    std::replace(line.begin(), line.end(), '\r', ' ');
+    ua_file_ << line << '\n';
+    ua_file_.flush();
+    return id;
+}
+
+void AccessLog::write(AccessEvent event, int status, std::string_view code, std::string_view ip, const std::string& user_agent) {
+    AccessRecord record{};
+    record.timestamp_us = current_time_us();
+    record.status = static_cast<uint16_t>(status);
+    record.code_length = static_cast<uint8_t>(std::min(code.size(), sizeof(record.code)));
+    std::memcpy(record.code, code.data(), record.code_length);
+    parse_ip(ip, record.ip);
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (!base_) {
+        return;
+    }
+    record.user_agent_id = user_agent_id(user_agent);
+    while (true) {
+        uint64_t index = next_.fetch_add(1, std::memory_order_relaxed);
+        if (index < capacity_) {
+            auto* slot = reinterpret_cast<AccessRecord*>(base_ + sizeof(AccessLogSegmentHeader)) + index;
+            std::memcpy(slot, &record, sizeof(record));
+            __atomic_store_n(&slot->event, static_cast<uint8_t>(event), __ATOMIC_RELEASE);
+            return;
+        }
+        uint64_t seq = seq_;
+        lock.unlock();
+        rotate(seq);
+        lock.lock();
+        if (!base_) {
+            return;
+        }
+    }
+}
+
+bool open_access_log(const std::string& dir, size_t segment_size, int max_segments) {
+    bool opened = global_access_log.open(dir, segment_size, max_segments);
+    global_access_log_open.store(opened);
+    return opened;
+}
+
+void close_access_log() {
+    global_access_log_open.store(false);
+    global_access_log.close();
+}
+
+bool access_log_sampled(AccessEvent event) {
+    if (!global_access_log_open.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    uint32_t threshold = sample_threshold(event);
+    if (threshold == 0xFFFFFFFF) {
+        return true;
+    }
+    thread_local uint64_t state = 0x9E3779B97F4A7C15ULL ^ reinterpret_cast<uintptr_t>(&state);
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<uint32_t>(state >> 32) < threshold;
+}
+
+void set_access_sample_rate(AccessEvent event, double rate) {
+    rate = std::min(std::max(rate, 0.0), 1.0);
+    uint32_t threshold = rate >= 1.0 ? 0xFFFFFFFF : static_cast<uint32_t>(rate * 4294967296.0);
+    sample_skips[static_cast<uint8_t>(event) % access_event_count].store(~threshold, std::memory_order_relaxed);
+}
+
+double access_sample_rate(AccessEvent event) {
+    uint32_t threshold = sample_threshold(event);
+    return threshold == 0xFFFFFFFF ? 1.0 : threshold / 4294967296.0;
+}
+
+void access_log(AccessEvent event, int status, std::string_view code, std::string_view ip, const std::string& user_agent) {
+    if (global_access_log_open.load(std::memory_order_relaxed)) {
+        global_access_log.write(event, status, code, ip, user_agent);
+    }
+}
+
+const char* access_event_name(AccessEvent event) {
+    switch (event) {
+        case AccessEvent::Shortened: return "shortened";
+        case AccessEvent::ShortenExisting: return "shorten_existing";
+        case AccessEvent::ShortenInvalid: return "shorten_invalid";
+        case AccessEvent::Redirect: return "redirect";
+        case AccessEvent::RedirectNotFound: return "redirect_not_found";
+        case AccessEvent::Deleted: return "deleted";
+        case AccessEvent::DeleteNotFound: return "delete_not_found";
+        case AccessEvent::BadRequest: return "bad_request";
+        case AccessEvent::RateLimited: return "rate_limited";
+        case AccessEvent::Shed: return "shed";
+        case AccessEvent::DeadlineExceeded: return "deadline_exceeded";
+        case AccessEvent::AliasTaken: return "alias_taken";
+        default: return "none";
+    }
+}
+
+AccessEvent parse_access_event(const std::string& name) {
+    for (int i = 1; i < access_event_count; ++i) {
+        if (name == access_event_name(static_cast<AccessEvent>(i))) {
+            return static_cast<AccessEvent>(i);
+        }
+    }
+    return AccessEvent::None;
+}
+
+std::string format_access_ip(const uint8_t ip[16]) {
+    static const uint8_t zero[16] = {};
+    static const uint8_t v4_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+    if (std::memcmp(ip, zero, 16) == 0) {
+        return "unknown";
+    }
+    char buffer[INET6_ADDRSTRLEN];
+    if (std::memcmp(ip, v4_prefix, 12) == 0) {
+        inet_ntop(AF_INET, ip + 12, buffer, sizeof(buffer));
+    } else {
+        inet_ntop(AF_INET6, ip, buffer, sizeof(buffer));
+    }
+    return buffer;
+}
+
+std::vector<std::string> list_access_log_segments(const std::string& dir) {
+    std::vector<std::string> segments;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        auto name = entry.path().filename().string();
+        if (name.size() == 32 && name.compare(0, 8, "segment-") == 0 && name.compare(28, 4, ".log") == 0) {
+            segments.push_back(entry.path().string());
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+std::vector<AccessRecord> read_access_log_segment(const std::string& path) {
+    std::vector<AccessRecord> records;
+    std::ifstream file(path, std::ios::binary);
+    AccessLogSegmentHeader header{};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, segment_magic, sizeof(segment_magic)) != 0 ||
+        header.record_size != sizeof(AccessRecord)) {
+        return records;
+    }
+    AccessRecord record;
+    for (uint64_t i = 0; i < header.capacity; ++i) {
+        if (!file.read(reinterpret_cast<char*>(&record), sizeof(record)) ||
+            record.event == static_cast<uint8_t>(AccessEvent::None)) {
+            break;
+        }
+        records.push_back(record);
+    }
+    return records;
+}
+
+std::vector<std::string> read_user_agents(const std::string& dir) {
+    std::vector<std::string> user_agents{""};
+    std::ifstream file((std::filesystem::path(dir) / "user_agents.txt").string());
+    std::string line;
+    while (std::getline(file, line)) {
+        user_agents.push_back(line);
+    }
+    return user_agents;
+}
+
+static std::string format_iso_timestamp(uint64_t timestamp_us) {
+    std::time_t seconds = static_cast<std::time_t>(timestamp_us / 1000000);
+    std::tm tm{};
+    gmtime_r(&seconds, &tm);
+    char buffer[48];
+    size_t n = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+    std::snprintf(buffer + n, sizeof(buffer) - n, ".%06lluZ", static_cast<unsigned long long>(timestamp_us % 1000000));
+    return buffer;
+}
+
+static std::string user_agent_name(uint32_t id, const std::vector<std::string>& user_agents) {
+    if (id == user_agent_overflow) {
+        return "(overflow)";
+    }
+    return id < user_agents.size() ? user_agents[id] : "";
+}
+
+static std::string csv_field(const std::string& value) {
+    if (value.find_first_of(",\"\n") == std::string::npos) {
+        return value;
+    }
+    std::string quoted = "\"";
+    for (char c : value) {
+        if (c == '"') {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static std::string json_string(const std::string& value) {
+    std::string escaped = "\"";
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            escaped += buffer;
+        } else {
+            escaped += static_cast<char>(c);
+        }
+    }
+    return escaped + "\"";
+}
+
+std::string access_record_to_csv(const AccessRecord& record, const std::vector<std::string>& user_agents) {
+    return format_iso_timestamp(record.timestamp_us) + "," +
+           access_event_name(static_cast<AccessEvent>(record.event)) + "," +
+           std::to_string(record.status) + "," +
+           csv_field(std::string(record.code, record.code_length)) + "," +
+           format_access_ip(record.ip) + "," +
+           csv_field(user_agent_name(record.user_agent_id, user_agents));
+}
+
+std::string access_record_to_json(const AccessRecord& record, const std::vector<std::string>& user_agents) {
+    return "{\"timestamp\":" + json_string(format_iso_timestamp(record.timestamp_us)) +
+           ",\"event\":" + json_string(access_event_name(static_cast<AccessEvent>(record.event))) +
+           ",\"status\":" + std::to_string(record.status) +
+           ",\"code\":" + json_string(std::string(record.code, record.code_length)) +
+           ",\"ip\":" + json_string(format_access_ip(record.ip)) +
+           ",\"user_agent\":" + json_string(user_agent_name(record.user_agent_id, user_agents)) + "}";
+}
@@ -0,0 +1,124 @@
+#include "admission.hpp"
+#include "deadline.hpp"
+#include "logger.hpp"
+#include "request_arena.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+static const int max_shed_level = 2;
+
+static std::mutex admission_mutex;
+static std::condition_variable admission_cv;
+static size_t max_inflight = 0;
+static size_t inflight = 0;
+static uint64_t target_us = 5000;
+static uint64_t interval_us = 100000;
+static std::atomic<int> shed_level{0};
+// When the queueing delay went above target, 0 while it is below.
+static uint64_t first_above_us = 0;
+static uint64_t level_changed_us = 0;
+
+static bool shed(AdmissionClass admission_class) {
+    return shed_level.load(std::memory_order_relaxed) > static_cast<int>(admission_class);
+}
+
+static void set_shed_level(int level, uint64_t now) {
+    int previous = shed_level.exchange(level);
+    level_changed_us = now;
+    auto message = request_string();
+    message += "Admission shed level ";
+    message += static_cast<char>('0' + previous);
+    message += " -> ";
+    message += static_cast<char>('0' + level);
+    log(message, level > previous ? "WARN" : "INFO");
+    if (level > previous) {
+        admission_cv.notify_all();
+    }
+}
+
+// Called with admission_mutex held for every request that got, or gave up on, a slot.
+static void record_sojourn(uint64_t sojourn_us, uint64_t now) {
+    int level = shed_level.load(std::memory_order_relaxed);
+    if (sojourn_us < target_us) {
+        first_above_us = 0;
+        if (level > 0 && now - level_changed_us >= interval_us) {
+            set_shed_level(level - 1, now);
+        }
+        return;
+    }
+    if (first_above_us == 0) {
+        first_above_us = now;
+    } else if (now - first_above_us >= interval_us && level < max_shed_level) {
+        set_shed_level(level + 1, now);
+        first_above_us = now;
+    }
+}
+
+void configure_admission(size_t max_requests, int target_ms, int interval_ms) {
+    std::lock_guard<std::mutex> lock(admission_mutex);
+    max_inflight = max_requests;
+    target_us = static_cast<uint64_t>(target_ms) * 1000;
+    interval_us = static_cast<uint64_t>(interval_ms) * 1000;
+    first_above_us = 0;
+    shed_level = 0;
+}
+
+int admission_shed_level() {
+    return shed_level.load();
+}
+
+StorageAdmission::StorageAdmission(AdmissionClass admission_class) {
+    std::unique_lock<std::mutex> lock(admission_mutex);
+    if (max_inflight == 0) {
+        admitted_ = true;
+        return;
+    }
+    uint64_t start = steady_time_us();
+    if (inflight < max_inflight) {
+        ++inflight;
+        admitted_ = counted_ = true;
+        record_sojourn(0, start);
+        return;
+    }
+    // Shedding only ever refuses requests that would have to queue.
+    if (shed(admission_class)) {
+        return;
+    }
+    // A waiter gives up after one interval past target, so a stalled storage still produces
+    // delay samples and raises the shed level. It never waits past its request's deadline.
+    uint64_t wait_us = target_us + interval_us;
+    if (request_deadline() != 0) {
+        wait_us = request_deadline() > start ? std::min(wait_us, request_deadline() - start) : 0;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(wait_us);
+    while (inflight >= max_inflight && !shed(admission_class)) {
+        if (admission_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+            break;
+        }
+    }
+    uint64_t now = steady_time_us();
+    record_sojourn(now - start, now);
+    if (inflight < max_inflight) {
+        if (!shed(admission_class)) {
+            ++inflight;
+            admitted_ = counted_ = true;
+        } else {
+            // Pass the free slot on to a waiter that may still be admitted.
+            admission_cv.notify_one();
+        }
+    }
+}
+
+StorageAdmission::~StorageAdmission() {
+    if (!counted_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(admission_mutex);
+        --inflight;
+    }
+    admission_cv.notify_one();
+}
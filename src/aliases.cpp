@@ -0,0 +1,121 @@
+#include "aliases.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_set>
+
+static sqlite3* alias_db = nullptr;
+static size_t generated_length = 0;
+static size_t legacy_code_length = 0;
+
+static std::shared_mutex aliases_mutex;
+static std::unordered_set<ShortCode> aliases;
+
+static std::mutex refresh_mutex;
+static std::condition_variable refresh_cv;
+static bool refresh_running = false;
+static std::thread refresh_thread;
+
+// Replaces the set with the table, so aliases other processes released drop out too.
+static void load_aliases() {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(alias_db, "SELECT alias FROM aliases;", -1, &stmt, nullptr) != SQLITE_OK) {
+        return;
+    }
+    std::unordered_set<ShortCode> loaded;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        ShortCode alias;
+        if (text && ShortCode::parse(text, alias)) {
+            loaded.insert(alias);
+        }
+    }
+    sqlite3_finalize(stmt);
+    std::unique_lock<std::shared_mutex> lock(aliases_mutex);
+    aliases.swap(loaded);
+}
+
+bool open_aliases(sqlite3* handle, size_t code_length, size_t legacy_length) {
+    close_aliases();
+    const char* sql = "CREATE TABLE IF NOT EXISTS aliases (alias TEXT PRIMARY KEY);";
+    char* err_msg = nullptr;
+    if (sqlite3_exec(handle, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cout << "Failed to create alias table: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return false;
+    }
+    alias_db = handle;
+    generated_length = code_length;
+    legacy_code_length = legacy_length;
+    load_aliases();
+    refresh_running = true;
+    refresh_thread = std::thread([] {
+        std::unique_lock<std::mutex> lock(refresh_mutex);
+        while (refresh_running) {
+            refresh_cv.wait_for(lock, std::chrono::seconds(1), [] { return !refresh_running; });
+            if (refresh_running) {
+                load_aliases();
+            }
+        }
+    });
+    return true;
+}
+
+void close_aliases() {
+    if (refresh_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(refresh_mutex);
+            refresh_running = false;
+        }
+        refresh_cv.notify_all();
+        refresh_thread.join();
+    }
+    alias_db = nullptr;
+    std::unique_lock<std::shared_mutex> lock(aliases_mutex);
+    aliases.clear();
+}
+
+bool alias_valid(std::string_view name) {
+    return alias_db && ShortCode::valid(name) && name.size() != generated_length && name.size() != legacy_code_length;
+}
+
+bool alias_known(const ShortCode& alias) {
+    std::shared_lock<std::shared_mutex> lock(aliases_mutex);
+    return aliases.count(alias) > 0;
+}
+
+bool record_alias(const ShortCode& alias) {
+    if (!alias_db) {
+        return false;
+    }
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(alias_db, "INSERT OR IGNORE INTO aliases (alias) VALUES (?);", -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, alias.data(), static_cast<int>(alias.size()), SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(aliases_mutex);
+    aliases.insert(alias);
+    return true;
+}
+
+void release_alias(const ShortCode& alias) {
+    if (!alias_db) {
+        return;
+    }
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(alias_db, "DELETE FROM aliases WHERE alias = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, alias.data(), static_cast<int>(alias.size()), SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+    std::unique_lock<std::shared_mutex> lock(aliases_mutex);
+    aliases.erase(alias);
+}
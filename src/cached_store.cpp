@@ -0,0 +1,209 @@
+#include "cached_store.hpp"
+#include <algorithm>
+#include <chrono>
+
+static int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CachedStore::CachedStore(std::unique_ptr<UrlStore> backend, size_t capacity, int64_t ttl_ms)
+    : backend_(std::move(backend)), shard_capacity_(std::max<size_t>(1, capacity / shard_count)),
+      ttl_ns_(std::max<int64_t>(0, ttl_ms) * 1000000) {}
+
+CachedStore::Shard& CachedStore::shard_for(const ShortCode& short_code) {
+    return shards_[short_code.hash() % shard_count];
+}
+
+bool CachedStore::lookup(const ShortCode& short_code, std::string& url, uint64_t& generation) {
+    Shard& shard = shard_for(short_code);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(short_code);
+    if (it != shard.index.end() && ttl_ns_ > 0 && it->second->expires_at <= steady_now_ns()) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        it = shard.index.end();
+    }
+    if (it == shard.index.end()) {
+        generation = shard.generation;
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    ++it->second->hits;
+    url = it->second->url;
+    return true;
+}
+
+void CachedStore::put(const ShortCode& short_code, const std::string& url, uint64_t generation) {
+    Shard& shard = shard_for(short_code);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.generation != generation) {
+        return;
+    }
+    int64_t expires_at = ttl_ns_ > 0 ? steady_now_ns() + ttl_ns_ : 0;
+    auto it = shard.index.find(short_code);
+    if (it != shard.index.end()) {
+        it->second->url = url;
+        it->second->expires_at = expires_at;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    shard.lru.push_front(Node{short_code, url, 0, expires_at});
+    shard.index[short_code] = shard.lru.begin();
+    if (shard.lru.size() > shard_capacity_) {
+        shard.index.erase(shard.lru.back().short_code);
+        shard.lru.pop_back();
+    }
+}
+
+void CachedStore::erase(const ShortCode& short_code) {
+    Shard& shard = shard_for(short_code);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ++shard.generation;
+    auto it = shard.index.find(short_code);
+    if (it != shard.index.end()) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+void CachedStore::insert(const ShortCode& short_code, const std::string& url) {
+    // The URL may move away from another code, whose cached entry would then be stale.
+    ShortCode previous_code = backend_->get_by_url(url);
+    if (!previous_code.empty() && previous_code != short_code) {
+        erase(previous_code);
+    }
+    backend_->insert(short_code, url);
+    erase(short_code);
+}
+
+bool CachedStore::insert_new(const ShortCode& short_code, const std::string& url) {
+    if (!backend_->insert_new(short_code, url)) {
+        return false;
+    }
+    erase(short_code);
+    return true;
+}
+
+std::string CachedStore::get(const ShortCode& short_code) {
+    std::string url;
+    uint64_t generation;
+    if (lookup(short_code, url, generation)) {
+        return url;
+    }
+    url = backend_->get(short_code);
+    if (!url.empty()) {
+        put(short_code, url, generation);
+    }
+    return url;
+}
+
+ShortCode CachedStore::get_by_url(const std::string& url) {
+    return backend_->get_by_url(url);
+}
+
+void CachedStore::remove(const ShortCode& short_code) {
+    backend_->remove(short_code);
+    erase(short_code);
+}
+
+void CachedStore::for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    backend_->for_each(callback);
+}
+
+void CachedStore::for_each_with_prefix(const std::string& prefix,
+                                       const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    backend_->for_each_with_prefix(prefix, callback);
+}
+
+bool CachedStore::has_url_index() {
+    return backend_->has_url_index();
+}
+
+void CachedStore::insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) {
+    // Bulk loads can move any number of URLs between codes; start over instead of looking each up.
+    backend_->insert_batch(entries);
+    clear();
+}
+
+std::vector<std::string> CachedStore::get_batch(const std::vector<ShortCode>& short_codes) {
+    std::vector<std::string> urls(short_codes.size());
+    std::vector<ShortCode> missing;
+    std::vector<size_t> positions;
+    std::vector<uint64_t> generations;
+    for (size_t i = 0; i < short_codes.size(); ++i) {
+        uint64_t generation;
+        if (!lookup(short_codes[i], urls[i], generation)) {
+            missing.push_back(short_codes[i]);
+            positions.push_back(i);
+            generations.push_back(generation);
+        }
+    }
+    if (missing.empty()) {
+        return urls;
+    }
+    auto loaded = backend_->get_batch(missing);
+    for (size_t i = 0; i < missing.size(); ++i) {
+        urls[positions[i]] = loaded[i];
+        if (!loaded[i].empty()) {
+            put(missing[i], loaded[i], generations[i]);
+        }
+    }
+    return urls;
+}
+
+void CachedStore::remove_batch(const std::vector<ShortCode>& short_codes) {
+    backend_->remove_batch(short_codes);
+    for (const auto& short_code : short_codes) {
+        erase(short_code);
+    }
+}
+
+bool CachedStore::healthy() {
+    return backend_->healthy();
+}
+
+bool CachedStore::get_cached(const ShortCode& short_code, std::string& url) {
+    uint64_t generation;
+    return lookup(short_code, url, generation);
+}
+
+std::vector<ShortCode> CachedStore::hottest(size_t count) {
+    std::vector<std::pair<uint32_t, ShortCode>> entries;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& node : shard.lru) {
+            entries.emplace_back(node.hits, node.short_code);
+        }
+    }
+    count = std::min(count, entries.size());
+    std::partial_sort(entries.begin(), entries.begin() + count, entries.end(),
+                      [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<ShortCode> codes;
+    codes.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        codes.push_back(entries[i].second);
+    }
+    return codes;
+}
+
+size_t CachedStore::size() {
+    size_t total = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.lru.size();
+    }
+    return total;
+}
+
+void CachedStore::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++shard.generation;
+        shard.lru.clear();
+        shard.index.clear();
+    }
+}
+
+UrlStore& CachedStore::backend() {
+    return *backend_;
+}
@@ -0,0 +1,39 @@
+#include "clock.hpp"
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+struct TimestampCache {
+    int64_t second = -1;
+    char prefix[20];
+};
+
+static thread_local TimestampCache cache;
+
+uint64_t current_time_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+size_t format_timestamp(uint64_t time_us, char* out) {
+    int64_t second = static_cast<int64_t>(time_us / 1000000);
+    if (second != cache.second) {
+        std::time_t t = static_cast<std::time_t>(second);
+        std::tm tm{};
+        gmtime_r(&t, &tm);
+        std::strftime(cache.prefix, sizeof(cache.prefix), "%Y-%m-%d %H:%M:%S", &tm);
+        cache.second = second;
+    }
+    std::memcpy(out, cache.prefix, 19);
+    unsigned millis = static_cast<unsigned>((time_us / 1000) % 1000);
+    out[19] = '.';
+    out[20] = static_cast<char>('0' + millis / 100);
+    out[21] = static_cast<char>('0' + millis / 10 % 10);
+    out[22] = static_cast<char>('0' + millis % 10);
+    return timestamp_length;
+}
+
+std::string current_timestamp() {
+    char buffer[timestamp_length];
+    return std::string(buffer, format_timestamp(current_time_us(), buffer));
+}
@@ -0,0 +1,54 @@
+#include "code_checksum.hpp"
+#include <cstdint>
+#include <cstring>
+
+static size_t checksum_length = 0;
+static size_t legacy_code_length = 0;
+static uint64_t key_low = 0;
+static uint64_t key_high = 0;
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+void configure_code_checksum(size_t code_length, const std::string& key, size_t legacy_length) {
+    checksum_length = code_length >= 2 && code_length <= ShortCode::max_length ? code_length : 0;
+    legacy_code_length = legacy_length;
+    // FNV-1a, so the same key gives the same check characters in every build and process.
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (char c : key) {
+        h = (h ^ static_cast<unsigned char>(c)) * 0x100000001B3ULL;
+    }
+    key_low = mix(h);
+    key_high = mix(h ^ 0x9E3779B97F4A7C15ULL);
+}
+
+bool code_checksum_enabled() {
+    return checksum_length > 0;
+}
+
+char code_check_char(const char* chars, size_t length) {
+    char padded[ShortCode::max_length] = {};
+    std::memcpy(padded, chars, length < ShortCode::max_length ? length : ShortCode::max_length);
+    uint64_t low, high;
+    std::memcpy(&low, padded, 8);
+    std::memcpy(&high, padded + 8, 8);
+    uint64_t h = mix((low ^ key_low) + length);
+    h = mix(h ^ high ^ key_high);
+    return base62_digits[((h >> 32) * 62) >> 32];
+}
+
+bool code_may_exist(const ShortCode& code) {
+    size_t length = code.size();
+    if (checksum_length == 0 || (length == legacy_code_length && length > 0)) {
+        return true;
+    }
+    if (length != checksum_length) {
+        return false;
+    }
+    return code_check_char(code.data(), length - 1) == code.data()[length - 1];
+}
@@ -0,0 +1,392 @@
+#include "code_pool.hpp"
+#include "clock.hpp"
+#include "code_checksum.hpp"
+#include "database.hpp"
+#include "logger.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+CodeQueue::CodeQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    cells_.reset(new Cell[size]);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool CodeQueue::push(const ShortCode& code) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells_[pos & mask_];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.code = code;
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool CodeQueue::pop(ShortCode& code) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells_[pos & mask_];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                code = cell.code;
+                cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+size_t CodeQueue::size() const {
+    size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+    size_t enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+}
+
+// A batch of reserved codes is handed out once the queue has popped end codes in total.
+struct ReservedBatch {
+    int64_t id;
+    uint64_t end;
+};
+
+// A pool renews the lease on its rows every lease_renew_seconds; rows whose lease has run out
+// belong to a pool that is gone.
+static const int64_t lease_seconds = 60;
+static const int64_t lease_renew_seconds = 10;
+
+static std::unique_ptr<CodeQueue> pool;
+static sqlite3* reservations = nullptr;
+static int pool_code_length = 0;
+static size_t pool_target = 0;
+static size_t pool_low_water = 0;
+static size_t pool_refill_batch = 0;
+static int64_t owner = 0;
+static int64_t next_batch = 1;
+static uint64_t pushed = 0;
+static std::deque<ReservedBatch> batches;
+
+static std::atomic<bool> pool_stopping{false};
+static std::atomic<bool> refill_wanted{false};
+static std::mutex refill_mutex;
+static std::condition_variable refill_cv;
+static std::thread refill_thread;
+
+static std::atomic<uint64_t> taken{0};
+static std::atomic<uint64_t> misses{0};
+static std::atomic<uint64_t> recovered{0};
+
+static bool exec(const char* sql) {
+    char* err_msg = nullptr;
+    if (sqlite3_exec(reservations, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cout << "Failed to update code reservations: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return false;
+    }
+    return true;
+}
+
+static void bind_code(sqlite3_stmt* stmt, int index, const ShortCode& code) {
+    sqlite3_bind_text(stmt, index, code.data(), static_cast<int>(code.size()), SQLITE_STATIC);
+}
+
+static int64_t now_seconds() {
+    return static_cast<int64_t>(current_time_us() / 1000000);
+}
+
+// Random per start: process ids repeat across containers sharing the database.
+static int64_t new_owner() {
+    std::random_device random;
+    uint64_t token = (static_cast<uint64_t>(random()) << 32) | random();
+    return static_cast<int64_t>(token >> 1) | 1;
+}
+
+static void renew_lease() {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(reservations, "UPDATE code_reservations SET lease_until = ? WHERE owner = ?;", -1, &stmt, nullptr) ==
+        SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, now_seconds() + lease_seconds);
+        sqlite3_bind_int64(stmt, 2, owner);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+}
+
+static void push_batch(const std::vector<ShortCode>& codes, int64_t batch) {
+    for (const auto& code : codes) {
+        if (!pool->push(code)) {
+            break;
+        }
+        ++pushed;
+    }
+    batches.push_back(ReservedBatch{batch, pushed});
+}
+
+// Takes over the rows whose lease has run out: codes still unused go back in the pool as far as
+// it has room, the rest are deleted. The lease is checked again in each update, so a row is
+// never taken from an owner that renewed it meanwhile.
+static void recover_reservations() {
+    std::vector<std::pair<ShortCode, int64_t>> rows;
+    int64_t now = now_seconds();
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(reservations, "SELECT short_code, owner FROM code_reservations WHERE lease_until < ? AND owner != ?;",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        return;
+    }
+    sqlite3_bind_int64(stmt, 1, now);
+    sqlite3_bind_int64(stmt, 2, owner);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        if (text) {
+            rows.emplace_back(ShortCode(text), sqlite3_column_int64(stmt, 1));
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (rows.empty()) {
+        return;
+    }
+
+    std::vector<ShortCode> codes;
+    for (const auto& row : rows) {
+        codes.push_back(row.first);
+    }
+    auto urls = current_store()->get_batch(codes);
+    int64_t batch = next_batch++;
+    std::vector<ShortCode> kept;
+    sqlite3_stmt* take;
+    sqlite3_stmt* drop;
+    sqlite3_prepare_v2(reservations,
+                       "UPDATE code_reservations SET owner = ?, batch = ?, lease_until = ? WHERE short_code = ? AND owner = ? "
+                       "AND lease_until < ?;",
+                       -1, &take, nullptr);
+    sqlite3_prepare_v2(reservations, "DELETE FROM code_reservations WHERE short_code = ? AND owner = ? AND lease_until < ?;", -1,
+                       &drop, nullptr);
+    size_t size = pool->size();
+    size_t room = size < pool_target ? pool_target - size : 0;
+    exec("BEGIN IMMEDIATE;");
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const ShortCode& code = rows[i].first;
+        bool usable = urls[i].empty() && code.size() == static_cast<size_t>(pool_code_length) && code_may_exist(code) &&
+                      kept.size() < room;
+        sqlite3_stmt* update = usable ? take : drop;
+        int index = 1;
+        if (usable) {
+            sqlite3_bind_int64(take, index++, owner);
+            sqlite3_bind_int64(take, index++, batch);
+            sqlite3_bind_int64(take, index++, now + lease_seconds);
+        }
+        bind_code(update, index++, code);
+        sqlite3_bind_int64(update, index++, rows[i].second);
+        sqlite3_bind_int64(update, index, now);
+        if (sqlite3_step(update) == SQLITE_DONE && usable && sqlite3_changes(reservations) == 1) {
+            kept.push_back(code);
+        }
+        sqlite3_reset(update);
+    }
+    sqlite3_finalize(take);
+    sqlite3_finalize(drop);
+    if (!exec("COMMIT;")) {
+        exec("ROLLBACK;");
+        return;
+    }
+    push_batch(kept, batch);
+    recovered += kept.size();
+    log("Recovered " + std::to_string(kept.size()) + " reserved short codes of " + std::to_string(rows.size()));
+}
+
+// Generates up to refill_batch codes, keeps those that are not stored or reserved by another
+// pool and reserves them in one transaction. False if nothing was added.
+static bool refill_once() {
+    size_t size = pool->size();
+    size_t wanted = std::min(pool_refill_batch, size < pool_target ? pool_target - size : 0);
+    if (wanted == 0) {
+        return false;
+    }
+    std::vector<ShortCode> candidates;
+    for (size_t i = 0; i < wanted; ++i) {
+        candidates.push_back(candidate_short(pool_code_length));
+    }
+    auto urls = current_store()->get_batch(candidates);
+
+    int64_t batch = next_batch++;
+    std::vector<ShortCode> reserved;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(reservations,
+                           "INSERT OR IGNORE INTO code_reservations (short_code, owner, batch, lease_until) VALUES (?, ?, ?, ?);",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    if (!exec("BEGIN IMMEDIATE;")) {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (!urls[i].empty()) {
+            continue;
+        }
+        bind_code(stmt, 1, candidates[i]);
+        sqlite3_bind_int64(stmt, 2, owner);
+        sqlite3_bind_int64(stmt, 3, batch);
+        sqlite3_bind_int64(stmt, 4, now_seconds() + lease_seconds);
+        if (sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(reservations) == 1) {
+            reserved.push_back(candidates[i]);
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (!exec("COMMIT;")) {
+        exec("ROLLBACK;");
+        return false;
+    }
+    push_batch(reserved, batch);
+    return !reserved.empty();
+}
+
+// Deletes the rows of batches the pool has handed out completely.
+static void release_taken_batches() {
+    sqlite3_stmt* stmt = nullptr;
+    while (!batches.empty() && pool->popped() >= batches.front().end) {
+        if (!stmt && sqlite3_prepare_v2(reservations, "DELETE FROM code_reservations WHERE owner = ? AND batch = ?;", -1, &stmt,
+                                        nullptr) != SQLITE_OK) {
+            return;
+        }
+        sqlite3_bind_int64(stmt, 1, owner);
+        sqlite3_bind_int64(stmt, 2, batches.front().id);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        batches.pop_front();
+    }
+    sqlite3_finalize(stmt);
+}
+
+bool start_code_pool(const std::string& db_path, int short_code_length, size_t pool_size, size_t low_water,
+                     size_t refill_batch) {
+    stop_code_pool();
+    if (pool_size == 0 || current_store() == nullptr) {
+        return false;
+    }
+    if (sqlite3_open(db_path.c_str(), &reservations) != SQLITE_OK) {
+        std::cout << "Failed to open code reservations: " << db_path << std::endl;
+        sqlite3_close(reservations);
+        reservations = nullptr;
+        return false;
+    }
+    sqlite3_busy_timeout(reservations, 5000);
+    if (!exec("CREATE TABLE IF NOT EXISTS code_reservations (short_code TEXT PRIMARY KEY, owner INTEGER NOT NULL, "
+              "batch INTEGER NOT NULL, lease_until INTEGER NOT NULL DEFAULT 0);")) {
+        sqlite3_close(reservations);
+        reservations = nullptr;
+        return false;
+    }
+    // Tables from before leases; their rows count as expired. Fails harmlessly once the column exists.
+    sqlite3_exec(reservations, "ALTER TABLE code_reservations ADD COLUMN lease_until INTEGER NOT NULL DEFAULT 0;", nullptr,
+                 nullptr, nullptr);
+    pool = std::make_unique<CodeQueue>(pool_size);
+    pool_code_length = short_code_length;
+    pool_target = pool_size;
+    pool_low_water = std::min(low_water, pool_size - 1);
+    pool_refill_batch = std::max<size_t>(refill_batch, 1);
+    owner = new_owner();
+    next_batch = 1;
+    pushed = 0;
+    batches.clear();
+    pool_stopping = false;
+    refill_thread = std::thread([] {
+        recover_reservations();
+        int64_t renewed = now_seconds();
+        while (!pool_stopping) {
+            if (now_seconds() - renewed >= lease_renew_seconds) {
+                renew_lease();
+                renewed = now_seconds();
+                // Pools that crashed leave rows behind whose lease runs out later.
+                recover_reservations();
+            }
+            release_taken_batches();
+            if (pool->size() <= pool_low_water) {
+                while (!pool_stopping && refill_once()) {
+                }
+                release_taken_batches();
+            }
+            std::unique_lock<std::mutex> lock(refill_mutex);
+            refill_cv.wait_for(lock, std::chrono::seconds(1), [] { return pool_stopping || refill_wanted.exchange(false); });
+        }
+    });
+    return true;
+}
+
+void stop_code_pool() {
+    if (!refill_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(refill_mutex);
+        pool_stopping = true;
+    }
+    refill_cv.notify_all();
+    refill_thread.join();
+    // The codes still in the pool stay reserved with their lease ended, so the next start, or
+    // another running pool, takes them back.
+    release_taken_batches();
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(reservations, "UPDATE code_reservations SET lease_until = 0 WHERE owner = ?;", -1, &stmt, nullptr) ==
+        SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, owner);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+    pool.reset();
+    sqlite3_close(reservations);
+    reservations = nullptr;
+}
+
+ShortCode next_short_code(int short_code_length) {
+    ShortCode code;
+    if (pool && pool->pop(code)) {
+        ++taken;
+        if (pool->size() <= pool_low_water && !refill_wanted.load(std::memory_order_relaxed) && !refill_wanted.exchange(true)) {
+            refill_cv.notify_one();
+        }
+        return code;
+    }
+    if (pool) {
+        ++misses;
+    }
+    return generate_short(short_code_length);
+}
+
+CodePoolStats code_pool_stats() {
+    CodePoolStats stats;
+    stats.available = pool ? pool->size() : 0;
+    stats.taken = taken.load();
+    stats.misses = misses.load();
+    stats.recovered = recovered.load();
+    return stats;
+}
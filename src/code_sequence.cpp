@@ -0,0 +1,253 @@
+#include "code_sequence.hpp"
+#include "code_checksum.hpp"
+#include "deadline.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+static const size_t max_sequence_digits = 10;
+
+static sqlite3* sequence_db = nullptr;
+static int sequence_length = 0;
+static uint64_t sequence_block = 0;
+static std::atomic<bool> sequence_running{false};
+
+// Guards the blocks; lease_mutex guards sequence_db. A thread holding sequence_mutex may take
+// lease_mutex, never the other way round.
+static std::mutex sequence_mutex;
+static std::mutex lease_mutex;
+static uint64_t block_next = 0;
+static uint64_t block_end = 0;
+static uint64_t spare_start = 0;
+static uint64_t spare_end = 0;
+
+static bool renew_wanted = false;
+static bool renew_stopping = false;
+static std::condition_variable renew_cv;
+static std::thread renew_thread;
+// Signalled after each lease attempt, for requests waiting on it.
+static std::condition_variable spare_cv;
+static uint64_t lease_attempts = 0;
+
+static std::atomic<uint64_t> leases{0};
+static std::atomic<uint64_t> issued{0};
+static std::atomic<uint64_t> behind{0};
+
+bool lease_id_block(sqlite3* handle, uint64_t block_size, uint64_t& start) {
+    if (sqlite3_exec(handle, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    bool ok = sqlite3_exec(handle, "INSERT OR IGNORE INTO code_sequence (name, next_id) VALUES ('short_code', 0);", nullptr,
+                           nullptr, nullptr) == SQLITE_OK;
+    sqlite3_stmt* stmt;
+    if (ok && sqlite3_prepare_v2(handle, "SELECT next_id FROM code_sequence WHERE name = 'short_code';", -1, &stmt, nullptr) ==
+                  SQLITE_OK) {
+        ok = sqlite3_step(stmt) == SQLITE_ROW;
+        if (ok) {
+            start = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    } else {
+        ok = false;
+    }
+    if (ok && sqlite3_prepare_v2(handle, "UPDATE code_sequence SET next_id = next_id + ? WHERE name = 'short_code';", -1, &stmt,
+                                 nullptr) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(block_size));
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+    } else {
+        ok = false;
+    }
+    if (!ok || sqlite3_exec(handle, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_exec(handle, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    return true;
+}
+
+static size_t random_length(int short_code_length) {
+    size_t length = static_cast<size_t>(std::clamp<int>(short_code_length, 1, ShortCode::max_length));
+    return code_checksum_enabled() && length > 1 ? length - 1 : length;
+}
+
+uint64_t sequence_capacity(int short_code_length) {
+    uint64_t capacity = 1;
+    for (size_t i = 0; i < std::min(random_length(short_code_length), max_sequence_digits); ++i) {
+        capacity *= 62;
+    }
+    return capacity;
+}
+
+ShortCode sequence_code(uint64_t id, int short_code_length) {
+    size_t length = random_length(short_code_length);
+    uint64_t capacity = sequence_capacity(short_code_length);
+    // x -> (x * a + b) mod 62^n permutes the IDs when a shares no factor with 62 (2 and 31).
+    uint64_t a = 0x9E3779B97F4A7C15ULL % capacity;
+    while (a % 2 == 0 || a % 31 == 0) {
+        ++a;
+    }
+    uint64_t b = 0x632BE59BD9B4E019ULL % capacity;
+    uint64_t x = static_cast<uint64_t>((static_cast<unsigned __int128>(id % capacity) * a + b) % capacity);
+
+    // Codes longer than 10 characters start with zeros.
+    char chars[ShortCode::max_length];
+    for (size_t i = length; i > 0; --i) {
+        chars[i - 1] = base62_digits[x % 62];
+        x /= 62;
+    }
+    size_t total = length;
+    if (code_checksum_enabled() && static_cast<size_t>(short_code_length) > length) {
+        chars[length] = code_check_char(chars, length);
+        ++total;
+    }
+    return ShortCode(std::string_view(chars, total));
+}
+
+// Leases a block into [start, end) unless the sequence is used up.
+static bool lease(uint64_t& start, uint64_t& end) {
+    std::lock_guard<std::mutex> lock(lease_mutex);
+    if (!sequence_db || !lease_id_block(sequence_db, sequence_block, start)) {
+        return false;
+    }
+    ++leases;
+    if (start + sequence_block > sequence_capacity(sequence_length)) {
+        log("Short code sequence is used up, generating random codes", "ERROR");
+        sequence_running = false;
+        return false;
+    }
+    end = start + sequence_block;
+    return true;
+}
+
+bool start_code_sequence(const std::string& db_path, int short_code_length, uint64_t block_size) {
+    stop_code_sequence();
+    if (block_size == 0) {
+        return false;
+    }
+    if (sqlite3_open(db_path.c_str(), &sequence_db) != SQLITE_OK) {
+        std::cout << "Failed to open code sequence: " << db_path << std::endl;
+        sqlite3_close(sequence_db);
+        sequence_db = nullptr;
+        return false;
+    }
+    sqlite3_busy_timeout(sequence_db, 5000);
+    char* err_msg = nullptr;
+    if (sqlite3_exec(sequence_db, "CREATE TABLE IF NOT EXISTS code_sequence (name TEXT PRIMARY KEY, next_id INTEGER NOT NULL);",
+                     nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cout << "Failed to create code sequence table: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        sqlite3_close(sequence_db);
+        sequence_db = nullptr;
+        return false;
+    }
+    sequence_length = short_code_length;
+    sequence_block = block_size;
+    sequence_running = true;
+    {
+        std::lock_guard<std::mutex> lock(sequence_mutex);
+        block_next = block_end = spare_start = spare_end = 0;
+        renew_wanted = true;
+        renew_stopping = false;
+    }
+    renew_thread = std::thread([] {
+        std::unique_lock<std::mutex> lock(sequence_mutex);
+        while (true) {
+            renew_cv.wait(lock, [] { return renew_stopping || renew_wanted; });
+            if (renew_stopping) {
+                return;
+            }
+            renew_wanted = false;
+            if (spare_start != spare_end || !sequence_running) {
+                continue;
+            }
+            lock.unlock();
+            uint64_t start = 0, end = 0;
+            bool leased = lease(start, end);
+            lock.lock();
+            if (leased && spare_start == spare_end) {
+                spare_start = start;
+                spare_end = end;
+            }
+            ++lease_attempts;
+            spare_cv.notify_all();
+        }
+    });
+    renew_cv.notify_one();
+    return true;
+}
+
+void stop_code_sequence() {
+    if (!renew_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sequence_mutex);
+        renew_stopping = true;
+    }
+    renew_cv.notify_all();
+    spare_cv.notify_all();
+    renew_thread.join();
+    sequence_running = false;
+    std::lock_guard<std::mutex> lock(lease_mutex);
+    sqlite3_close(sequence_db);
+    sequence_db = nullptr;
+}
+
+bool next_sequence_code(ShortCode& code) {
+    if (!sequence_running) {
+        return false;
+    }
+    uint64_t id;
+    {
+        std::unique_lock<std::mutex> lock(sequence_mutex);
+        if (block_next == block_end) {
+            if (spare_start == spare_end) {
+                // Renewal fell behind. Leasing here would hold every other /shorten behind a
+                // write transaction, so this request waits for the renewing thread's next
+                // attempt, but not past its deadline.
+                if (!renew_wanted) {
+                    renew_wanted = true;
+                    renew_cv.notify_one();
+                }
+                uint64_t attempts = lease_attempts;
+                auto renewed = [attempts] {
+                    return spare_start != spare_end || lease_attempts != attempts || renew_stopping || !sequence_running;
+                };
+                uint64_t deadline = request_deadline();
+                if (deadline == 0) {
+                    spare_cv.wait(lock, renewed);
+                } else {
+                    spare_cv.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::microseconds(deadline)), renewed);
+                }
+            }
+            if (spare_start == spare_end) {
+                ++behind;
+                return false;
+            }
+            block_next = spare_start;
+            block_end = spare_end;
+            spare_start = spare_end = 0;
+        }
+        id = block_next++;
+        if (block_end - block_next <= sequence_block / 4 && spare_start == spare_end && !renew_wanted) {
+            renew_wanted = true;
+            renew_cv.notify_one();
+        }
+    }
+    ++issued;
+    code = sequence_code(id, sequence_length);
+    return true;
+}
+
+CodeSequenceStats code_sequence_stats() {
+    CodeSequenceStats stats;
+    stats.leases = leases.load();
+    stats.issued = issued.load();
+    stats.behind = behind.load();
+    return stats;
+}
@@ -0,0 +1,173 @@
+#include "compressed_store.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+static std::atomic<size_t> dictionary_tokens{0};
+static std::atomic<uint64_t> raw_bytes{0};
+static std::atomic<uint64_t> stored_bytes{0};
+static std::atomic<uint64_t> decodes{0};
+static std::atomic<uint64_t> decode_ns{0};
+
+CompressedStore::CompressedStore(std::unique_ptr<UrlStore> backend, UrlDictionary dictionary)
+    : backend_(std::move(backend)), dictionary_(std::move(dictionary)) {
+    dictionary_tokens = dictionary_.size();
+}
+
+std::string CompressedStore::encode(const std::string& url) {
+    std::string value = dictionary_.encode(url);
+    raw_bytes += url.size();
+    stored_bytes += value.size();
+    return value;
+}
+
+std::string CompressedStore::decode(const std::string& value) {
+    if (!UrlDictionary::is_encoded(value)) {
+        return value;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::string url = dictionary_.decode(value);
+    decode_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    ++decodes;
+    return url;
+}
+
+void CompressedStore::insert(const ShortCode& short_code, const std::string& url) {
+    backend_->insert(short_code, encode(url));
+}
+
+bool CompressedStore::insert_new(const ShortCode& short_code, const std::string& url) {
+    if (!get_by_url(url).empty()) {
+        return false;
+    }
+    return backend_->insert_new(short_code, encode(url));
+}
+
+std::string CompressedStore::get(const ShortCode& short_code) {
+    return decode(backend_->get(short_code));
+}
+
+ShortCode CompressedStore::get_by_url(const std::string& url) {
+    std::string value = dictionary_.encode(url);
+    ShortCode short_code = backend_->get_by_url(value);
+    // Rows written uncompressed after the dictionary was trained, e.g. by another process.
+    if (short_code.empty() && value != url) {
+        short_code = backend_->get_by_url(url);
+    }
+    return short_code;
+}
+
+void CompressedStore::remove(const ShortCode& short_code) {
+    backend_->remove(short_code);
+}
+
+void CompressedStore::for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    backend_->for_each([this, &callback](const ShortCode& short_code, const std::string& value) {
+        callback(short_code, dictionary_.decode(value));
+    });
+}
+
+void CompressedStore::insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) {
+    std::vector<std::pair<ShortCode, std::string>> encoded;
+    encoded.reserve(entries.size());
+    for (const auto& entry : entries) {
+        encoded.emplace_back(entry.first, encode(entry.second));
+    }
+    backend_->insert_batch(encoded);
+}
+
+std::vector<std::string> CompressedStore::get_batch(const std::vector<ShortCode>& short_codes) {
+    auto values = backend_->get_batch(short_codes);
+    for (auto& value : values) {
+        value = decode(value);
+    }
+    return values;
+}
+
+void CompressedStore::remove_batch(const std::vector<ShortCode>& short_codes) {
+    backend_->remove_batch(short_codes);
+}
+
+bool CompressedStore::healthy() {
+    return backend_->healthy();
+}
+
+bool CompressedStore::get_cached(const ShortCode& short_code, std::string& url) {
+    if (!backend_->get_cached(short_code, url)) {
+        return false;
+    }
+    url = decode(url);
+    return true;
+}
+
+size_t CompressedStore::compress_existing() {
+    return rewrite_values(*backend_, [](const std::string& value) { return !UrlDictionary::is_encoded(value); },
+                          [this](const std::string& value) { return encode(value); });
+}
+
+UrlStore& CompressedStore::backend() {
+    return *backend_;
+}
+
+std::unique_ptr<UrlStore> open_compressed_store(std::unique_ptr<UrlStore> backend, const std::string& path,
+                                                size_t sample_size) {
+    UrlDictionary dictionary;
+    bool trained = false;
+    if (!dictionary.load(path)) {
+        // Reservoir sample, so the dictionary reflects the whole table and not its oldest rows.
+        std::vector<std::string> sample;
+        std::mt19937_64 rng(1);
+        size_t seen = 0;
+        size_t encoded = 0;
+        backend->for_each([&](const ShortCode&, const std::string& url) {
+            if (UrlDictionary::is_encoded(url)) {
+                ++encoded;
+                return;
+            }
+            if (sample.size() < sample_size) {
+                sample.push_back(url);
+            } else if (sample_size > 0) {
+                size_t slot = rng() % (seen + 1);
+                if (slot < sample_size) {
+                    sample[slot] = url;
+                }
+            }
+            ++seen;
+        });
+        if (encoded > 0) {
+            log("Stored URLs are compressed but the dictionary is missing: " + path, "ERROR");
+            return nullptr;
+        }
+        if (sample.empty()) {
+            log("No URLs to train a dictionary on yet, storing them uncompressed", "WARN");
+            return backend;
+        }
+        dictionary = UrlDictionary::train(sample);
+        if (!dictionary.save(path)) {
+            log("Failed to save URL dictionary: " + path, "ERROR");
+            return backend;
+        }
+        trained = true;
+    }
+    auto store = std::make_unique<CompressedStore>(std::move(backend), std::move(dictionary));
+    log("URL dictionary: " + std::to_string(store->dictionary().size()) + " tokens" + (trained ? ", trained" : ""));
+    if (trained) {
+        size_t rewritten = store->compress_existing();
+        UrlCompressionStats stats = url_compression_stats();
+        log("Compressed " + std::to_string(rewritten) + " stored URLs, " + std::to_string(stats.raw_bytes) + " -> " +
+            std::to_string(stats.stored_bytes) + " bytes");
+    }
+    return store;
+}
+
+UrlCompressionStats url_compression_stats() {
+    UrlCompressionStats stats;
+    stats.tokens = dictionary_tokens.load();
+    stats.raw_bytes = raw_bytes.load();
+    stats.stored_bytes = stored_bytes.load();
+    stats.decodes = decodes.load();
+    stats.decode_ns = decode_ns.load();
+    return stats;
+}
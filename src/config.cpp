@@ -1,19 +1,122 @@
 #include "config.hpp"
 #include <fstream>
 
-int load_config() {
-    std::ifstream file("config.txt");
+static std::unordered_map<std::string, std::string> read_config_file(const std::string& path) {
+    std::unordered_map<std::string, std::string> values;
+    std::ifstream file(path);
     if (file.is_open()) {
         std::string line;
         while (std::getline(file, line)) {
-            if (line.find("short_code_length=") == 0) {
-                try {
-                    return std::stoi(line.substr(18));
-                } catch (...) {
-                }
+            auto eq = line.find('=');
+            if (line.empty() || line[0] == '#' || eq == std::string::npos) {
+                continue;
             }
+            values[line.substr(0, eq)] = line.substr(eq + 1);
         }
         file.close();
     }
-    return 6;
-}
\ No newline at end of file
+    return values;
+}
+
+template <typename T>
+static void read_number(const std::unordered_map<std::string, std::string>& values, const std::string& key, T& out) {
+    auto it = values.find(key);
+    if (it == values.end()) {
+        return;
+    }
+    try {
+        out = static_cast<T>(std::stoll(it->second));
+    } catch (...) {
+    }
+}
+
+// An empty value keeps the default unless allow_empty is set, for settings an empty value turns off.
+static void read_string(const std::unordered_map<std::string, std::string>& values, const std::string& key, std::string& out,
+                        bool allow_empty = false) {
+    auto it = values.find(key);
+    if (it != values.end() && (allow_empty || !it->second.empty())) {
+        out = it->second;
+    }
+}
+
+Config load_settings(const std::string& path) {
+    Config config;
+    auto values = read_config_file(path);
+    read_number(values, "short_code_length", config.short_code_length);
+    read_number(values, "short_code_checksum", config.short_code_checksum);
+    read_string(values, "short_code_checksum_key", config.short_code_checksum_key);
+    read_number(values, "short_code_legacy_length", config.short_code_legacy_length);
+    read_number(values, "code_pool_size", config.code_pool_size);
+    read_number(values, "code_pool_low_water", config.code_pool_low_water);
+    read_number(values, "code_pool_refill_batch", config.code_pool_refill_batch);
+    read_number(values, "code_sequence_block", config.code_sequence_block);
+    read_string(values, "storage_engine", config.storage_engine);
+    read_string(values, "mmap_dir", config.mmap_dir);
+    read_number(values, "mmap_initial_capacity", config.mmap_initial_capacity);
+    read_string(values, "lsm_dir", config.lsm_dir);
+    read_number(values, "lsm_memtable_bytes", config.lsm_memtable_bytes);
+    read_number(values, "lsm_compaction_trigger", config.lsm_compaction_trigger);
+    read_number(values, "lsm_sync_wal", config.lsm_sync_wal);
+    read_string(values, "shard_dir", config.shard_dir);
+    read_number(values, "shard_count", config.shard_count);
+    read_string(values, "url_dictionary", config.url_dictionary);
+    read_number(values, "url_dictionary_sample", config.url_dictionary_sample);
+    read_number(values, "url_prefix_limit", config.url_prefix_limit);
+    read_number(values, "cache_size", config.cache_size);
+    read_number(values, "cache_ttl_ms", config.cache_ttl_ms);
+    read_string(values, "hot_set_path", config.hot_set_path);
+    read_number(values, "hot_set_size", config.hot_set_size);
+    read_number(values, "hot_set_interval", config.hot_set_interval);
+    read_number(values, "health_probe_interval_ms", config.health_probe_interval_ms);
+    read_number(values, "health_probe_timeout_ms", config.health_probe_timeout_ms);
+    auto fill = values.find("ready_max_log_queue_fill");
+    if (fill != values.end()) {
+        try {
+            config.ready_max_log_queue_fill = std::stod(fill->second);
+        } catch (...) {
+        }
+    }
+    read_string(values, "db_path", config.db_path);
+    read_string(values, "db_journal_mode", config.db_journal_mode);
+    read_string(values, "log_db_path", config.log_db_path);
+    read_string(values, "log_db_journal_mode", config.log_db_journal_mode);
+    read_number(values, "log_queue_size", config.log_queue_size);
+    read_string(values, "log_level", config.log_level);
+    read_string(values, "admin_token", config.admin_token);
+    for (const auto& entry : values) {
+        if (entry.first.find("log_sample.") == 0) {
+            try {
+                config.log_sample_rates[entry.first.substr(11)] = std::stod(entry.second);
+            } catch (...) {
+            }
+        }
+    }
+    for (const auto& entry : values) {
+        if (entry.first.find("rate_limit.") == 0) {
+            try {
+                auto slash = entry.second.find('/');
+                double rate = std::stod(entry.second.substr(0, slash));
+                double burst = slash == std::string::npos ? rate : std::stod(entry.second.substr(slash + 1));
+                config.rate_limits[entry.first.substr(11)] = {rate, burst};
+            } catch (...) {
+            }
+        }
+    }
+    read_number(values, "rate_limit_clients", config.rate_limit_clients);
+    read_number(values, "server_threads", config.server_threads);
+    read_number(values, "admission_max_inflight", config.admission_max_inflight);
+    read_number(values, "admission_target_ms", config.admission_target_ms);
+    read_number(values, "admission_interval_ms", config.admission_interval_ms);
+    read_number(values, "request_timeout_ms", config.request_timeout_ms);
+    read_number(values, "request_arena_size", config.request_arena_size);
+    read_number(values, "shutdown_drain_timeout_ms", config.shutdown_drain_timeout_ms);
+    read_string(values, "hot_restart_socket", config.hot_restart_socket, true);
+    read_string(values, "access_log_dir", config.access_log_dir);
+    read_number(values, "access_log_segment_size", config.access_log_segment_size);
+    read_number(values, "access_log_max_segments", config.access_log_max_segments);
+    return config;
+}
+
+int load_config() {
+    return load_settings().short_code_length;
+}
@@ -1,66 +1,104 @@
 #include "database.hpp"
+#include "deadline.hpp"
+#include "lsm_store.hpp"
+#include "mmap_store.hpp"
+#include "sharded_store.hpp"
+#include "sqlite_store.hpp"
 #include <iostream>
 
 sqlite3* db;
+static std::unique_ptr<UrlStore> store;
 
 void init_db() {
-    const char* sql = "CREATE TABLE IF NOT EXISTS urls (short_code TEXT PRIMARY KEY, url TEXT); CREATE UNIQUE INDEX IF NOT EXISTS idx_url ON urls(url); CREATE TABLE IF NOT EXISTS logs (id INTEGER PRIMARY KEY AUTOINCREMENT, timestamp TEXT, level TEXT, message TEXT, ip TEXT, user_agent TEXT);";
+    set_store(std::make_unique<SqliteStore>(db));
+}
+
+bool set_journal_mode(sqlite3* handle, const std::string& journal_mode) {
+    std::string sql = "PRAGMA journal_mode=" + journal_mode + ";";
     char* err_msg = nullptr;
-    if (sqlite3_exec(db, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
-        std::cout << "Failed to create tables: " << err_msg << std::endl;
+    if (sqlite3_exec(handle, sql.c_str(), nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cout << "Failed to set journal mode: " << err_msg << std::endl;
         sqlite3_free(err_msg);
+        return false;
     }
+    return true;
 }
 
-void insert_url(const std::string& short_code, const std::string& url) {
-    const char* sql = "INSERT OR REPLACE INTO urls (short_code, url) VALUES (?, ?);";
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, short_code.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, url.c_str(), -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            std::cout << "Failed to insert URL" << std::endl;
-        }
-        sqlite3_finalize(stmt);
+bool checkpoint_wal(sqlite3* handle) {
+    char* err_msg = nullptr;
+    if (sqlite3_exec(handle, "PRAGMA wal_checkpoint(TRUNCATE);", nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cout << "Failed to checkpoint WAL: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return false;
     }
+    return true;
 }
 
-std::string get_url(const std::string& short_code) {
-    const char* sql = "SELECT url FROM urls WHERE short_code = ?;";
-    sqlite3_stmt* stmt;
-    std::string url;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, short_code.c_str(), -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            url = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+std::unique_ptr<UrlStore> create_store(const Config& config) {
+    if (config.storage_engine == "sqlite") {
+        return std::make_unique<SqliteStore>(db);
+    }
+    if (config.storage_engine == "mmap") {
+        auto mmap_store = std::make_unique<MmapStore>();
+        if (!mmap_store->open(config.mmap_dir, config.mmap_initial_capacity)) {
+            return nullptr;
         }
-        sqlite3_finalize(stmt);
+        return mmap_store;
     }
-    return url;
+    if (config.storage_engine == "lsm") {
+        LsmStore::Options options;
+        options.memtable_bytes = config.lsm_memtable_bytes;
+        options.compaction_trigger = config.lsm_compaction_trigger;
+        options.sync_wal = config.lsm_sync_wal;
+        auto lsm_store = std::make_unique<LsmStore>();
+        if (!lsm_store->open(config.lsm_dir, options)) {
+            return nullptr;
+        }
+        return lsm_store;
+    }
+    if (config.storage_engine == "sharded") {
+        auto sharded_store = std::make_unique<ShardedSqliteStore>();
+        if (!sharded_store->open(config.shard_dir, config.shard_count, config.db_journal_mode)) {
+            return nullptr;
+        }
+        return sharded_store;
+    }
+    std::cout << "Unknown storage engine: " << config.storage_engine << std::endl;
+    return nullptr;
 }
 
-std::string get_short_code(const std::string& url) {
-    const char* sql = "SELECT short_code FROM urls WHERE url = ?;";
-    sqlite3_stmt* stmt;
-    std::string short_code;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, url.c_str(), -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            short_code = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        }
-        sqlite3_finalize(stmt);
+void set_store(std::unique_ptr<UrlStore> new_store) {
+    store = std::move(new_store);
+}
+
+UrlStore* current_store() {
+    return store.get();
+}
+
+void insert_url(const ShortCode& short_code, const std::string& url) {
+    if (store && !stop_if_expired()) {
+        store->insert(short_code, url);
     }
-    return short_code;
 }
 
-void delete_url(const std::string& short_code) {
-    const char* sql = "DELETE FROM urls WHERE short_code = ?;";
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, short_code.c_str(), -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            std::cout << "Failed to delete URL" << std::endl;
-        }
-        sqlite3_finalize(stmt);
+bool insert_new_url(const ShortCode& short_code, const std::string& url) {
+    return store && !stop_if_expired() && store->insert_new(short_code, url);
+}
+
+std::string get_url(const ShortCode& short_code) {
+    return store && !stop_if_expired() ? store->get(short_code) : "";
+}
+
+bool get_cached_url(const ShortCode& short_code, std::string& url) {
+    return store && store->get_cached(short_code, url);
+}
+
+ShortCode get_short_code(const std::string& url) {
+    return store && !stop_if_expired() ? store->get_by_url(url) : "";
+}
+
+void delete_url(const ShortCode& short_code) {
+    if (store && !stop_if_expired()) {
+        store->remove(short_code);
     }
-}
\ No newline at end of file
+}
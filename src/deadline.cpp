@@ -0,0 +1,60 @@
+#include "deadline.hpp"
+#include <chrono>
+#include <thread>
+
+// Virtual machine steps between deadline checks; a clock read every ~1000 steps is noise.
+static const int progress_steps = 1000;
+
+// 10 retries 1 ms apart, then every 10 ms: about five seconds in total.
+static const int busy_fast_retries = 10;
+static const int busy_max_retries = 510;
+
+static thread_local uint64_t deadline_us = 0;
+static thread_local bool interrupted = false;
+
+uint64_t steady_time_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void set_request_deadline(uint64_t deadline) {
+    deadline_us = deadline;
+    interrupted = false;
+}
+
+uint64_t request_deadline() {
+    return deadline_us;
+}
+
+bool deadline_expired() {
+    return deadline_us != 0 && steady_time_us() >= deadline_us;
+}
+
+bool deadline_interrupted() {
+    return interrupted;
+}
+
+bool stop_if_expired() {
+    if (deadline_expired()) {
+        interrupted = true;
+        return true;
+    }
+    return false;
+}
+
+static int check_deadline(void*) {
+    return stop_if_expired() ? 1 : 0;
+}
+
+static int wait_if_busy(void*, int retries) {
+    if (retries >= busy_max_retries || stop_if_expired()) {
+        return 0;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(retries < busy_fast_retries ? 1 : 10));
+    return 1;
+}
+
+void watch_deadline(sqlite3* handle) {
+    sqlite3_progress_handler(handle, progress_steps, check_deadline, nullptr);
+    sqlite3_busy_handler(handle, wait_if_busy, nullptr);
+}
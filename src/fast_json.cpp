@@ -0,0 +1,293 @@
+#include "fast_json.hpp"
+
+// Deeper documents are rejected instead of recursing without bound.
+static const int max_depth = 64;
+
+size_t json_skip_space(std::string_view text, size_t pos) {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+        ++pos;
+    }
+    return pos;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool read_hex4(std::string_view text, size_t pos, unsigned& out) {
+    if (pos + 4 > text.size()) {
+        return false;
+    }
+    out = 0;
+    for (size_t i = pos; i < pos + 4; ++i) {
+        int digit = hex_value(text[i]);
+        if (digit < 0) {
+            return false;
+        }
+        out = (out << 4) | static_cast<unsigned>(digit);
+    }
+    return true;
+}
+
+// Characters that end a run of plain string contents: quote, backslash and control characters.
+struct StringStops {
+    bool stop[256] = {};
+    constexpr StringStops() {
+        for (int c = 0; c < 0x20; ++c) {
+            stop[c] = true;
+        }
+        stop[static_cast<unsigned char>('"')] = true;
+        stop[static_cast<unsigned char>('\\')] = true;
+    }
+};
+
+static constexpr StringStops string_stops;
+
+bool json_scan_string(std::string_view text, size_t& pos, std::string_view& contents, bool& escaped) {
+    size_t start = ++pos;
+    escaped = false;
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+    while (pos < text.size()) {
+        while (pos < text.size() && !string_stops.stop[data[pos]]) {
+            ++pos;
+        }
+        if (pos >= text.size()) {
+            break;
+        }
+        char c = text[pos];
+        if (c == '"') {
+            contents = text.substr(start, pos - start);
+            ++pos;
+            return true;
+        }
+        if (static_cast<unsigned char>(c) < 0x20) {
+            return false;
+        }
+        if (c == '\\') {
+            escaped = true;
+            if (++pos >= text.size()) {
+                return false;
+            }
+            char e = text[pos];
+            if (e == 'u') {
+                unsigned code;
+                if (!read_hex4(text, pos + 1, code)) {
+                    return false;
+                }
+                pos += 4;
+            } else if (e != '"' && e != '\\' && e != '/' && e != 'b' && e != 'f' && e != 'n' && e != 'r' && e != 't') {
+                return false;
+            }
+        }
+        ++pos;
+    }
+    return false;
+}
+
+static bool skip_number(std::string_view text, size_t& pos) {
+    auto digit = [&text](size_t i) { return i < text.size() && text[i] >= '0' && text[i] <= '9'; };
+    if (pos < text.size() && text[pos] == '-') {
+        ++pos;
+    }
+    if (!digit(pos)) {
+        return false;
+    }
+    if (text[pos] == '0') {
+        ++pos;
+    } else {
+        while (digit(pos)) ++pos;
+    }
+    if (pos < text.size() && text[pos] == '.') {
+        if (!digit(++pos)) {
+            return false;
+        }
+        while (digit(pos)) ++pos;
+    }
+    if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+        ++pos;
+        if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+            ++pos;
+        }
+        if (!digit(pos)) {
+            return false;
+        }
+        while (digit(pos)) ++pos;
+    }
+    return true;
+}
+
+static bool skip_literal(std::string_view text, size_t& pos, std::string_view literal) {
+    if (text.compare(pos, literal.size(), literal) != 0) {
+        return false;
+    }
+    pos += literal.size();
+    return true;
+}
+
+bool json_skip_value(std::string_view text, size_t& pos, int depth) {
+    if (pos >= text.size() || depth > max_depth) {
+        return false;
+    }
+    std::string_view contents;
+    bool escaped;
+    switch (text[pos]) {
+        case '"':
+            return json_scan_string(text, pos, contents, escaped);
+        case 't':
+            return skip_literal(text, pos, "true");
+        case 'f':
+            return skip_literal(text, pos, "false");
+        case 'n':
+            return skip_literal(text, pos, "null");
+        case '[': {
+            pos = json_skip_space(text, pos + 1);
+            if (pos < text.size() && text[pos] == ']') {
+                ++pos;
+                return true;
+            }
+            while (true) {
+                if (!json_skip_value(text, pos, depth + 1)) {
+                    return false;
+                }
+                pos = json_skip_space(text, pos);
+                if (pos >= text.size()) {
+                    return false;
+                }
+                if (text[pos] == ']') {
+                    ++pos;
+                    return true;
+                }
+                if (text[pos] != ',') {
+                    return false;
+                }
+                pos = json_skip_space(text, pos + 1);
+            }
+        }
+        case '{': {
+            pos = json_skip_space(text, pos + 1);
+            if (pos < text.size() && text[pos] == '}') {
+                ++pos;
+                return true;
+            }
+            while (true) {
+                if (pos >= text.size() || text[pos] != '"' || !json_scan_string(text, pos, contents, escaped)) {
+                    return false;
+                }
+                pos = json_skip_space(text, pos);
+                if (pos >= text.size() || text[pos] != ':') {
+                    return false;
+                }
+                pos = json_skip_space(text, pos + 1);
+                if (!json_skip_value(text, pos, depth + 1)) {
+                    return false;
+                }
+                pos = json_skip_space(text, pos);
+                if (pos >= text.size()) {
+                    return false;
+                }
+                if (text[pos] == '}') {
+                    ++pos;
+                    return true;
+                }
+                if (text[pos] != ',') {
+                    return false;
+                }
+                pos = json_skip_space(text, pos + 1);
+            }
+        }
+        default:
+            return skip_number(text, pos);
+    }
+}
+
+static void append_utf8(unsigned code, std::string& out) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+bool json_unescape(std::string_view contents, std::string& out) {
+    out.clear();
+    out.reserve(contents.size());
+    for (size_t i = 0; i < contents.size(); ++i) {
+        char c = contents[i];
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        char e = contents[++i];
+        switch (e) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned code;
+                if (!read_hex4(contents, i + 1, code)) {
+                    return false;
+                }
+                i += 4;
+                if (code >= 0xD800 && code < 0xDC00) {
+                    unsigned low;
+                    if (i + 2 >= contents.size() || contents[i + 1] != '\\' || contents[i + 2] != 'u' ||
+                        !read_hex4(contents, i + 3, low) || low < 0xDC00 || low >= 0xE000) {
+                        return false;
+                    }
+                    i += 6;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(code, out);
+                break;
+            }
+            default: out += e; break;
+        }
+    }
+    return true;
+}
+
+bool parse_shorten_request(std::string_view body, ShortenRequest& request) {
+    bool found = false;
+    bool valid = true;
+    std::string key;
+    auto read_string = [&valid](const JsonField& field, std::string_view& out, std::string& unescaped) {
+        if (!field.is_string) {
+            valid = false;
+        } else if (field.escaped) {
+            valid = valid && json_unescape(field.value, unescaped);
+            out = unescaped;
+        } else {
+            out = field.value;
+        }
+    };
+    bool parsed = scan_json_object(body, [&](const JsonField& field) {
+        std::string_view name = field.key;
+        if (field.key_escaped) {
+            valid = valid && json_unescape(field.key, key);
+            name = key;
+        }
+        if (!found && name == "url") {
+            found = true;
+            read_string(field, request.url, request.unescaped_url);
+        } else if (!request.has_alias && name == "alias") {
+            request.has_alias = true;
+            read_string(field, request.alias, request.unescaped_alias);
+        }
+    });
+    return parsed && found && valid;
+}
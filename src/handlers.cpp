@@ -1,107 +1,440 @@
 #include "crow_all.h"
+#include "handlers.hpp"
 #include "database.hpp"
+#include "access_log.hpp"
+#include "aliases.hpp"
 #include "logger.hpp"
 #include "utils.hpp"
 #include "config.hpp"
+#include "health.hpp"
+#include "admission.hpp"
+#include "deadline.hpp"
+#include "shutdown.hpp"
+#include "fast_json.hpp"
+#include "url_canon.hpp"
+#include "code_checksum.hpp"
+#include "code_pool.hpp"
+#include "code_sequence.hpp"
+#include "compressed_store.hpp"
+#include "request_arena.hpp"
+#include <algorithm>
+#include <cctype>
 #include <string>
+#include <vector>
 
-void setup_routes(crow::SimpleApp& app, int short_code_length) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, 61);
-    const std::string chars = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+std::string_view client_ip(const crow::request& req) {
+    const std::string& forwarded = req.get_header_value("X-Forwarded-For");
+    if (!forwarded.empty()) return forwarded;
+    const std::string& real_ip = req.get_header_value("X-Real-IP");
+    if (!real_ip.empty()) return real_ip;
+    return "unknown";
+}
 
-    auto generate_short_lambda = [&]() -> std::string {
-        std::string short_code;
-        for (int i = 0; i < short_code_length; ++i) {
-            short_code += chars[dis(gen)];
-        }
-        while (!get_url(short_code).empty()) {
-            short_code = "";
-            for (int i = 0; i < short_code_length; ++i) {
-                short_code += chars[dis(gen)];
+void DrainMiddleware::before_handle(crow::request&, crow::response&, context&) {
+    request_started();
+}
+
+void DrainMiddleware::after_handle(crow::request&, crow::response&, context&) {
+    request_finished();
+}
+
+void ArenaMiddleware::before_handle(crow::request&, crow::response&, context&) {
+    begin_request_arena();
+}
+
+void ArenaMiddleware::after_handle(crow::request&, crow::response&, context&) {
+    end_request_arena();
+}
+
+void DeadlineMiddleware::before_handle(crow::request& req, crow::response&, context&) {
+    int timeout = timeout_ms;
+    std::string header = req.get_header_value("X-Request-Timeout");
+    if (!header.empty()) {
+        try {
+            int requested = std::stoi(header);
+            if (requested > 0 && (timeout == 0 || requested < timeout)) {
+                timeout = requested;
             }
+        } catch (...) {
+        }
+    }
+    set_request_deadline(timeout > 0 ? steady_time_us() + static_cast<uint64_t>(timeout) * 1000 : 0);
+}
+
+void DeadlineMiddleware::after_handle(crow::request&, crow::response&, context&) {
+    set_request_deadline(0);
+}
+
+static void log_request(const crow::request& req, AccessEvent event, int status, std::string_view short_code) {
+    if (!access_log_sampled(event)) {
+        return;
+    }
+    access_log(event, status, short_code, client_ip(req), req.get_header_value("User-Agent"));
+}
+
+static crow::response deadline_response(const crow::request& req, std::string_view short_code) {
+    log_request(req, AccessEvent::DeadlineExceeded, 504, short_code);
+    return crow::response(504, "Request deadline exceeded");
+}
+
+static crow::response shed_response(const crow::request& req, std::string_view short_code) {
+    if (deadline_expired()) {
+        return deadline_response(req, short_code);
+    }
+    log_request(req, AccessEvent::Shed, 503, short_code);
+    crow::response res(503, "Service Unavailable");
+    res.set_header("Retry-After", "1");
+    return res;
+}
+
+static crow::response json_response(int code, const std::pmr::string& body) {
+    crow::response res(code);
+    res.body.assign(body.data(), body.size());
+    res.set_header("Content-Type", "application/json");
+    return res;
+}
+
+// Codes /shorten tries before giving up on storing a link.
+static const int shorten_attempts = 8;
+
+static crow::response short_url_response(const ShortCode& short_code) {
+    JsonWriter<256> writer;
+    std::string_view body = writer.field("short_url", "http://localhost:8080/", short_code.view()).finish();
+    crow::response res(200);
+    res.body.assign(body.data(), body.size());
+    res.set_header("Content-Type", "application/json");
+    return res;
+}
+
+// Shortens url under the alias the client chose. The link is stored only if neither the alias
+// nor the URL is taken, in one insert that only one request, from any process, can win.
+static crow::response shorten_with_alias(const crow::request& req, std::string_view name, const std::string& url) {
+    if (!alias_valid(name)) {
+        log_request(req, AccessEvent::ShortenInvalid, 400, "");
+        return crow::response(400, "Invalid alias");
+    }
+    ShortCode alias(name);
+    StorageAdmission admission(AdmissionClass::Write);
+    if (!admission.admitted()) {
+        return shed_response(req, name);
+    }
+    if (!insert_new_url(alias, url)) {
+        if (deadline_interrupted()) {
+            return deadline_response(req, name);
+        }
+        // One URL has one code; the client is told which one it already has.
+        ShortCode existing_code = get_short_code(url);
+        if (existing_code == alias) {
+            log_request(req, AccessEvent::ShortenExisting, 200, name);
+            return short_url_response(alias);
         }
-        return short_code;
-    };
+        log_request(req, AccessEvent::AliasTaken, 409, name);
+        if (existing_code.empty()) {
+            return crow::response(409, "Alias is taken");
+        }
+        crow::response res = short_url_response(existing_code);
+        res.code = 409;
+        return res;
+    }
+    // The link is stored; recording it as an alias finishes even past the deadline.
+    uint64_t deadline = request_deadline();
+    set_request_deadline(0);
+    if (!record_alias(alias)) {
+        log("Failed to record alias " + alias.str(), "WARN");
+    }
+    set_request_deadline(deadline);
+    log_request(req, AccessEvent::Shortened, 200, name);
+    return short_url_response(alias);
+}
+
+void setup_routes(App& app, int short_code_length) {
+    CROW_ROUTE(app, "/alias/available")
+        ([](const crow::request& req) {
+            const char* name = req.url_params.get("name");
+            if (name == nullptr || *name == '\0') {
+                log_request(req, AccessEvent::BadRequest, 400, "");
+                return crow::response(400, "Missing 'name' parameter");
+            }
+            bool valid = alias_valid(name);
+            auto body = request_string();
+            JsonBuilder json(body);
+            json.begin_object().key("name").value(name).key("valid").value(valid);
+            json.key("available").value(valid && !alias_known(ShortCode(name))).end_object();
+            return json_response(200, body);
+        });
 
     CROW_ROUTE(app, "/shorten")
         .methods("POST"_method)
-        ([&](const crow::request& req) {
-            std::string ip = req.get_header_value("X-Forwarded-For");
-            if (ip.empty()) ip = req.get_header_value("X-Real-IP");
-            if (ip.empty()) ip = "unknown";
-            std::string ua = req.get_header_value("User-Agent");
-            log("Received shorten request", "INFO", ip, ua);
-            auto body = crow::json::load(req.body);
-            if (!body || !body.has("url")) {
-                log("Invalid request: missing or invalid JSON", "WARN", ip, ua);
+        ([short_code_length](const crow::request& req) {
+            ShortenRequest request;
+            if (!parse_shorten_request(req.body, request)) {
+                log_request(req, AccessEvent::ShortenInvalid, 400, "");
                 return crow::response(400, "Invalid JSON or missing 'url' field");
             }
-            std::string url = body["url"].s();
-            if (url.empty() || url.find("http") != 0) {
-                log("Invalid URL: " + url, "WARN", ip, ua);
+            std::string url;
+            if (!canonicalize_url(request.url, url)) {
+                log_request(req, AccessEvent::ShortenInvalid, 400, "");
                 return crow::response(400, "Invalid URL");
             }
-            std::string existing_code = get_short_code(url);
+            if (request.has_alias) {
+                return shorten_with_alias(req, request.alias, url);
+            }
+            StorageAdmission admission(AdmissionClass::Write);
+            if (!admission.admitted()) {
+                return shed_response(req, "");
+            }
+            ShortCode existing_code = get_short_code(url);
+            if (deadline_interrupted()) {
+                return deadline_response(req, "");
+            }
             if (!existing_code.empty()) {
-                log("URL already shortened: " + url + " -> " + existing_code, "INFO", ip, ua);
-                crow::json::wvalue response;
-                response["short_url"] = "http://localhost:8080/" + existing_code;
-                return crow::response(response);
-            }
-            std::string short_code = generate_short_lambda();
-            insert_url(short_code, url);
-            log("Shortened URL: " + url + " to " + short_code, "INFO", ip, ua);
-            crow::json::wvalue response;
-            response["short_url"] = "http://localhost:8080/" + short_code;
-            return crow::response(response);
+                log_request(req, AccessEvent::ShortenExisting, 200, existing_code.view());
+                return short_url_response(existing_code);
+            }
+            // Reservations only keep other pools off a code, and a generated code may be taken
+            // meanwhile, so the insert fails rather than replaces a taken code or URL.
+            ShortCode short_code;
+            for (int attempt = 0;; ++attempt) {
+                short_code = next_short_code(short_code_length);
+                if (insert_new_url(short_code, url)) {
+                    break;
+                }
+                if (deadline_interrupted()) {
+                    return deadline_response(req, "");
+                }
+                existing_code = get_short_code(url);
+                if (!existing_code.empty()) {
+                    log_request(req, AccessEvent::ShortenExisting, 200, existing_code.view());
+                    return short_url_response(existing_code);
+                }
+                if (attempt + 1 == shorten_attempts) {
+                    log("Failed to store a new short code after " + std::to_string(shorten_attempts) + " attempts", "WARN");
+                    return shed_response(req, "");
+                }
+            }
+            if (deadline_interrupted()) {
+                return deadline_response(req, short_code.view());
+            }
+            log_request(req, AccessEvent::Shortened, 200, short_code.view());
+            return short_url_response(short_code);
         });
 
     CROW_ROUTE(app, "/<string>")
         .methods("GET"_method)
-        ([&](const crow::request& req, std::string short_code) {
-            std::string ip = req.get_header_value("X-Forwarded-For");
-            if (ip.empty()) ip = req.get_header_value("X-Real-IP");
-            if (ip.empty()) ip = "unknown";
-            std::string ua = req.get_header_value("User-Agent");
-            if (short_code.empty()) {
-                log("Invalid short code request", "WARN", ip, ua);
+        ([](const crow::request& req, std::string text) {
+            if (text.empty()) {
+                log_request(req, AccessEvent::BadRequest, 400, "");
                 return crow::response(400, "Invalid short code");
             }
-            log("Redirect request for: " + short_code, "INFO", ip, ua);
-            std::string url = get_url(short_code);
+            // Text that is not a valid code, or fails the code checksum without being of an alias
+            // length, cannot be stored, so it never reaches the cache or storage.
+            ShortCode short_code;
+            std::string url;
+            if (ShortCode::parse(text, short_code) && (code_may_exist(short_code) || alias_valid(short_code.view())) &&
+                !get_cached_url(short_code, url)) {
+                StorageAdmission admission(AdmissionClass::Read);
+                if (!admission.admitted()) {
+                    return shed_response(req, text);
+                }
+                url = get_url(short_code);
+                if (deadline_interrupted()) {
+                    return deadline_response(req, text);
+                }
+            }
             if (!url.empty()) {
-                log("Redirecting to: " + url, "INFO", ip, ua);
+                log_request(req, AccessEvent::Redirect, 302, text);
                 crow::response res(302);
-                res.add_header("Location", url);
+                res.add_header("Location", std::move(url));
                 return res;
             } else {
-                log("Short URL not found: " + short_code, "WARN", ip, ua);
+                log_request(req, AccessEvent::RedirectNotFound, 404, text);
                 return crow::response(404, "Short URL not found");
             }
         });
 
     CROW_ROUTE(app, "/delete/<string>")
         .methods("DELETE"_method)
-        ([&](const crow::request& req, std::string short_code) {
-            std::string ip = req.get_header_value("X-Forwarded-For");
-            if (ip.empty()) ip = req.get_header_value("X-Real-IP");
-            if (ip.empty()) ip = "unknown";
-            std::string ua = req.get_header_value("User-Agent");
-            if (short_code.empty()) {
-                log("Invalid delete request", "WARN", ip, ua);
+        ([](const crow::request& req, std::string text) {
+            if (text.empty()) {
+                log_request(req, AccessEvent::BadRequest, 400, "");
                 return crow::response(400, "Invalid short code");
             }
-            log("Delete request for: " + short_code, "INFO", ip, ua);
+            ShortCode short_code;
+            if (!ShortCode::parse(text, short_code) || !(code_may_exist(short_code) || alias_valid(short_code.view()))) {
+                log_request(req, AccessEvent::DeleteNotFound, 404, text);
+                return crow::response(404, "Short URL not found");
+            }
+            StorageAdmission admission(AdmissionClass::Write);
+            if (!admission.admitted()) {
+                return shed_response(req, text);
+            }
             std::string url = get_url(short_code);
+            if (deadline_interrupted()) {
+                return deadline_response(req, text);
+            }
             if (!url.empty()) {
+                // Released first: an alias whose link survives an interrupted delete still
+                // cannot be claimed again, as the link holds its code.
+                release_alias(short_code);
                 delete_url(short_code);
-                log("Deleted URL: " + short_code, "INFO", ip, ua);
+                if (deadline_interrupted()) {
+                    return deadline_response(req, text);
+                }
+                log_request(req, AccessEvent::Deleted, 200, text);
                 return crow::response(200, "Deleted");
             } else {
-                log("Short URL not found: " + short_code, "WARN", ip, ua);
+                log_request(req, AccessEvent::DeleteNotFound, 404, text);
                 return crow::response(404, "Short URL not found");
             }
         });
-}
\ No newline at end of file
+}
+
+static crow::response logging_settings() {
+    auto body = request_string();
+    JsonBuilder json(body);
+    json.begin_object().key("level").value(log_level_name(min_log_level()));
+    json.key("sample_rates").begin_object();
+    for (int i = 1; i < access_event_count; ++i) {
+        auto event = static_cast<AccessEvent>(i);
+        json.key(access_event_name(event)).value(access_sample_rate(event));
+    }
+    json.end_object().end_object();
+    return json_response(200, body);
+}
+
+void setup_admin_routes(App& app, const std::string& admin_token) {
+    CROW_ROUTE(app, "/admin/logging")
+        .methods("GET"_method, "PUT"_method)
+        ([admin_token](const crow::request& req) {
+            if (admin_token.empty() || req.get_header_value("X-Admin-Token") != admin_token) {
+                return crow::response(403, "Forbidden");
+            }
+            if (req.method == "PUT"_method) {
+                auto body = crow::json::load(req.body);
+                if (!body || body.t() != crow::json::type::Object) {
+                    return crow::response(400, "Invalid JSON");
+                }
+                // The whole body is checked first, so a rejected request changes nothing.
+                LogLevel level = min_log_level();
+                if (body.has("level") &&
+                    (body["level"].t() != crow::json::type::String || !parse_log_level(body["level"].s(), level))) {
+                    return crow::response(400, "Unknown log level");
+                }
+                std::vector<std::pair<AccessEvent, double>> rates;
+                if (body.has("sample_rates")) {
+                    if (body["sample_rates"].t() != crow::json::type::Object) {
+                        return crow::response(400, "'sample_rates' must be an object");
+                    }
+                    for (const auto& rate : body["sample_rates"]) {
+                        AccessEvent event = parse_access_event(rate.key());
+                        if (event == AccessEvent::None) {
+                            return crow::response(400, "Unknown event: " + std::string(rate.key()));
+                        }
+                        if (rate.t() != crow::json::type::Number || rate.d() < 0.0 || rate.d() > 1.0) {
+                            return crow::response(400, "Sample rate must be a number from 0 to 1: " + std::string(rate.key()));
+                        }
+                        rates.emplace_back(event, rate.d());
+                    }
+                }
+                if (body.has("level")) {
+                    set_min_log_level(level);
+                }
+                for (const auto& rate : rates) {
+                    set_access_sample_rate(rate.first, rate.second);
+                }
+                auto message = request_string();
+                message += "Logging settings changed: level=";
+                message += log_level_name(min_log_level());
+                log(message, "WARN");
+            }
+            return logging_settings();
+        });
+
+    CROW_ROUTE(app, "/admin/storage")
+        ([admin_token](const crow::request& req) {
+            if (admin_token.empty() || req.get_header_value("X-Admin-Token") != admin_token) {
+                return crow::response(403, "Forbidden");
+            }
+            UrlCompressionStats stats = url_compression_stats();
+            RequestArenaStats arena = request_arena_stats();
+            CodePoolStats pool = code_pool_stats();
+            CodeSequenceStats sequence = code_sequence_stats();
+            auto body = request_string();
+            JsonBuilder json(body);
+            json.begin_object();
+            json.key("dictionary_tokens").value(stats.tokens);
+            json.key("raw_bytes").value(stats.raw_bytes);
+            json.key("stored_bytes").value(stats.stored_bytes);
+            json.key("bytes_saved").value(stats.raw_bytes - stats.stored_bytes);
+            json.key("decodes").value(stats.decodes);
+            json.key("decode_ns_avg").value(stats.decodes > 0 ? static_cast<double>(stats.decode_ns) / stats.decodes : 0.0);
+            json.key("request_arena_size").value(request_arena_size());
+            json.key("request_arena_requests").value(arena.requests);
+            json.key("request_arena_overflows").value(arena.overflows);
+            json.key("request_arena_overflow_bytes").value(arena.overflow_bytes);
+            json.key("code_pool_available").value(pool.available);
+            json.key("code_pool_taken").value(pool.taken);
+            json.key("code_pool_misses").value(pool.misses);
+            json.key("code_pool_recovered").value(pool.recovered);
+            json.key("code_sequence_leases").value(sequence.leases);
+            json.key("code_sequence_issued").value(sequence.issued);
+            json.key("code_sequence_behind").value(sequence.behind);
+            json.end_object();
+            return json_response(200, body);
+        });
+
+    CROW_ROUTE(app, "/admin/domains")
+        ([admin_token](const crow::request& req) {
+            if (admin_token.empty() || req.get_header_value("X-Admin-Token") != admin_token) {
+                return crow::response(403, "Forbidden");
+            }
+            const char* host_param = req.url_params.get("host");
+            if (host_param == nullptr || *host_param == '\0' || current_store() == nullptr) {
+                return crow::response(400, "Missing 'host' parameter");
+            }
+            std::string host = host_param;
+            std::transform(host.begin(), host.end(), host.begin(), [](unsigned char c) { return std::tolower(c); });
+            const char* limit_param = req.url_params.get("limit");
+            size_t limit = limit_param ? std::strtoul(limit_param, nullptr, 10) : 100;
+            size_t links = 0;
+            std::pmr::vector<ShortCode> short_codes(request_memory());
+            current_store()->for_each_on_host(host, [&](const ShortCode& short_code, const std::string&) {
+                if (short_codes.size() < limit) {
+                    short_codes.push_back(short_code);
+                }
+                ++links;
+            });
+            auto body = request_string();
+            JsonBuilder json(body);
+            json.begin_object().key("host").value(host).key("links").value(links).key("short_codes").begin_array();
+            for (const auto& short_code : short_codes) {
+                json.value(short_code.view());
+            }
+            json.end_array().end_object();
+            return json_response(200, body);
+        });
+}
+
+void setup_health_routes(App& app) {
+    CROW_ROUTE(app, "/healthz")
+        ([]() {
+            return crow::response(200, "ok");
+        });
+
+    CROW_ROUTE(app, "/readyz")
+        ([]() {
+            HealthStatus status = health_status();
+            auto body = request_string();
+            JsonBuilder json(body);
+            json.begin_object();
+            json.key("ready").value(status.ready);
+            json.key("storage").value(status.storage);
+            json.key("warmed_up").value(status.warmed_up);
+            json.key("log_queue_fill").value(status.log_queue_fill);
+            json.key("log_dropped").value(status.log_dropped);
+            json.key("shed_level").value(admission_shed_level());
+            json.key("draining").value(status.draining);
+            json.end_object();
+            return json_response(status.ready ? 200 : 503, body);
+        });
+}
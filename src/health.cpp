@@ -0,0 +1,80 @@
+#include "health.hpp"
+#include "clock.hpp"
+#include "database.hpp"
+#include "logger.hpp"
+#include "shutdown.hpp"
+#include "warmup.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static std::atomic<bool> storage_ok{false};
+static std::atomic<uint64_t> probe_started_us{0};
+static std::atomic<uint64_t> probe_timeout_us{0};
+static std::atomic<double> max_queue_fill{1.0};
+
+static std::mutex probe_mutex;
+static std::condition_variable probe_cv;
+static bool probe_running = false;
+static std::thread probe_thread;
+
+static void run_probe() {
+    UrlStore* store = current_store();
+    probe_started_us = current_time_us();
+    bool ok = store && store->healthy();
+    bool in_time = current_time_us() - probe_started_us.load() <= probe_timeout_us.load();
+    probe_started_us = 0;
+    bool healthy = ok && in_time;
+    static bool probed = false;
+    if (probed && healthy != storage_ok.load()) {
+        log(healthy ? "Storage probe recovered" : "Storage probe failed", healthy ? "INFO" : "WARN");
+    }
+    probed = true;
+    storage_ok = healthy;
+}
+
+void start_health_probe(int interval_ms, int timeout_ms, double max_log_queue_fill) {
+    stop_health_probe();
+    probe_timeout_us = static_cast<uint64_t>(timeout_ms) * 1000;
+    max_queue_fill = max_log_queue_fill;
+    probe_running = true;
+    probe_thread = std::thread([interval_ms] {
+        std::unique_lock<std::mutex> lock(probe_mutex);
+        while (probe_running) {
+            lock.unlock();
+            run_probe();
+            lock.lock();
+            probe_cv.wait_for(lock, std::chrono::milliseconds(interval_ms), [] { return !probe_running; });
+        }
+    });
+}
+
+void stop_health_probe() {
+    if (!probe_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(probe_mutex);
+        probe_running = false;
+    }
+    probe_cv.notify_all();
+    probe_thread.join();
+    storage_ok = false;
+}
+
+HealthStatus health_status() {
+    HealthStatus status;
+    uint64_t started = probe_started_us.load();
+    bool probe_stuck = started != 0 && current_time_us() - started > probe_timeout_us.load();
+    status.storage = storage_ok.load() && !probe_stuck;
+    status.warmed_up = warmup_complete();
+    size_t capacity = log_queue_capacity();
+    status.log_queue_fill = capacity ? static_cast<double>(log_queue_depth()) / capacity : 0;
+    status.log_dropped = log_entries_dropped();
+    status.draining = shutdown_draining();
+    status.ready = status.storage && status.warmed_up && status.log_queue_fill < max_queue_fill.load() &&
+                   !status.draining;
+    return status;
+}
@@ -0,0 +1,206 @@
+#include "hot_restart.hpp"
+#include "logger.hpp"
+#include "shutdown.hpp"
+#include <atomic>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+static const char handoff_message = 'F';
+static const char ready_message = 'R';
+
+static std::atomic<bool> listener_running{false};
+static std::thread listener_thread;
+static int listener_socket = -1;
+static int handoff_connection = -1;
+static bool handed_over = false;
+static std::string listener_path;
+
+static bool unix_address(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+static bool send_fd(int connection, int fd) {
+    char byte = handoff_message;
+    iovec iov{&byte, 1};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    return sendmsg(connection, &message, MSG_NOSIGNAL) == 1;
+}
+
+static int receive_fd(int connection) {
+    char byte = 0;
+    iovec iov{&byte, 1};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(connection, &message, MSG_CMSG_CLOEXEC) != 1 || byte != handoff_message) {
+        return -1;
+    }
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    int fd;
+    std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+    return fd;
+}
+
+HotRestartHandoff request_listen_socket(const std::string& path) {
+    HotRestartHandoff handoff;
+    sockaddr_un address;
+    if (!unix_address(path, address)) {
+        return handoff;
+    }
+    int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection < 0) {
+        return handoff;
+    }
+    if (connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(connection);
+        return handoff;
+    }
+    int fd = receive_fd(connection);
+    if (fd < 0) {
+        log("Failed to receive listening socket from " + path, "WARN");
+        close(connection);
+        return handoff;
+    }
+    handoff.connection = connection;
+    handoff.listen_fd = fd;
+    return handoff;
+}
+
+bool finish_handoff(HotRestartHandoff& handoff, int timeout_ms) {
+    if (handoff.connection < 0) {
+        return false;
+    }
+    bool finished = false;
+    if (send(handoff.connection, &ready_message, 1, MSG_NOSIGNAL) == 1) {
+        pollfd waiting{handoff.connection, POLLIN, 0};
+        char byte;
+        // Nothing more is sent on this connection; it becomes readable when the old instance exits.
+        finished = poll(&waiting, 1, timeout_ms) == 1 && recv(handoff.connection, &byte, 1, 0) <= 0;
+    }
+    close(handoff.connection);
+    handoff.connection = -1;
+    return finished;
+}
+
+void abort_handoff(HotRestartHandoff& handoff) {
+    if (handoff.connection >= 0) {
+        close(handoff.connection);
+        handoff.connection = -1;
+    }
+}
+
+static void serve_handoff(int connection, uint16_t port, const std::function<void()>& before_handoff,
+                          const std::function<void()>& on_ready) {
+    before_handoff();
+    int fd = listening_socket(port);
+    if (fd < 0 || !send_fd(connection, fd)) {
+        log("Failed to hand over listening socket", "WARN");
+        close(connection);
+        return;
+    }
+    // The new instance warms up before answering; until then both instances serve.
+    char byte = 0;
+    while (listener_running.load()) {
+        pollfd waiting{connection, POLLIN, 0};
+        if (poll(&waiting, 1, 100) == 1) {
+            if (recv(connection, &byte, 1, 0) != 1) {
+                break;
+            }
+            if (byte == ready_message) {
+                log("New instance is ready, draining", "WARN");
+                handed_over = true;
+                handoff_connection = connection;
+                listener_running = false;
+                on_ready();
+                return;
+            }
+        }
+    }
+    log("Hot restart aborted by the new instance", "WARN");
+    close(connection);
+}
+
+bool start_handoff_listener(const std::string& path, uint16_t port, std::function<void()> before_handoff,
+                            std::function<void()> on_ready) {
+    stop_handoff_listener();
+    sockaddr_un address;
+    if (!unix_address(path, address)) {
+        log("Invalid hot restart socket path: " + path, "WARN");
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    // Anything still at the path belongs to an instance that is gone or has handed over to us.
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 1) != 0) {
+        log("Failed to listen on hot restart socket: " + path, "WARN");
+        close(fd);
+        return false;
+    }
+    listener_socket = fd;
+    listener_path = path;
+    handed_over = false;
+    listener_running = true;
+    listener_thread = std::thread([port, before_handoff, on_ready] {
+        while (listener_running.load()) {
+            pollfd waiting{listener_socket, POLLIN, 0};
+            if (poll(&waiting, 1, 100) != 1) {
+                continue;
+            }
+            int connection = accept4(listener_socket, nullptr, nullptr, SOCK_CLOEXEC);
+            if (connection >= 0) {
+                serve_handoff(connection, port, before_handoff, on_ready);
+            }
+        }
+    });
+    return true;
+}
+
+void stop_handoff_listener() {
+    listener_running = false;
+    if (listener_thread.joinable()) {
+        listener_thread.join();
+    }
+    if (listener_socket >= 0) {
+        close(listener_socket);
+        listener_socket = -1;
+        if (!handed_over) {
+            unlink(listener_path.c_str());
+        }
+    }
+}
+
+void close_handoff_connection() {
+    if (handoff_connection >= 0) {
+        close(handoff_connection);
+        handoff_connection = -1;
+    }
+}
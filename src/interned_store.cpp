@@ -0,0 +1,335 @@
+#include "interned_store.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+
+// Interned values are marker, the prefix id as three characters from '0' to 'o', and the rest
+// of the URL. A canonical URL never starts with marker, so rows stored whole read back as is.
+static const char marker = 0x03;
+static const size_t id_length = 3;
+static const uint32_t id_limit = 1 << 18;
+// Longer first path segments are unlikely to repeat; such URLs intern only their origin.
+static const size_t max_segment_length = 32;
+
+static void append_id(uint32_t id, std::string& out) {
+    out += marker;
+    for (int shift = 12; shift >= 0; shift -= 6) {
+        out += static_cast<char>('0' + ((id >> shift) & 63));
+    }
+}
+
+static bool read_id(const std::string& value, uint32_t& id) {
+    if (value.size() < 1 + id_length || value[0] != marker) {
+        return false;
+    }
+    id = 0;
+    for (size_t i = 1; i <= id_length; ++i) {
+        int digit = value[i] - '0';
+        if (digit < 0 || digit > 63) {
+            return false;
+        }
+        id = id << 6 | static_cast<uint32_t>(digit);
+    }
+    return true;
+}
+
+// Length of the part of url to intern: scheme, host and '/', plus the first path segment and
+// its '/' if with_segment. 0 if url has no such part.
+static size_t prefix_length(const std::string& url, bool with_segment) {
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos || scheme_end > 5) {
+        return 0;
+    }
+    size_t host_end = url.find_first_of("/?#", scheme_end + 3);
+    if (host_end == std::string::npos || url[host_end] != '/') {
+        return 0;
+    }
+    size_t length = host_end + 1;
+    if (!with_segment) {
+        return length;
+    }
+    size_t segment_end = url.find_first_of("/?#", length);
+    if (segment_end != std::string::npos && url[segment_end] == '/' && segment_end - length <= max_segment_length) {
+        return segment_end + 1;
+    }
+    return length;
+}
+
+static uint32_t select_prefix_id(sqlite3* handle, const std::string& prefix) {
+    sqlite3_stmt* stmt;
+    uint32_t id = 0;
+    if (sqlite3_prepare_v2(handle, "SELECT id FROM url_prefixes WHERE prefix = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, prefix.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            id = static_cast<uint32_t>(sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+    return id;
+}
+
+InternedStore::InternedStore(std::unique_ptr<UrlStore> backend, sqlite3* handle, size_t max_prefixes)
+    : backend_(std::move(backend)), handle_(handle), max_prefixes_(std::min<size_t>(max_prefixes, id_limit - 1)) {}
+
+bool InternedStore::open() {
+    const char* sql = "CREATE TABLE IF NOT EXISTS url_prefixes (id INTEGER PRIMARY KEY, prefix TEXT UNIQUE);";
+    char* err_msg = nullptr;
+    if (sqlite3_exec(handle_, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cout << "Failed to create url_prefixes: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        return false;
+    }
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, "SELECT id, prefix FROM url_prefixes;", -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        auto id = static_cast<uint32_t>(sqlite3_column_int64(stmt, 0));
+        std::string prefix = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        if (id < id_limit) {
+            ids_[prefix] = id;
+            prefixes_[id] = prefix;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+uint32_t InternedStore::prefix_id(const std::string& prefix, bool create) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(prefix);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+    }
+    // SQLite work happens outside mutex_, so lookups of known prefixes never wait on the
+    // database. create_mutex_ keeps this process from adding prefixes past max_prefixes_.
+    std::unique_lock<std::mutex> create_lock(create_mutex_, std::defer_lock);
+    bool room = false;
+    if (create) {
+        create_lock.lock();
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(prefix);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+        room = ids_.size() < max_prefixes_;
+    }
+    // Another process sharing the database may have added it.
+    uint32_t id = select_prefix_id(handle_, prefix);
+    if (id == 0 && room) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(handle_, "INSERT OR IGNORE INTO url_prefixes (prefix) VALUES (?);", -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, prefix.c_str(), -1, SQLITE_STATIC);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                std::cout << "Failed to insert URL prefix" << std::endl;
+            }
+            sqlite3_finalize(stmt);
+        }
+        id = select_prefix_id(handle_, prefix);
+    }
+    if (id == 0 || id >= id_limit) {
+        return 0;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    ids_.emplace(prefix, id);
+    prefixes_.emplace(id, prefix);
+    return id;
+}
+
+bool InternedStore::prefix_for_id(uint32_t id, std::string& prefix) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = prefixes_.find(id);
+        if (it != prefixes_.end()) {
+            prefix = it->second;
+            return true;
+        }
+    }
+    sqlite3_stmt* stmt;
+    bool found = false;
+    if (sqlite3_prepare_v2(handle_, "SELECT prefix FROM url_prefixes WHERE id = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            prefix = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            found = true;
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (found) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        ids_.emplace(prefix, id);
+        prefixes_.emplace(id, prefix);
+    }
+    return found;
+}
+
+std::string InternedStore::encode(const std::string& url, bool create) {
+    for (bool with_segment : {true, false}) {
+        size_t length = prefix_length(url, with_segment);
+        if (length == 0) {
+            break;
+        }
+        uint32_t id = prefix_id(url.substr(0, length), create);
+        if (id != 0) {
+            std::string value;
+            value.reserve(1 + id_length + url.size() - length);
+            append_id(id, value);
+            value.append(url, length, std::string::npos);
+            return value;
+        }
+    }
+    return url;
+}
+
+std::string InternedStore::decode(const std::string& value) {
+    uint32_t id;
+    if (!read_id(value, id)) {
+        return value;
+    }
+    std::string url;
+    if (!prefix_for_id(id, url)) {
+        log("Unknown URL prefix id: " + std::to_string(id), "ERROR");
+        return "";
+    }
+    url.append(value, 1 + id_length, std::string::npos);
+    return url;
+}
+
+void InternedStore::insert(const ShortCode& short_code, const std::string& url) {
+    backend_->insert(short_code, encode(url, true));
+}
+
+bool InternedStore::insert_new(const ShortCode& short_code, const std::string& url) {
+    if (!get_by_url(url).empty()) {
+        return false;
+    }
+    return backend_->insert_new(short_code, encode(url, true));
+}
+
+std::string InternedStore::get(const ShortCode& short_code) {
+    return decode(backend_->get(short_code));
+}
+
+ShortCode InternedStore::get_by_url(const std::string& url) {
+    std::string value = encode(url, false);
+    ShortCode short_code = backend_->get_by_url(value);
+    // Rows written whole: before interning was on, by another process, or with the table full.
+    if (short_code.empty() && value != url) {
+        short_code = backend_->get_by_url(url);
+    }
+    return short_code;
+}
+
+void InternedStore::remove(const ShortCode& short_code) {
+    backend_->remove(short_code);
+}
+
+void InternedStore::for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    backend_->for_each([this, &callback](const ShortCode& short_code, const std::string& value) {
+        callback(short_code, decode(value));
+    });
+}
+
+void InternedStore::insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) {
+    std::vector<std::pair<ShortCode, std::string>> encoded;
+    encoded.reserve(entries.size());
+    for (const auto& entry : entries) {
+        encoded.emplace_back(entry.first, encode(entry.second, true));
+    }
+    backend_->insert_batch(encoded);
+}
+
+std::vector<std::string> InternedStore::get_batch(const std::vector<ShortCode>& short_codes) {
+    auto values = backend_->get_batch(short_codes);
+    for (auto& value : values) {
+        value = decode(value);
+    }
+    return values;
+}
+
+void InternedStore::remove_batch(const std::vector<ShortCode>& short_codes) {
+    backend_->remove_batch(short_codes);
+}
+
+bool InternedStore::healthy() {
+    return backend_->healthy();
+}
+
+bool InternedStore::get_cached(const ShortCode& short_code, std::string& url) {
+    if (!backend_->get_cached(short_code, url)) {
+        return false;
+    }
+    url = decode(url);
+    return true;
+}
+
+void InternedStore::for_each_with_prefix(const std::string& prefix,
+                                         const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    if (!backend_->has_url_index()) {
+        // One pass over every row instead of one per overlapping prefix.
+        UrlStore::for_each_with_prefix(prefix, callback);
+        return;
+    }
+    // Rows stored whole, then one range per interned prefix that overlaps the requested one.
+    backend_->for_each_with_prefix(prefix, callback);
+    std::vector<std::string> ranges;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& entry : prefixes_) {
+            const std::string& interned = entry.second;
+            std::string range;
+            if (interned.compare(0, prefix.size(), prefix) == 0) {
+                append_id(entry.first, range);
+            } else if (prefix.compare(0, interned.size(), interned) == 0) {
+                append_id(entry.first, range);
+                range.append(prefix, interned.size(), std::string::npos);
+            } else {
+                continue;
+            }
+            ranges.push_back(range);
+        }
+    }
+    for (const auto& range : ranges) {
+        backend_->for_each_with_prefix(range, [this, &callback](const ShortCode& short_code, const std::string& value) {
+            callback(short_code, decode(value));
+        });
+    }
+}
+
+bool InternedStore::has_url_index() {
+    return backend_->has_url_index();
+}
+
+size_t InternedStore::intern_existing() {
+    return rewrite_values(*backend_, [](const std::string& value) {
+        uint32_t id;
+        return !read_id(value, id);
+    }, [this](const std::string& value) { return encode(value, true); });
+}
+
+size_t InternedStore::prefix_count() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return prefixes_.size();
+}
+
+UrlStore& InternedStore::backend() {
+    return *backend_;
+}
+
+std::unique_ptr<UrlStore> open_interned_store(std::unique_ptr<UrlStore> backend, sqlite3* handle, size_t max_prefixes) {
+    auto store = std::make_unique<InternedStore>(std::move(backend), handle, max_prefixes);
+    if (!store->open()) {
+        log("Failed to open URL prefix table", "ERROR");
+        return nullptr;
+    }
+    if (store->prefix_count() == 0) {
+        size_t rewritten = store->intern_existing();
+        log("Interned " + std::to_string(rewritten) + " stored URLs");
+    }
+    log("URL prefixes: " + std::to_string(store->prefix_count()));
+    return store;
+}
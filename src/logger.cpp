@@ -1,27 +1,221 @@
 #include "logger.hpp"
 #include "database.hpp"
+#include "clock.hpp"
+#include "deadline.hpp"
 #include <iostream>
-#include <chrono>
-#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-void log_to_db(const std::string& level, const std::string& message, const std::string& ip, const std::string& user_agent) {
-    const char* sql = "INSERT INTO logs (timestamp, level, message, ip, user_agent) VALUES (datetime('now'), ?, ?, ?, ?);";
+sqlite3* log_db = nullptr;
+
+struct LogEntry {
+    std::string timestamp;
+    std::string level;
+    std::string message;
+    std::string ip;
+    std::string user_agent;
+};
+
+static std::atomic<int> min_level{static_cast<int>(LogLevel::Info)};
+static std::mutex queue_mutex;
+static std::condition_variable queue_cv;
+static std::condition_variable drained_cv;
+static std::deque<LogEntry> queue;
+static size_t queue_capacity = 0;
+static size_t in_flight = 0;
+static std::atomic<uint64_t> dropped{0};
+static bool writer_running = false;
+static std::thread writer;
+
+static void write_entries(const std::vector<LogEntry>& entries) {
+    const char* sql = "INSERT INTO logs (timestamp, level, message, ip, user_agent) VALUES (?, ?, ?, ?, ?);";
     sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, level.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, message.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 3, ip.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 4, user_agent.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_prepare_v2(log_db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return;
+    }
+    bool batch = entries.size() > 1;
+    if (batch) {
+        sqlite3_exec(log_db, "BEGIN;", nullptr, nullptr, nullptr);
+    }
+    for (const auto& entry : entries) {
+        sqlite3_bind_text(stmt, 1, entry.timestamp.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, entry.level.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, entry.message.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, entry.ip.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 5, entry.user_agent.c_str(), -1, SQLITE_STATIC);
         if (sqlite3_step(stmt) != SQLITE_DONE) {
             std::cout << "Failed to log to DB" << std::endl;
         }
-        sqlite3_finalize(stmt);
+        sqlite3_reset(stmt);
     }
+    if (batch) {
+        sqlite3_exec(log_db, "COMMIT;", nullptr, nullptr, nullptr);
+    }
+    sqlite3_finalize(stmt);
 }
 
-void log(const std::string& message, const std::string& level, const std::string& ip, const std::string& user_agent) {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    std::cout << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") << " - " << message << std::endl;
-    log_to_db(level, message, ip, user_agent);
-}
\ No newline at end of file
+static void writer_loop() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true) {
+        queue_cv.wait(lock, [] { return !queue.empty() || !writer_running; });
+        if (queue.empty() && !writer_running) {
+            break;
+        }
+        std::vector<LogEntry> entries(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.end()));
+        queue.clear();
+        in_flight = entries.size();
+        lock.unlock();
+        write_entries(entries);
+        lock.lock();
+        in_flight = 0;
+        drained_cv.notify_all();
+    }
+}
+
+bool open_log_db(const std::string& path, const std::string& journal_mode, size_t capacity) {
+    close_log_db();
+    if (sqlite3_open(path.c_str(), &log_db) != SQLITE_OK) {
+        std::cout << "Failed to open log database: " << path << std::endl;
+        sqlite3_close(log_db);
+        log_db = nullptr;
+        return false;
+    }
+    set_journal_mode(log_db, journal_mode);
+    watch_deadline(log_db);
+    const char* sql = "CREATE TABLE IF NOT EXISTS logs (id INTEGER PRIMARY KEY AUTOINCREMENT, timestamp TEXT, level TEXT, message TEXT, ip TEXT, user_agent TEXT);";
+    char* err_msg = nullptr;
+    if (sqlite3_exec(log_db, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cout << "Failed to create log table: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+    }
+
+    queue_capacity = capacity;
+    if (queue_capacity > 0) {
+        writer_running = true;
+        writer = std::thread(writer_loop);
+    }
+    return true;
+}
+
+void flush_log_queue() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    drained_cv.wait(lock, [] { return (queue.empty() && in_flight == 0) || !writer_running; });
+}
+
+void close_log_db() {
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            writer_running = false;
+        }
+        queue_cv.notify_all();
+        writer.join();
+        drained_cv.notify_all();
+    }
+    if (log_db) {
+        checkpoint_wal(log_db);
+        sqlite3_close(log_db);
+        log_db = nullptr;
+    }
+}
+
+size_t log_queue_depth() {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return queue.size();
+}
+
+size_t log_queue_capacity() {
+    return queue_capacity;
+}
+
+uint64_t log_entries_dropped() {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+static void log_to_db(std::string timestamp, const std::string& level, const std::string& message, const std::string& ip, const std::string& user_agent) {
+    if (!log_db) {
+        return;
+    }
+    if (queue_capacity == 0) {
+        // A request past its deadline does not wait for the log database; stdout has the line.
+        if (deadline_expired()) {
+            return;
+        }
+        write_entries({LogEntry{std::move(timestamp), level, message, ip, user_agent}});
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (queue.size() >= queue_capacity) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        queue.push_back(LogEntry{std::move(timestamp), level, message, ip, user_agent});
+    }
+    queue_cv.notify_one();
+}
+
+void log_to_db(const std::string& level, const std::string& message, const std::string& ip, const std::string& user_agent) {
+    log_to_db(current_timestamp(), level, message, ip, user_agent);
+}
+
+bool parse_log_level(const std::string& level, LogLevel& out) {
+    std::string name = level;
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::toupper(c); });
+    if (name == "DEBUG") {
+        out = LogLevel::Debug;
+    } else if (name == "INFO") {
+        out = LogLevel::Info;
+    } else if (name == "WARN" || name == "WARNING") {
+        out = LogLevel::Warn;
+    } else if (name == "ERROR") {
+        out = LogLevel::Error;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+LogLevel parse_log_level(const std::string& level) {
+    LogLevel parsed = LogLevel::Info;
+    parse_log_level(level, parsed);
+    return parsed;
+}
+
+const char* log_level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Warn: return "WARN";
+        case LogLevel::Error: return "ERROR";
+        default: return "INFO";
+    }
+}
+
+void set_min_log_level(LogLevel level) {
+    min_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+LogLevel min_log_level() {
+    return static_cast<LogLevel>(min_level.load(std::memory_order_relaxed));
+}
+
+bool log_enabled(const std::string& level) {
+    return static_cast<int>(parse_log_level(level)) >= min_level.load(std::memory_order_relaxed);
+}
+
+void log(std::string_view message, const std::string& level, const std::string& ip, const std::string& user_agent) {
+    if (!log_enabled(level)) {
+        return;
+    }
+    std::string timestamp = current_timestamp();
+    std::cout << timestamp << " - " << message << std::endl;
+    if (log_db) {
+        log_to_db(std::move(timestamp), level, std::string(message), ip, user_agent);
+    }
+}
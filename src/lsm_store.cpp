@@ -0,0 +1,894 @@
+#include "lsm_store.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <queue>
+
+static const char segment_magic[8] = {'S', 'U', 'L', 'S', 'M', '0', '0', '1'};
+static const uint8_t wal_put = 1;
+static const uint8_t wal_delete = 2;
+static const size_t index_interval = 16;
+static const uint32_t bloom_bits_per_key = 10;
+static const uint32_t bloom_hashes = 7;
+static const size_t max_frozen_memtables = 2;
+
+struct SegmentFooter {
+    uint64_t index_offset;
+    uint64_t bloom_offset;
+    uint64_t entry_count;
+    uint64_t min_input_id;
+    uint64_t reserved;
+    char magic[8];
+};
+
+static uint64_t hash_key(const std::string& key) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint32_t checksum(const std::string& data) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void append_u32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void append_u64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static uint32_t read_u32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint64_t read_u64(const uint8_t* data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static std::string numbered_name(const char* prefix, uint64_t id, const char* suffix) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s%020llu%s", prefix, static_cast<unsigned long long>(id), suffix);
+    return name;
+}
+
+static bool parse_numbered_name(const std::string& name, const char* prefix, const char* suffix, uint64_t& id) {
+    size_t prefix_length = std::strlen(prefix);
+    size_t suffix_length = std::strlen(suffix);
+    if (name.size() != prefix_length + 20 + suffix_length || name.compare(0, prefix_length, prefix) != 0 ||
+        name.compare(prefix_length + 20, suffix_length, suffix) != 0) {
+        return false;
+    }
+    id = std::stoull(name.substr(prefix_length, 20));
+    return true;
+}
+
+// Decoded view of one data entry: [u8 deleted][u32 key length][u32 value length][key][value].
+struct SegmentEntry {
+    std::string key;
+    std::string value;
+    bool deleted = false;
+    uint64_t next = 0;
+};
+
+static bool decode_entry(const uint8_t* data, uint64_t end, uint64_t offset, SegmentEntry& out, bool with_value) {
+    if (offset + 9 > end) {
+        return false;
+    }
+    uint32_t key_length = read_u32(data + offset + 1);
+    uint32_t value_length = read_u32(data + offset + 5);
+    if (offset + 9 + key_length + value_length > end) {
+        return false;
+    }
+    out.deleted = data[offset] != 0;
+    out.key.assign(reinterpret_cast<const char*>(data + offset + 9), key_length);
+    if (with_value) {
+        out.value.assign(reinterpret_cast<const char*>(data + offset + 9 + key_length), value_length);
+    }
+    out.next = offset + 9 + key_length + value_length;
+    return true;
+}
+
+struct LsmStore::Segment {
+    uint64_t id = 0;
+    std::string path;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    uint64_t data_end = 0;
+    uint64_t entry_count = 0;
+    uint64_t min_input_id = 0;
+    std::vector<std::pair<std::string, uint64_t>> index;
+    std::vector<uint64_t> bloom;
+
+    ~Segment() {
+        if (data) {
+            munmap(data, size);
+        }
+    }
+
+    bool may_contain(const std::string& key) const {
+        if (bloom.empty()) {
+            return true;
+        }
+        uint64_t mask = bloom.size() * 64 - 1;
+        uint64_t h1 = hash_key(key);
+        uint64_t h2 = ((h1 >> 32) | (h1 << 32)) | 1;
+        for (uint32_t i = 0; i < bloom_hashes; ++i) {
+            uint64_t bit = (h1 + i * h2) & mask;
+            if (!(bloom[bit / 64] & (1ULL << (bit % 64)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Offset of the last indexed entry not after key; entries from there on are sorted.
+    uint64_t seek(const std::string& key) const {
+        auto it = std::upper_bound(index.begin(), index.end(), key,
+                                   [](const std::string& k, const std::pair<std::string, uint64_t>& item) { return k < item.first; });
+        return it == index.begin() ? 0 : std::prev(it)->second;
+    }
+
+    bool find(const std::string& key, Entry& out) const {
+        auto it = std::upper_bound(index.begin(), index.end(), key,
+                                   [](const std::string& k, const std::pair<std::string, uint64_t>& item) { return k < item.first; });
+        if (it == index.begin()) {
+            return false;
+        }
+        uint64_t offset = std::prev(it)->second;
+        uint64_t end = it == index.end() ? data_end : it->second;
+        SegmentEntry entry;
+        while (offset < end && decode_entry(data, data_end, offset, entry, false)) {
+            if (entry.key == key) {
+                decode_entry(data, data_end, offset, entry, true);
+                out.value = entry.value;
+                out.deleted = entry.deleted;
+                return true;
+            }
+            if (entry.key > key) {
+                return false;
+            }
+            offset = entry.next;
+        }
+        return false;
+    }
+};
+
+// Streams sorted entries into "<path>.tmp" and renames it into place on finish().
+class SegmentWriter {
+public:
+    SegmentWriter(const std::string& path, uint64_t expected_entries, uint64_t min_input_id)
+        : path_(path), min_input_id_(min_input_id) {
+        file_ = std::fopen((path + ".tmp").c_str(), "wb");
+        // Power-of-two size so probes are masked instead of divided.
+        uint64_t words = 1;
+        while (words * 64 < expected_entries * bloom_bits_per_key) {
+            words *= 2;
+        }
+        bloom_.assign(words, 0);
+    }
+
+    ~SegmentWriter() {
+        if (file_) {
+            std::fclose(file_);
+        }
+    }
+
+    bool ok() const {
+        return file_ != nullptr;
+    }
+
+    void add(const std::string& key, const std::string& value, bool deleted) {
+        if (count_ % index_interval == 0) {
+            index_.emplace_back(key, offset_);
+        }
+        record_.clear();
+        record_.push_back(deleted ? 1 : 0);
+        append_u32(record_, static_cast<uint32_t>(key.size()));
+        append_u32(record_, static_cast<uint32_t>(deleted ? 0 : value.size()));
+        record_ += key;
+        if (!deleted) {
+            record_ += value;
+        }
+        std::fwrite(record_.data(), 1, record_.size(), file_);
+        offset_ += record_.size();
+        ++count_;
+
+        uint64_t mask = bloom_.size() * 64 - 1;
+        uint64_t h1 = hash_key(key);
+        uint64_t h2 = ((h1 >> 32) | (h1 << 32)) | 1;
+        for (uint32_t i = 0; i < bloom_hashes; ++i) {
+            uint64_t bit = (h1 + i * h2) & mask;
+            bloom_[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+
+    bool finish() {
+        std::string tail;
+        uint64_t index_offset = offset_;
+        append_u32(tail, static_cast<uint32_t>(index_.size()));
+        for (const auto& item : index_) {
+            append_u32(tail, static_cast<uint32_t>(item.first.size()));
+            tail += item.first;
+            append_u64(tail, item.second);
+        }
+        uint64_t bloom_offset = index_offset + tail.size();
+        append_u32(tail, static_cast<uint32_t>(bloom_.size()));
+        for (uint64_t word : bloom_) {
+            append_u64(tail, word);
+        }
+        SegmentFooter footer{};
+        footer.index_offset = index_offset;
+        footer.bloom_offset = bloom_offset;
+        footer.entry_count = count_;
+        footer.min_input_id = min_input_id_;
+        std::memcpy(footer.magic, segment_magic, sizeof(segment_magic));
+        tail.append(reinterpret_cast<const char*>(&footer), sizeof(footer));
+
+        bool written = std::fwrite(tail.data(), 1, tail.size(), file_) == tail.size() && std::fflush(file_) == 0 &&
+                       fsync(fileno(file_)) == 0;
+        std::fclose(file_);
+        file_ = nullptr;
+        return written && std::rename((path_ + ".tmp").c_str(), path_.c_str()) == 0;
+    }
+
+private:
+    std::string path_;
+    uint64_t min_input_id_;
+    std::FILE* file_ = nullptr;
+    uint64_t offset_ = 0;
+    uint64_t count_ = 0;
+    std::string record_;
+    std::vector<std::pair<std::string, uint64_t>> index_;
+    std::vector<uint64_t> bloom_;
+};
+
+static std::shared_ptr<LsmStore::Segment> load_segment(const std::string& path, uint64_t id) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SegmentFooter)) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        return nullptr;
+    }
+    auto segment = std::make_shared<LsmStore::Segment>();
+    segment->id = id;
+    segment->path = path;
+    segment->data = static_cast<uint8_t*>(mapped);
+    segment->size = st.st_size;
+
+    SegmentFooter footer;
+    std::memcpy(&footer, segment->data + segment->size - sizeof(footer), sizeof(footer));
+    if (std::memcmp(footer.magic, segment_magic, sizeof(segment_magic)) != 0 ||
+        footer.bloom_offset + 4 > segment->size || footer.index_offset + 4 > footer.bloom_offset) {
+        std::cout << "Invalid LSM segment: " << path << std::endl;
+        return nullptr;
+    }
+    segment->data_end = footer.index_offset;
+    segment->entry_count = footer.entry_count;
+    segment->min_input_id = footer.min_input_id;
+
+    const uint8_t* cursor = segment->data + footer.index_offset;
+    uint32_t index_count = read_u32(cursor);
+    cursor += 4;
+    segment->index.reserve(index_count);
+    for (uint32_t i = 0; i < index_count; ++i) {
+        uint32_t key_length = read_u32(cursor);
+        std::string key(reinterpret_cast<const char*>(cursor + 4), key_length);
+        segment->index.emplace_back(std::move(key), read_u64(cursor + 4 + key_length));
+        cursor += 4 + key_length + 8;
+    }
+    cursor = segment->data + footer.bloom_offset;
+    uint32_t words = read_u32(cursor);
+    cursor += 4;
+    segment->bloom.resize(words);
+    std::memcpy(segment->bloom.data(), cursor, words * sizeof(uint64_t));
+    return segment;
+}
+
+LsmStore::~LsmStore() {
+    close();
+}
+
+std::string LsmStore::segment_path(uint64_t id) const {
+    return (std::filesystem::path(dir_) / numbered_name("seg-", id, ".sst")).string();
+}
+
+std::string LsmStore::wal_path(uint64_t id) const {
+    return (std::filesystem::path(dir_) / numbered_name("wal-", id, ".log")).string();
+}
+
+bool LsmStore::open(const std::string& dir, const Options& options) {
+    close();
+    dir_ = dir;
+    options_ = options;
+    options_.compaction_trigger = std::max<size_t>(options_.compaction_trigger, 2);
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    if (ec) {
+        std::cout << "Failed to create LSM directory: " << ec.message() << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t> segment_ids;
+    std::vector<uint64_t> wal_ids;
+    for (const auto& file : std::filesystem::directory_iterator(dir_, ec)) {
+        std::string name = file.path().filename().string();
+        uint64_t id;
+        if (file.path().extension() == ".tmp") {
+            std::filesystem::remove(file.path(), ec);
+        } else if (parse_numbered_name(name, "seg-", ".sst", id)) {
+            segment_ids.push_back(id);
+        } else if (parse_numbered_name(name, "wal-", ".log", id)) {
+            wal_ids.push_back(id);
+        }
+    }
+    std::sort(segment_ids.begin(), segment_ids.end());
+    std::sort(wal_ids.begin(), wal_ids.end());
+
+    std::vector<std::shared_ptr<Segment>> loaded;
+    for (uint64_t id : segment_ids) {
+        auto segment = load_segment(segment_path(id), id);
+        if (!segment) {
+            return false;
+        }
+        loaded.push_back(segment);
+        next_segment_id_ = std::max(next_segment_id_, id + 1);
+    }
+    // A compaction that finished but crashed before deleting its inputs leaves them behind.
+    for (const auto& segment : loaded) {
+        if (segment->min_input_id == 0) {
+            continue;
+        }
+        for (auto& input : loaded) {
+            if (input && input->id >= segment->min_input_id && input->id < segment->id) {
+                std::filesystem::remove(input->path, ec);
+                input->min_input_id = UINT64_MAX;
+            }
+        }
+    }
+    for (const auto& segment : loaded) {
+        if (segment->min_input_id != UINT64_MAX) {
+            segments_.push_back(segment);
+        }
+    }
+
+    for (uint64_t id : wal_ids) {
+        replay_wal(wal_path(id));
+        active_wal_ids_.push_back(id);
+        next_wal_id_ = std::max(next_wal_id_, id + 1);
+    }
+    if (!open_wal()) {
+        return false;
+    }
+
+    stopping_ = false;
+    background_ = std::thread(&LsmStore::background_loop, this);
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    maybe_freeze();
+    return true;
+}
+
+void LsmStore::close() {
+    if (background_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(background_mutex_);
+            stopping_ = true;
+        }
+        background_cv_.notify_all();
+        background_.join();
+    }
+    if (wal_) {
+        std::fflush(wal_);
+        fsync(fileno(wal_));
+        std::fclose(wal_);
+        wal_ = nullptr;
+    }
+    std::unique_lock<std::shared_mutex> lock(state_mutex_);
+    memtable_.clear();
+    memtable_size_ = 0;
+    frozen_.clear();
+    segments_.clear();
+    active_wal_ids_.clear();
+    next_wal_id_ = 1;
+    next_segment_id_ = 1;
+}
+
+bool LsmStore::open_wal() {
+    uint64_t id = next_wal_id_++;
+    wal_ = std::fopen(wal_path(id).c_str(), "ab");
+    if (!wal_) {
+        std::cout << "Failed to open LSM write-ahead log" << std::endl;
+        return false;
+    }
+    active_wal_ids_.push_back(id);
+    return true;
+}
+
+void LsmStore::sync_wal() {
+    std::fflush(wal_);
+    if (options_.sync_wal) {
+        fdatasync(fileno(wal_));
+    }
+}
+
+bool LsmStore::replay_wal(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    uint8_t header[9];
+    while (std::fread(header, 1, sizeof(header), file) == sizeof(header)) {
+        uint32_t key_length = read_u32(header + 1);
+        uint32_t value_length = read_u32(header + 5);
+        std::string payload(reinterpret_cast<const char*>(header), sizeof(header));
+        payload.resize(sizeof(header) + key_length + value_length);
+        uint32_t expected;
+        if (std::fread(&payload[sizeof(header)], 1, key_length + value_length, file) != key_length + value_length ||
+            std::fread(&expected, 1, sizeof(expected), file) != sizeof(expected) || checksum(payload) != expected) {
+            break;
+        }
+        std::string key = payload.substr(sizeof(header), key_length);
+        Entry& entry = memtable_[key];
+        entry.deleted = header[0] == wal_delete;
+        entry.value = payload.substr(sizeof(header) + key_length);
+        memtable_size_ += key.size() + entry.value.size() + 32;
+    }
+    std::fclose(file);
+    return true;
+}
+
+void LsmStore::put_locked(const std::string& key, const std::string& value, bool deleted) {
+    std::string record;
+    record.push_back(static_cast<char>(deleted ? wal_delete : wal_put));
+    append_u32(record, static_cast<uint32_t>(key.size()));
+    append_u32(record, static_cast<uint32_t>(deleted ? 0 : value.size()));
+    record += key;
+    if (!deleted) {
+        record += value;
+    }
+    append_u32(record, checksum(record));
+    std::fwrite(record.data(), 1, record.size(), wal_);
+
+    std::unique_lock<std::shared_mutex> lock(state_mutex_);
+    Entry& entry = memtable_[key];
+    entry.value = deleted ? std::string() : value;
+    entry.deleted = deleted;
+    memtable_size_ += key.size() + value.size() + 32;
+}
+
+void LsmStore::maybe_freeze() {
+    if (memtable_size_ < options_.memtable_bytes) {
+        return;
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        auto frozen = std::make_shared<FrozenMemtable>();
+        frozen->entries.swap(memtable_);
+        frozen->wal_ids.swap(active_wal_ids_);
+        frozen_.push_back(frozen);
+        memtable_size_ = 0;
+    }
+    std::fclose(wal_);
+    wal_ = nullptr;
+    open_wal();
+    {
+        std::lock_guard<std::mutex> lock(background_mutex_);
+        pending_ = true;
+    }
+    background_cv_.notify_all();
+
+    // Back-pressure: do not let frozen memtables pile up faster than they are written.
+    std::unique_lock<std::mutex> lock(background_mutex_);
+    while (true) {
+        {
+            std::shared_lock<std::shared_mutex> state(state_mutex_);
+            if (frozen_.size() <= max_frozen_memtables) {
+                break;
+            }
+        }
+        idle_cv_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+void LsmStore::background_loop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(background_mutex_);
+            background_cv_.wait(lock, [this] { return pending_ || stopping_; });
+            pending_ = false;
+            busy_ = true;
+        }
+        while (flush_one()) {
+        }
+        while (true) {
+            {
+                std::shared_lock<std::shared_mutex> lock(state_mutex_);
+                if (segments_.size() < options_.compaction_trigger) {
+                    break;
+                }
+            }
+            if (!compact_segments()) {
+                break;
+            }
+        }
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lock(background_mutex_);
+            busy_ = false;
+            stop = stopping_ && !pending_;
+        }
+        idle_cv_.notify_all();
+        if (stop) {
+            break;
+        }
+    }
+}
+
+bool LsmStore::flush_one() {
+    std::shared_ptr<FrozenMemtable> oldest;
+    uint64_t id;
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        if (frozen_.empty()) {
+            return false;
+        }
+        oldest = frozen_.front();
+        id = next_segment_id_++;
+    }
+    SegmentWriter writer(segment_path(id), oldest->entries.size(), 0);
+    if (!writer.ok()) {
+        std::cout << "Failed to write LSM segment" << std::endl;
+        return false;
+    }
+    for (const auto& item : oldest->entries) {
+        writer.add(item.first, item.second.value, item.second.deleted);
+    }
+    std::shared_ptr<Segment> segment;
+    if (!writer.finish() || !(segment = load_segment(segment_path(id), id))) {
+        std::cout << "Failed to write LSM segment" << std::endl;
+        return false;
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        segments_.push_back(segment);
+        frozen_.erase(frozen_.begin());
+    }
+    std::error_code ec;
+    for (uint64_t wal_id : oldest->wal_ids) {
+        std::filesystem::remove(wal_path(wal_id), ec);
+    }
+    idle_cv_.notify_all();
+    return true;
+}
+
+bool LsmStore::compact_segments() {
+    std::vector<std::shared_ptr<Segment>> inputs;
+    bool includes_oldest;
+    uint64_t id;
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        // Size-tiered: merge the newest run of segments within 2x of each other once it is
+        // compaction_trigger long, so each entry is rewritten about log(n) times.
+        size_t start = segments_.size() - 1;
+        size_t largest = segments_.back()->size;
+        while (start > 0 && segments_[start - 1]->size <= 2 * largest) {
+            --start;
+            largest = std::max(largest, segments_[start]->size);
+        }
+        if (segments_.size() - start < options_.compaction_trigger) {
+            return false;
+        }
+        inputs.assign(segments_.begin() + start, segments_.end());
+        includes_oldest = start == 0;
+        id = next_segment_id_++;
+    }
+    uint64_t expected = 0;
+    for (const auto& segment : inputs) {
+        expected += segment->entry_count;
+    }
+
+    // The heap holds input positions; heads[i] is the current entry of inputs[i].
+    std::vector<SegmentEntry> heads(inputs.size());
+    auto later = [&heads](size_t a, size_t b) {
+        int order = heads[a].key.compare(heads[b].key);
+        return order != 0 ? order > 0 : a < b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (decode_entry(inputs[i]->data, inputs[i]->data_end, 0, heads[i], true)) {
+            heap.push(i);
+        }
+    }
+
+    SegmentWriter writer(segment_path(id), expected, inputs.front()->id);
+    if (!writer.ok()) {
+        return false;
+    }
+    std::string last_key;
+    bool has_last = false;
+    while (!heap.empty()) {
+        size_t source = heap.top();
+        heap.pop();
+        SegmentEntry& entry = heads[source];
+        // Newest source pops first for equal keys, so older versions are skipped. Tombstones
+        // can only be dropped when nothing older than the inputs is left to shadow.
+        if (!has_last || entry.key != last_key) {
+            if (!entry.deleted || !includes_oldest) {
+                writer.add(entry.key, entry.value, entry.deleted);
+            }
+            last_key = entry.key;
+            has_last = true;
+        }
+        if (decode_entry(inputs[source]->data, inputs[source]->data_end, entry.next, entry, true)) {
+            heap.push(source);
+        }
+    }
+    std::shared_ptr<Segment> merged;
+    if (!writer.finish() || !(merged = load_segment(segment_path(id), id))) {
+        std::cout << "Failed to compact LSM segments" << std::endl;
+        return false;
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        segments_.erase(segments_.end() - inputs.size(), segments_.end());
+        segments_.push_back(merged);
+    }
+    std::error_code ec;
+    for (const auto& input : inputs) {
+        std::filesystem::remove(input->path, ec);
+    }
+    return true;
+}
+
+void LsmStore::flush() {
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        if (!wal_) {
+            return;
+        }
+        sync_wal();
+        if (!memtable_.empty()) {
+            size_t limit = options_.memtable_bytes;
+            options_.memtable_bytes = 0;
+            maybe_freeze();
+            options_.memtable_bytes = limit;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(background_mutex_);
+        pending_ = true;
+    }
+    background_cv_.notify_all();
+    std::unique_lock<std::mutex> lock(background_mutex_);
+    idle_cv_.wait(lock, [this] {
+        std::shared_lock<std::shared_mutex> state(state_mutex_);
+        return !pending_ && !busy_ && frozen_.empty();
+    });
+}
+
+bool LsmStore::healthy() {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    return wal_ != nullptr && !std::ferror(wal_);
+}
+
+size_t LsmStore::segment_count() {
+    std::shared_lock<std::shared_mutex> lock(state_mutex_);
+    return segments_.size();
+}
+
+bool LsmStore::lookup(const std::string& key, std::string& value) {
+    std::shared_lock<std::shared_mutex> lock(state_mutex_);
+    auto it = memtable_.find(key);
+    if (it != memtable_.end()) {
+        value = it->second.value;
+        return !it->second.deleted;
+    }
+    for (auto frozen = frozen_.rbegin(); frozen != frozen_.rend(); ++frozen) {
+        auto found = (*frozen)->entries.find(key);
+        if (found != (*frozen)->entries.end()) {
+            value = found->second.value;
+            return !found->second.deleted;
+        }
+    }
+    for (auto segment = segments_.rbegin(); segment != segments_.rend(); ++segment) {
+        Entry entry;
+        if ((*segment)->may_contain(key) && (*segment)->find(key, entry)) {
+            value = entry.value;
+            return !entry.deleted;
+        }
+    }
+    return false;
+}
+
+static std::string code_key(const ShortCode& short_code) {
+    std::string key = "c:";
+    key.append(short_code.data(), short_code.size());
+    return key;
+}
+
+void LsmStore::insert_locked(const ShortCode& short_code, const std::string& url) {
+    std::string previous_url;
+    if (lookup(code_key(short_code), previous_url) && previous_url != url) {
+        put_locked("u:" + previous_url, "", true);
+    }
+    std::string previous_code;
+    if (lookup("u:" + url, previous_code) && previous_code != short_code) {
+        put_locked("c:" + previous_code, "", true);
+    }
+    put_locked(code_key(short_code), url, false);
+    put_locked("u:" + url, short_code.str(), false);
+}
+
+void LsmStore::remove_locked(const ShortCode& short_code) {
+    std::string url;
+    if (lookup(code_key(short_code), url)) {
+        put_locked(code_key(short_code), "", true);
+        put_locked("u:" + url, "", true);
+    }
+}
+
+void LsmStore::insert(const ShortCode& short_code, const std::string& url) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (!wal_) {
+        return;
+    }
+    insert_locked(short_code, url);
+    sync_wal();
+    maybe_freeze();
+}
+
+bool LsmStore::insert_new(const ShortCode& short_code, const std::string& url) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    std::string existing;
+    if (!wal_ || lookup(code_key(short_code), existing) || lookup("u:" + url, existing)) {
+        return false;
+    }
+    insert_locked(short_code, url);
+    sync_wal();
+    maybe_freeze();
+    return true;
+}
+
+void LsmStore::insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (!wal_) {
+        return;
+    }
+    for (const auto& entry : entries) {
+        insert_locked(entry.first, entry.second);
+    }
+    sync_wal();
+    maybe_freeze();
+}
+
+std::string LsmStore::get(const ShortCode& short_code) {
+    std::string url;
+    return lookup(code_key(short_code), url) ? url : "";
+}
+
+ShortCode LsmStore::get_by_url(const std::string& url) {
+    std::string short_code;
+    return lookup("u:" + url, short_code) ? short_code : "";
+}
+
+void LsmStore::remove(const ShortCode& short_code) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (!wal_) {
+        return;
+    }
+    remove_locked(short_code);
+    sync_wal();
+    maybe_freeze();
+}
+
+void LsmStore::remove_batch(const std::vector<ShortCode>& short_codes) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (!wal_) {
+        return;
+    }
+    for (const auto& short_code : short_codes) {
+        remove_locked(short_code);
+    }
+    sync_wal();
+    maybe_freeze();
+}
+
+void LsmStore::for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    Memtable merged;
+    {
+        std::shared_lock<std::shared_mutex> lock(state_mutex_);
+        for (const auto& segment : segments_) {
+            SegmentEntry entry;
+            uint64_t offset = 0;
+            while (decode_entry(segment->data, segment->data_end, offset, entry, true)) {
+                if (entry.key.compare(0, 2, "c:") == 0) {
+                    merged[entry.key] = Entry{entry.value, entry.deleted};
+                }
+                offset = entry.next;
+            }
+        }
+        for (const auto& frozen : frozen_) {
+            for (auto it = frozen->entries.lower_bound("c:"); it != frozen->entries.end() && it->first.compare(0, 2, "c:") == 0; ++it) {
+                merged[it->first] = it->second;
+            }
+        }
+        for (auto it = memtable_.lower_bound("c:"); it != memtable_.end() && it->first.compare(0, 2, "c:") == 0; ++it) {
+            merged[it->first] = it->second;
+        }
+    }
+    for (const auto& item : merged) {
+        if (!item.second.deleted) {
+            callback(item.first.substr(2), item.second.value);
+        }
+    }
+}
+
+void LsmStore::for_each_with_prefix(const std::string& prefix,
+                                    const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    // "u:<url>" keys are sorted, so the matching ones form one range in every level.
+    std::string lower = "u:" + prefix;
+    auto in_range = [&lower](const std::string& key) { return key.compare(0, lower.size(), lower) == 0; };
+    Memtable merged;
+    {
+        std::shared_lock<std::shared_mutex> lock(state_mutex_);
+        for (const auto& segment : segments_) {
+            SegmentEntry entry;
+            uint64_t offset = segment->seek(lower);
+            while (decode_entry(segment->data, segment->data_end, offset, entry, true)) {
+                if (in_range(entry.key)) {
+                    merged[entry.key] = Entry{entry.value, entry.deleted};
+                } else if (entry.key > lower) {
+                    break;
+                }
+                offset = entry.next;
+            }
+        }
+        for (const auto& frozen : frozen_) {
+            for (auto it = frozen->entries.lower_bound(lower); it != frozen->entries.end() && in_range(it->first); ++it) {
+                merged[it->first] = it->second;
+            }
+        }
+        for (auto it = memtable_.lower_bound(lower); it != memtable_.end() && in_range(it->first); ++it) {
+            merged[it->first] = it->second;
+        }
+    }
+    for (const auto& item : merged) {
+        if (!item.second.deleted) {
+            callback(item.second.value, item.first.substr(2));
+        }
+    }
+}
+
+bool LsmStore::has_url_index() {
+    return true;
+}
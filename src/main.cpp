@@ -2,23 +2,227 @@
 #include "config.hpp"
 #include "database.hpp"
 #include "logger.hpp"
+#include "access_log.hpp"
+#include "aliases.hpp"
 #include "handlers.hpp"
+#include "cached_store.hpp"
+#include "code_checksum.hpp"
+#include "code_pool.hpp"
+#include "code_sequence.hpp"
+#include "compressed_store.hpp"
+#include "interned_store.hpp"
+#include "warmup.hpp"
+#include "health.hpp"
+#include "admission.hpp"
+#include "shutdown.hpp"
+#include "hot_restart.hpp"
+#include "request_arena.hpp"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <thread>
+#include <unistd.h>
 #include <sqlite3.h>
 
+static const uint16_t port = 8080;
+
 int main() {
+    // Before any thread starts, so SIGTERM reaches only the shutdown thread below.
+    block_shutdown_signals();
     log("Starting URL Shortener server");
-    int short_code_length = load_config();
+    Config config = load_settings();
+    set_min_log_level(parse_log_level(config.log_level));
+    for (const auto& rate : config.log_sample_rates) {
+        AccessEvent event = parse_access_event(rate.first);
+        if (event == AccessEvent::None) {
+            log("Unknown log_sample event: " + rate.first, "WARN");
+            continue;
+        }
+        set_access_sample_rate(event, rate.second);
+    }
+    int short_code_length = config.short_code_length;
     log("Short code length: " + std::to_string(short_code_length));
-    if (sqlite3_open("urls.db", &db) != SQLITE_OK) {
+    if (config.short_code_checksum) {
+        configure_code_checksum(short_code_length, config.short_code_checksum_key, config.short_code_legacy_length);
+        if (!code_checksum_enabled()) {
+            log("Short code checksum needs short_code_length of 2 to 16, disabled", "WARN");
+        } else if (config.short_code_legacy_length == static_cast<size_t>(short_code_length)) {
+            log("Legacy codes have the same length as checksummed ones, every code of that length reaches storage", "WARN");
+        } else if (config.short_code_checksum_key.empty()) {
+            log("Short code checksum has no key, anyone can compute valid codes", "WARN");
+        }
+    }
+    if (sqlite3_open(config.db_path.c_str(), &db) != SQLITE_OK) {
         log("Failed to open database");
         return 1;
     }
+    set_journal_mode(db, config.db_journal_mode);
     init_db();
+    auto store = create_store(config);
+    if (!store) {
+        log("Failed to open storage engine: " + config.storage_engine, "ERROR");
+        return 1;
+    }
+    if (!config.url_dictionary.empty()) {
+        store = open_compressed_store(std::move(store), config.url_dictionary, config.url_dictionary_sample);
+        if (!store) {
+            return 1;
+        }
+    }
+    CachedStore* cache = nullptr;
+    if (config.cache_size > 0) {
+        auto cached_store = std::make_unique<CachedStore>(std::move(store), config.cache_size, config.cache_ttl_ms);
+        cache = cached_store.get();
+        store = std::move(cached_store);
+    }
+    if (config.url_prefix_limit > 0) {
+        store = open_interned_store(std::move(store), db, config.url_prefix_limit);
+        if (!store) {
+            return 1;
+        }
+    }
+    set_store(std::move(store));
+    log("Storage engine: " + config.storage_engine);
+    if (!open_aliases(db, short_code_length, config.short_code_legacy_length)) {
+        log("Failed to open alias table", "WARN");
+    }
+    if (config.code_sequence_block > 0 &&
+        !start_code_sequence(config.db_path, short_code_length, config.code_sequence_block)) {
+        log("Failed to start short code sequence, generating random codes", "WARN");
+    }
+    if (config.code_pool_size > 0 &&
+        !start_code_pool(config.db_path, short_code_length, config.code_pool_size, config.code_pool_low_water,
+                         config.code_pool_refill_batch)) {
+        log("Failed to start short code pool", "WARN");
+    }
+    if (!open_log_db(config.log_db_path, config.log_db_journal_mode, config.log_queue_size)) {
+        log("Failed to open log database", "WARN");
+    }
+    // mmap and lsm files must not be opened by two processes at once.
+    bool hot_restart = !config.hot_restart_socket.empty() && config.storage_engine != "mmap" && config.storage_engine != "lsm";
+    HotRestartHandoff handoff;
+    if (hot_restart) {
+        handoff = request_listen_socket(config.hot_restart_socket);
+    }
+    // During a handoff the previous instance still writes the access log; open it once it is gone.
+    if (handoff.listen_fd < 0 &&
+        !open_access_log(config.access_log_dir, config.access_log_segment_size, config.access_log_max_segments)) {
+        log("Failed to open access log", "WARN");
+    }
+
+    start_warmup(*current_store(), config.hot_set_path);
+    start_health_probe(config.health_probe_interval_ms, config.health_probe_timeout_ms, config.ready_max_log_queue_fill);
+    if (cache) {
+        start_hot_set_snapshots(*cache, config.hot_set_path, config.hot_set_size, config.hot_set_interval);
+    }
 
-    crow::SimpleApp app;
+    App app;
+    if (!config.rate_limits.empty()) {
+        auto limiter = std::make_unique<RateLimiter>(config.rate_limit_clients);
+        for (const auto& limit : config.rate_limits) {
+            RateLimitRoute route = parse_rate_limit_route(limit.first);
+            if (route == RateLimitRoute::None) {
+                log("Unknown rate_limit route: " + limit.first, "WARN");
+                continue;
+            }
+            limiter->set_limit(route, limit.second.first, limit.second.second);
+        }
+        app.get_middleware<RateLimitMiddleware>().limiter = std::move(limiter);
+    }
+    app.get_middleware<DeadlineMiddleware>().timeout_ms = config.request_timeout_ms;
+    set_request_arena_size(config.request_arena_size);
+    if (config.server_threads > 0) {
+        app.concurrency(config.server_threads);
+    } else {
+        app.multithreaded();
+    }
+    // One Crow thread accepts connections, the rest handle requests. Keeping some of them out
+    // of storage leaves threads to answer cached redirects and 503s while storage stalls.
+    int workers = app.concurrency() - 1;
+    if (config.admission_max_inflight >= 0) {
+        int max_inflight = config.admission_max_inflight > 0 ? config.admission_max_inflight : std::max(1, workers / 2);
+        configure_admission(max_inflight, config.admission_target_ms, config.admission_interval_ms);
+        log("Admission control: " + std::to_string(max_inflight) + " of " + std::to_string(workers) + " workers may use storage");
+    }
+    // Crow prefers the earliest registered rule, so fixed paths go before "/<string>".
+    setup_health_routes(app);
     setup_routes(app, short_code_length);
+    setup_admin_routes(app, config.admin_token);
+
+    if (handoff.listen_fd >= 0) {
+        log("Took over the listening socket of the running instance");
+        app.listen_fd(handoff.listen_fd);
+    }
+    std::atomic<bool> signalled{false};
+    std::thread handoff_thread;
+    if (hot_restart) {
+        handoff_thread = std::thread([&config, &handoff, &signalled, cache] {
+            if (handoff.listen_fd >= 0) {
+                while (!warmup_complete() && !signalled.load()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+                if (signalled.load()) {
+                    abort_handoff(handoff);
+                    log("Shutting down before the handoff finished, the previous instance keeps serving", "WARN");
+                    return;
+                }
+                bool finished = finish_handoff(handoff, config.shutdown_drain_timeout_ms + 5000);
+                log(finished ? "Previous instance exited" : "Previous instance did not exit in time", finished ? "INFO" : "WARN");
+                if (!open_access_log(config.access_log_dir, config.access_log_segment_size, config.access_log_max_segments)) {
+                    log("Failed to open access log", "WARN");
+                }
+            }
+            if (signalled.load()) {
+                return;
+            }
+            start_handoff_listener(config.hot_restart_socket, port, [cache, &config] {
+                // The next instance warms up from this file.
+                if (cache && !save_hot_set(*cache, config.hot_set_path, config.hot_set_size)) {
+                    log("Failed to save hot set: " + config.hot_set_path, "WARN");
+                }
+            }, [] {
+                kill(getpid(), SIGTERM);
+            });
+        });
+    }
+
+    app.signal_clear();
+    std::thread shutdown_thread([&app, &signalled, &config] {
+        int signal_number = wait_for_shutdown_signal();
+        if (signalled.exchange(true)) {
+            return;
+        }
+        log("Received signal " + std::to_string(signal_number) + ", draining requests", "WARN");
+        bool drained = drain_requests(port, config.shutdown_drain_timeout_ms);
+        log(drained ? "All requests drained" : "Stopping with requests still in flight", drained ? "INFO" : "WARN");
+        app.stop();
+    });
+
+    app.port(port).run();
+    if (!signalled.exchange(true)) {
+        // run() returned on its own; wake the shutdown thread so it can be joined.
+        kill(getpid(), SIGTERM);
+    }
+    shutdown_thread.join();
+    if (handoff_thread.joinable()) {
+        handoff_thread.join();
+    }
+    // Before the store goes away, since a handoff still in progress saves the hot set from it.
+    stop_handoff_listener();
 
-    app.port(8080).multithreaded().run();
+    stop_health_probe();
+    stop_warmup();
+    stop_hot_set_snapshots();
+    stop_code_pool();
+    stop_code_sequence();
+    close_aliases();
+    close_access_log();
+    close_log_db();
+    set_store(nullptr);
+    checkpoint_wal(db);
     sqlite3_close(db);
+    log("Shutdown complete");
+    // Last, so a new instance only opens the access log once everything here is flushed.
+    close_handoff_connection();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,557 @@
+#include "mmap_store.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+static const char index_magic[8] = {'S', 'U', 'I', 'D', 'X', '0', '0', '1'};
+static const char heap_magic[8] = {'S', 'U', 'H', 'E', 'A', 'P', '0', '1'};
+static const uint64_t empty_offset = 0;
+static const uint64_t tombstone_offset = 1;
+static const size_t initial_heap_size = 1024 * 1024;
+// Far beyond any real table; keeps a corrupt header from overflowing index_file_size().
+static const uint64_t max_index_capacity = uint64_t(1) << 40;
+
+struct IndexHeader {
+    char magic[8];
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t used;
+    char reserved[32];
+};
+
+struct HeapHeader {
+    char magic[8];
+    uint64_t used;
+    char reserved[48];
+};
+
+struct CodeSlot {
+    uint64_t offset;
+    char code[MmapStore::max_code_length];
+};
+
+struct UrlSlot {
+    uint64_t offset;
+    uint64_t hash;
+};
+
+struct HeapRecord {
+    uint32_t url_length;
+    uint8_t code_length;
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(IndexHeader) == 64, "IndexHeader layout is part of the index file format");
+static_assert(sizeof(HeapHeader) == 64, "HeapHeader layout is part of the heap file format");
+static_assert(sizeof(CodeSlot) == 24, "CodeSlot layout is part of the index file format");
+
+static uint64_t hash_bytes(const char* data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= static_cast<uint8_t>(data[i]);
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t load_offset(const uint64_t* offset) {
+    return __atomic_load_n(offset, __ATOMIC_ACQUIRE);
+}
+
+static void store_offset(uint64_t* offset, uint64_t value) {
+    __atomic_store_n(offset, value, __ATOMIC_RELEASE);
+}
+
+static size_t index_file_size(uint64_t capacity) {
+    return sizeof(IndexHeader) + capacity * (sizeof(CodeSlot) + sizeof(UrlSlot));
+}
+
+static IndexHeader* index_header(uint8_t* base) {
+    return reinterpret_cast<IndexHeader*>(base);
+}
+
+static CodeSlot* code_slots(uint8_t* base) {
+    return reinterpret_cast<CodeSlot*>(base + sizeof(IndexHeader));
+}
+
+static UrlSlot* url_slots(uint8_t* base, uint64_t capacity) {
+    return reinterpret_cast<UrlSlot*>(base + sizeof(IndexHeader) + capacity * sizeof(CodeSlot));
+}
+
+static HeapHeader* heap_header(uint8_t* base) {
+    return reinterpret_cast<HeapHeader*>(base);
+}
+
+static bool read_record(const uint8_t* heap, size_t heap_size, uint64_t offset, std::string* code, std::string* url) {
+    if (offset + sizeof(HeapRecord) > heap_size) {
+        return false;
+    }
+    HeapRecord record;
+    std::memcpy(&record, heap + offset, sizeof(record));
+    const char* data = reinterpret_cast<const char*>(heap + offset + sizeof(record));
+    if (offset + sizeof(record) + record.code_length + record.url_length > heap_size) {
+        return false;
+    }
+    if (code) {
+        code->assign(data, record.code_length);
+    }
+    if (url) {
+        url->assign(data + record.code_length, record.url_length);
+    }
+    return true;
+}
+
+static bool record_has_code(const uint8_t* heap, size_t heap_size, uint64_t offset, const ShortCode& short_code) {
+    if (offset + sizeof(HeapRecord) > heap_size) {
+        return false;
+    }
+    HeapRecord record;
+    std::memcpy(&record, heap + offset, sizeof(record));
+    return record.code_length == short_code.size() &&
+           offset + sizeof(record) + record.code_length <= heap_size &&
+           std::memcmp(heap + offset + sizeof(record), short_code.data(), short_code.size()) == 0;
+}
+
+static bool record_has_url(const uint8_t* heap, size_t heap_size, uint64_t offset, const std::string& url) {
+    if (offset + sizeof(HeapRecord) > heap_size) {
+        return false;
+    }
+    HeapRecord record;
+    std::memcpy(&record, heap + offset, sizeof(record));
+    size_t start = offset + sizeof(record) + record.code_length;
+    return record.url_length == url.size() &&
+           start + record.url_length <= heap_size &&
+           std::memcmp(heap + start, url.data(), url.size()) == 0;
+}
+
+static void pack_code(const ShortCode& short_code, char out[MmapStore::max_code_length]) {
+    std::memset(out, 0, MmapStore::max_code_length);
+    std::memcpy(out, short_code.data(), std::min(short_code.size(), MmapStore::max_code_length));
+}
+
+MmapStore::~MmapStore() {
+    close();
+}
+
+bool MmapStore::map_file(const std::string& path, size_t size, bool truncate, Mapping& out) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (fd < 0) {
+        std::cout << "Failed to open storage file: " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (static_cast<size_t>(st.st_size) < size && ftruncate(fd, static_cast<off_t>(size)) != 0)) {
+        std::cout << "Failed to size storage file: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    size = std::max(size, static_cast<size_t>(st.st_size));
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cout << "Failed to map storage file: " << path << std::endl;
+        return false;
+    }
+    out.base = static_cast<uint8_t*>(mapped);
+    out.size = size;
+    return true;
+}
+
+bool MmapStore::create_index(const std::string& path, uint64_t capacity, Index& out) {
+    if (!map_file(path, index_file_size(capacity), true, out.mapping)) {
+        return false;
+    }
+    IndexHeader* header = index_header(out.mapping.base);
+    std::memcpy(header->magic, index_magic, sizeof(index_magic));
+    header->capacity = capacity;
+    header->count = 0;
+    header->used = 0;
+    out.capacity = capacity;
+    return true;
+}
+
+bool MmapStore::open(const std::string& dir, uint64_t initial_capacity) {
+    close();
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    dir_ = dir;
+    std::string index_path = (std::filesystem::path(dir) / "index.bin").string();
+    std::string heap_path = (std::filesystem::path(dir) / "heap.bin").string();
+
+    uint64_t capacity = 16;
+    while (capacity < initial_capacity) {
+        capacity <<= 1;
+    }
+
+    auto* index = new Index();
+    auto* heap = new Heap();
+    auto fail = [index, heap](const std::string& message) {
+        std::cout << message << std::endl;
+        for (Mapping* mapping : {&index->mapping, &heap->mapping}) {
+            if (mapping->base) {
+                munmap(mapping->base, mapping->size);
+            }
+        }
+        delete index;
+        delete heap;
+        return false;
+    };
+    bool exists = std::filesystem::exists(index_path, ec);
+    if (exists) {
+        if (!map_file(index_path, sizeof(IndexHeader), false, index->mapping)) {
+            return fail("Invalid storage index: " + index_path);
+        }
+        const IndexHeader* header = index_header(index->mapping.base);
+        uint64_t stored_capacity = header->capacity;
+        if (std::memcmp(header->magic, index_magic, sizeof(index_magic)) != 0 || stored_capacity == 0 ||
+            (stored_capacity & (stored_capacity - 1)) != 0 || stored_capacity > max_index_capacity ||
+            index->mapping.size < index_file_size(stored_capacity) || header->count > header->used ||
+            header->used > stored_capacity) {
+            return fail("Invalid storage index: " + index_path);
+        }
+        index->capacity = stored_capacity;
+        // The index points into the heap; without it, every slot would read garbage.
+        if (!std::filesystem::exists(heap_path, ec)) {
+            return fail("Storage heap is missing: " + heap_path);
+        }
+    } else if (!create_index(index_path, capacity, *index)) {
+        return fail("Failed to create storage index: " + index_path);
+    }
+
+    if (!map_file(heap_path, initial_heap_size, false, heap->mapping)) {
+        return fail("Failed to open storage heap: " + heap_path);
+    }
+    HeapHeader* header = heap_header(heap->mapping.base);
+    if (std::memcmp(header->magic, heap_magic, sizeof(heap_magic)) != 0) {
+        if (exists) {
+            return fail("Invalid storage heap: " + heap_path);
+        }
+        std::memcpy(header->magic, heap_magic, sizeof(heap_magic));
+        header->used = sizeof(HeapHeader);
+    } else if (header->used < sizeof(HeapHeader) || header->used > heap->mapping.size) {
+        return fail("Invalid storage heap: " + heap_path);
+    }
+
+    heap_.store(heap, std::memory_order_release);
+    index_.store(index, std::memory_order_release);
+    return true;
+}
+
+void MmapStore::close() {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    Index* index = index_.exchange(nullptr);
+    Heap* heap = heap_.exchange(nullptr);
+    if (index) {
+        retired_indexes_.push_back(index);
+    }
+    if (heap) {
+        retired_heaps_.push_back(heap);
+    }
+    for (Index* retired : retired_indexes_) {
+        msync(retired->mapping.base, retired->mapping.size, MS_SYNC);
+        munmap(retired->mapping.base, retired->mapping.size);
+        delete retired;
+    }
+    for (Heap* retired : retired_heaps_) {
+        msync(retired->mapping.base, retired->mapping.size, MS_SYNC);
+        munmap(retired->mapping.base, retired->mapping.size);
+        delete retired;
+    }
+    retired_indexes_.clear();
+    retired_heaps_.clear();
+}
+
+bool MmapStore::is_open() const {
+    return index_.load(std::memory_order_acquire) != nullptr;
+}
+
+bool MmapStore::healthy() {
+    return is_open();
+}
+
+uint64_t MmapStore::size() const {
+    Index* index = index_.load(std::memory_order_acquire);
+    return index ? __atomic_load_n(&index_header(index->mapping.base)->count, __ATOMIC_RELAXED) : 0;
+}
+
+std::string MmapStore::get(const ShortCode& short_code) {
+    Index* index = index_.load(std::memory_order_acquire);
+    if (!index || short_code.empty() || short_code.size() > max_code_length) {
+        return "";
+    }
+    char key[max_code_length];
+    pack_code(short_code, key);
+    CodeSlot* slots = code_slots(index->mapping.base);
+    uint64_t mask = index->capacity - 1;
+    uint64_t start = hash_bytes(short_code.data(), short_code.size());
+    for (uint64_t i = 0; i <= mask; ++i) {
+        CodeSlot* slot = &slots[(start + i) & mask];
+        uint64_t offset = load_offset(&slot->offset);
+        if (offset == empty_offset) {
+            return "";
+        }
+        if (offset == tombstone_offset || std::memcmp(slot->code, key, max_code_length) != 0) {
+            continue;
+        }
+        Heap* heap = heap_.load(std::memory_order_acquire);
+        std::string url;
+        if (record_has_code(heap->mapping.base, heap->mapping.size, offset, short_code) &&
+            read_record(heap->mapping.base, heap->mapping.size, offset, nullptr, &url)) {
+            return url;
+        }
+    }
+    return "";
+}
+
+ShortCode MmapStore::get_by_url(const std::string& url) {
+    Index* index = index_.load(std::memory_order_acquire);
+    return index ? find_by_url(index, url) : "";
+}
+
+std::string MmapStore::find_by_url(Index* index, const std::string& url) const {
+    UrlSlot* slots = url_slots(index->mapping.base, index->capacity);
+    uint64_t mask = index->capacity - 1;
+    uint64_t hash = hash_bytes(url.data(), url.size());
+    for (uint64_t i = 0; i <= mask; ++i) {
+        UrlSlot* slot = &slots[(hash + i) & mask];
+        uint64_t offset = load_offset(&slot->offset);
+        if (offset == empty_offset) {
+            return "";
+        }
+        if (offset == tombstone_offset || slot->hash != hash) {
+            continue;
+        }
+        Heap* heap = heap_.load(std::memory_order_acquire);
+        std::string short_code;
+        if (record_has_url(heap->mapping.base, heap->mapping.size, offset, url) &&
+            read_record(heap->mapping.base, heap->mapping.size, offset, &short_code, nullptr)) {
+            return short_code;
+        }
+    }
+    return "";
+}
+
+bool MmapStore::grow_heap(size_t needed) {
+    Heap* heap = heap_.load(std::memory_order_relaxed);
+    uint64_t used = heap_header(heap->mapping.base)->used;
+    if (used + needed <= heap->mapping.size) {
+        return true;
+    }
+    size_t size = heap->mapping.size;
+    while (used + needed > size) {
+        size *= 2;
+    }
+    auto* grown = new Heap();
+    if (!map_file((std::filesystem::path(dir_) / "heap.bin").string(), size, false, grown->mapping)) {
+        delete grown;
+        return false;
+    }
+    heap_.store(grown, std::memory_order_release);
+    retired_heaps_.push_back(heap);
+    return true;
+}
+
+uint64_t MmapStore::append_record(const ShortCode& short_code, const std::string& url) {
+    size_t needed = (sizeof(HeapRecord) + short_code.size() + url.size() + 7) & ~static_cast<size_t>(7);
+    if (!grow_heap(needed)) {
+        return empty_offset;
+    }
+    Heap* heap = heap_.load(std::memory_order_relaxed);
+    HeapHeader* header = heap_header(heap->mapping.base);
+    uint64_t offset = header->used;
+    HeapRecord record{};
+    record.url_length = static_cast<uint32_t>(url.size());
+    record.code_length = static_cast<uint8_t>(short_code.size());
+    uint8_t* out = heap->mapping.base + offset;
+    std::memcpy(out, &record, sizeof(record));
+    std::memcpy(out + sizeof(record), short_code.data(), short_code.size());
+    std::memcpy(out + sizeof(record) + short_code.size(), url.data(), url.size());
+    __atomic_store_n(&header->used, offset + needed, __ATOMIC_RELEASE);
+    return offset;
+}
+
+void MmapStore::publish(Index* index, uint64_t offset, const ShortCode& short_code, uint64_t url_hash) {
+    uint64_t mask = index->capacity - 1;
+    CodeSlot* codes = code_slots(index->mapping.base);
+    uint64_t code_start = hash_bytes(short_code.data(), short_code.size());
+    for (uint64_t i = 0; i <= mask; ++i) {
+        CodeSlot* slot = &codes[(code_start + i) & mask];
+        if (slot->offset == empty_offset) {
+            pack_code(short_code, slot->code);
+            store_offset(&slot->offset, offset);
+            break;
+        }
+    }
+    UrlSlot* urls = url_slots(index->mapping.base, index->capacity);
+    for (uint64_t i = 0; i <= mask; ++i) {
+        UrlSlot* slot = &urls[(url_hash + i) & mask];
+        if (slot->offset == empty_offset) {
+            slot->hash = url_hash;
+            store_offset(&slot->offset, offset);
+            break;
+        }
+    }
+    IndexHeader* header = index_header(index->mapping.base);
+    __atomic_store_n(&header->count, header->count + 1, __ATOMIC_RELAXED);
+    header->used += 1;
+}
+
+bool MmapStore::grow_index() {
+    Index* index = index_.load(std::memory_order_relaxed);
+    IndexHeader* header = index_header(index->mapping.base);
+    uint64_t capacity = index->capacity;
+    while (header->count * 10 >= capacity * 3) {
+        capacity <<= 1;
+    }
+
+    std::string path = (std::filesystem::path(dir_) / "index.bin").string();
+    std::string tmp_path = path + ".tmp";
+    auto* grown = new Index();
+    if (!create_index(tmp_path, capacity, *grown)) {
+        delete grown;
+        return false;
+    }
+    Heap* heap = heap_.load(std::memory_order_relaxed);
+    CodeSlot* slots = code_slots(index->mapping.base);
+    for (uint64_t i = 0; i < index->capacity; ++i) {
+        uint64_t offset = slots[i].offset;
+        std::string short_code;
+        std::string url;
+        if (offset != empty_offset && offset != tombstone_offset &&
+            read_record(heap->mapping.base, heap->mapping.size, offset, &short_code, &url)) {
+            publish(grown, offset, short_code, hash_bytes(url.data(), url.size()));
+        }
+    }
+    msync(grown->mapping.base, grown->mapping.size, MS_SYNC);
+    std::rename(tmp_path.c_str(), path.c_str());
+    index_.store(grown, std::memory_order_release);
+    retired_indexes_.push_back(index);
+    return true;
+}
+
+bool MmapStore::remove_locked(Index* index, const ShortCode& short_code) {
+    char key[max_code_length];
+    pack_code(short_code, key);
+    Heap* heap = heap_.load(std::memory_order_relaxed);
+    uint64_t mask = index->capacity - 1;
+    CodeSlot* codes = code_slots(index->mapping.base);
+    uint64_t start = hash_bytes(short_code.data(), short_code.size());
+    for (uint64_t i = 0; i <= mask; ++i) {
+        CodeSlot* slot = &codes[(start + i) & mask];
+        uint64_t offset = slot->offset;
+        if (offset == empty_offset) {
+            return false;
+        }
+        if (offset == tombstone_offset || std::memcmp(slot->code, key, max_code_length) != 0 ||
+            !record_has_code(heap->mapping.base, heap->mapping.size, offset, short_code)) {
+            continue;
+        }
+        std::string url;
+        read_record(heap->mapping.base, heap->mapping.size, offset, nullptr, &url);
+        store_offset(&slot->offset, tombstone_offset);
+
+        UrlSlot* urls = url_slots(index->mapping.base, index->capacity);
+        uint64_t url_hash = hash_bytes(url.data(), url.size());
+        for (uint64_t j = 0; j <= mask; ++j) {
+            UrlSlot* url_slot = &urls[(url_hash + j) & mask];
+            if (url_slot->offset == empty_offset) {
+                break;
+            }
+            if (url_slot->offset == offset) {
+                store_offset(&url_slot->offset, tombstone_offset);
+                break;
+            }
+        }
+        IndexHeader* header = index_header(index->mapping.base);
+        __atomic_store_n(&header->count, header->count - 1, __ATOMIC_RELAXED);
+        return true;
+    }
+    return false;
+}
+
+void MmapStore::insert(const ShortCode& short_code, const std::string& url) {
+    if (short_code.empty() || short_code.size() > max_code_length || url.size() > UINT32_MAX) {
+        std::cout << "Failed to insert URL" << std::endl;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    Index* index = index_.load(std::memory_order_relaxed);
+    if (!index) {
+        return;
+    }
+    remove_locked(index, short_code);
+    std::string previous_code = find_by_url(index, url);
+    if (!previous_code.empty()) {
+        remove_locked(index, previous_code);
+    }
+    append_locked(index, short_code, url);
+}
+
+bool MmapStore::insert_new(const ShortCode& short_code, const std::string& url) {
+    if (short_code.empty() || short_code.size() > max_code_length || url.size() > UINT32_MAX) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    Index* index = index_.load(std::memory_order_relaxed);
+    if (!index || !get(short_code).empty() || !find_by_url(index, url).empty()) {
+        return false;
+    }
+    return append_locked(index, short_code, url);
+}
+
+bool MmapStore::append_locked(Index* index, const ShortCode& short_code, const std::string& url) {
+    if ((index_header(index->mapping.base)->used + 1) * 10 > index->capacity * 6) {
+        if (!grow_index()) {
+            std::cout << "Failed to grow storage index" << std::endl;
+            return false;
+        }
+        index = index_.load(std::memory_order_relaxed);
+    }
+    uint64_t offset = append_record(short_code, url);
+    if (offset == empty_offset) {
+        std::cout << "Failed to insert URL" << std::endl;
+        return false;
+    }
+    publish(index, offset, short_code, hash_bytes(url.data(), url.size()));
+    return true;
+}
+
+void MmapStore::remove(const ShortCode& short_code) {
+    if (short_code.empty() || short_code.size() > max_code_length) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    Index* index = index_.load(std::memory_order_relaxed);
+    if (index) {
+        remove_locked(index, short_code);
+    }
+}
+
+void MmapStore::for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    Index* index = index_.load(std::memory_order_acquire);
+    if (!index) {
+        return;
+    }
+    CodeSlot* slots = code_slots(index->mapping.base);
+    for (uint64_t i = 0; i < index->capacity; ++i) {
+        uint64_t offset = load_offset(&slots[i].offset);
+        if (offset == empty_offset || offset == tombstone_offset) {
+            continue;
+        }
+        Heap* heap = heap_.load(std::memory_order_acquire);
+        std::string short_code;
+        std::string url;
+        if (read_record(heap->mapping.base, heap->mapping.size, offset, &short_code, &url)) {
+            callback(short_code, url);
+        }
+    }
+}
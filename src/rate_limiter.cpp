@@ -0,0 +1,158 @@
+#include "rate_limiter.hpp"
+#include "access_log.hpp"
+#include "clock.hpp"
+#include "handlers.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const uint64_t token_scale = 256;
+static const uint64_t token_mask = (1ULL << 24) - 1;
+
+const char* rate_limit_route_name(RateLimitRoute route) {
+    switch (route) {
+        case RateLimitRoute::Shorten: return "shorten";
+        case RateLimitRoute::Redirect: return "redirect";
+        case RateLimitRoute::Delete: return "delete";
+        default: return "none";
+    }
+}
+
+RateLimitRoute parse_rate_limit_route(const std::string& name) {
+    for (int i = 1; i < rate_limit_route_count; ++i) {
+        if (name == rate_limit_route_name(static_cast<RateLimitRoute>(i))) {
+            return static_cast<RateLimitRoute>(i);
+        }
+    }
+    return RateLimitRoute::None;
+}
+
+RateLimiter::RateLimiter(size_t capacity) {
+    size_t size = probe_window;
+    while (size < capacity) {
+        size *= 2;
+    }
+    slots_.reset(new Slot[size]);
+    mask_ = size - 1;
+}
+
+void RateLimiter::set_limit(RateLimitRoute route, double rate, double burst) {
+    rate_[static_cast<int>(route)] = std::max(0.0, rate);
+    burst_[static_cast<int>(route)] = std::min(std::max(1.0, burst), static_cast<double>(token_mask / token_scale));
+}
+
+bool RateLimiter::limited(RateLimitRoute route) const {
+    return route != RateLimitRoute::None && rate_[static_cast<int>(route)] > 0;
+}
+
+RateLimiter::Slot* RateLimiter::find_slot(uint64_t key, uint64_t now_ms) {
+    Slot* window = &slots_[(key & mask_) & ~static_cast<uint64_t>(probe_window - 1)];
+    for (size_t i = 0; i < probe_window; ++i) {
+        if (window[i].key.load(std::memory_order_acquire) == key) {
+            return &window[i];
+        }
+    }
+    for (size_t i = 0; i < probe_window; ++i) {
+        uint64_t expected = 0;
+        if (window[i].key.load(std::memory_order_relaxed) == 0 &&
+            window[i].key.compare_exchange_strong(expected, key, std::memory_order_acq_rel)) {
+            return &window[i];
+        }
+        if (expected == key) {
+            return &window[i];
+        }
+    }
+    Slot* oldest = &window[0];
+    uint64_t oldest_ms = now_ms;
+    for (size_t i = 0; i < probe_window; ++i) {
+        uint64_t updated_ms = window[i].state.load(std::memory_order_relaxed) >> 24;
+        if (updated_ms < oldest_ms) {
+            oldest = &window[i];
+            oldest_ms = updated_ms;
+        }
+    }
+    uint64_t victim = oldest->key.load(std::memory_order_relaxed);
+    if (!oldest->key.compare_exchange_strong(victim, key, std::memory_order_acq_rel)) {
+        return victim == key ? oldest : nullptr;
+    }
+    oldest->state.store(0, std::memory_order_release);
+    return oldest;
+}
+
+uint32_t RateLimiter::acquire(const std::string& client, RateLimitRoute route, uint64_t now_us) {
+    if (!limited(route)) {
+        return 0;
+    }
+    int index = static_cast<int>(route);
+    uint64_t key = std::hash<std::string>()(client) * 0x9e3779b97f4a7c15ULL + index;
+    key = key ? key : 1;
+    // Timestamps are kept relative to the first call so they fit the 40 bits left in state.
+    uint64_t origin = origin_ms_.load(std::memory_order_relaxed);
+    if (origin == 0) {
+        uint64_t expected = 0;
+        origin = origin_ms_.compare_exchange_strong(expected, now_us / 1000) ? now_us / 1000 : expected;
+    }
+    uint64_t now_ms = now_us / 1000 > origin ? now_us / 1000 - origin + 1 : 1;
+    Slot* slot = find_slot(key, now_ms);
+    if (!slot) {
+        // Lost a race for the last slot in the window; let the request through.
+        return 0;
+    }
+
+    double rate_per_ms = rate_[index] / 1000.0;
+    uint64_t burst = static_cast<uint64_t>(burst_[index] * token_scale);
+    uint64_t state = slot->state.load(std::memory_order_acquire);
+    while (true) {
+        uint64_t tokens = burst;
+        if (state != 0) {
+            uint64_t updated_ms = state >> 24;
+            uint64_t elapsed_ms = now_ms > updated_ms ? now_ms - updated_ms : 0;
+            tokens = std::min<uint64_t>(burst, (state & token_mask) + static_cast<uint64_t>(elapsed_ms * rate_per_ms * token_scale));
+        }
+        if (tokens < token_scale) {
+            return static_cast<uint32_t>(std::ceil((token_scale - tokens) / (rate_[index] * token_scale)));
+        }
+        uint64_t next = (now_ms << 24) | (tokens - token_scale);
+        if (slot->state.compare_exchange_weak(state, next, std::memory_order_acq_rel)) {
+            return 0;
+        }
+    }
+}
+
+RateLimitRoute classify_rate_limit_route(const crow::request& req) {
+    const std::string& url = req.url;
+    if (req.method == "POST"_method && url == "/shorten") {
+        return RateLimitRoute::Shorten;
+    }
+    if (url.compare(0, 8, "/delete/") == 0) {
+        return RateLimitRoute::Delete;
+    }
+    if (req.method == "GET"_method && url.size() > 1 && url.find('/', 1) == std::string::npos &&
+        url != "/healthz" && url != "/readyz") {
+        return RateLimitRoute::Redirect;
+    }
+    return RateLimitRoute::None;
+}
+
+void RateLimitMiddleware::before_handle(crow::request& req, crow::response& res, context&) {
+    if (!limiter) {
+        return;
+    }
+    RateLimitRoute route = classify_rate_limit_route(req);
+    if (!limiter->limited(route)) {
+        return;
+    }
+    std::string ip(client_ip(req));
+    uint32_t retry_after = limiter->acquire(ip, route, current_time_us());
+    if (retry_after == 0) {
+        return;
+    }
+    if (access_log_sampled(AccessEvent::RateLimited)) {
+        access_log(AccessEvent::RateLimited, 429, "", ip, req.get_header_value("User-Agent"));
+    }
+    res.code = 429;
+    res.set_header("Retry-After", std::to_string(retry_after));
+    res.body = "Too Many Requests";
+    res.end();
+}
+
+void RateLimitMiddleware::after_handle(crow::request&, crow::response&, context&) {}
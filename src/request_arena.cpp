@@ -0,0 +1,87 @@
+#include "request_arena.hpp"
+#include <atomic>
+#include <memory>
+
+static std::atomic<size_t> arena_size{16 * 1024};
+static std::atomic<uint64_t> requests{0};
+static std::atomic<uint64_t> overflows{0};
+static std::atomic<uint64_t> overflow_bytes{0};
+
+// Passes requests that outgrow the buffer on to the heap and counts them.
+class OverflowResource : public std::pmr::memory_resource {
+public:
+    size_t allocated = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        allocated += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+struct RequestArena {
+    explicit RequestArena(size_t size)
+        : size(size), buffer(new char[size]), resource(buffer.get(), size, &overflow) {}
+
+    size_t size;
+    std::unique_ptr<char[]> buffer;
+    OverflowResource overflow;
+    std::pmr::monotonic_buffer_resource resource;
+};
+
+static thread_local std::unique_ptr<RequestArena> arena;
+static thread_local bool active = false;
+
+void set_request_arena_size(size_t bytes) {
+    arena_size = bytes;
+}
+
+size_t request_arena_size() {
+    return arena_size;
+}
+
+void begin_request_arena() {
+    size_t size = arena_size.load(std::memory_order_relaxed);
+    if (size == 0) {
+        active = false;
+        return;
+    }
+    if (!arena || arena->size != size) {
+        arena = std::make_unique<RequestArena>(size);
+    }
+    active = true;
+}
+
+void end_request_arena() {
+    if (!active) {
+        return;
+    }
+    active = false;
+    requests.fetch_add(1, std::memory_order_relaxed);
+    if (arena->overflow.allocated > 0) {
+        overflows.fetch_add(1, std::memory_order_relaxed);
+        overflow_bytes.fetch_add(arena->overflow.allocated, std::memory_order_relaxed);
+        arena->overflow.allocated = 0;
+    }
+    arena->resource.release();
+}
+
+std::pmr::memory_resource* request_memory() {
+    return active ? &arena->resource : std::pmr::new_delete_resource();
+}
+
+RequestArenaStats request_arena_stats() {
+    RequestArenaStats stats;
+    stats.requests = requests.load(std::memory_order_relaxed);
+    stats.overflows = overflows.load(std::memory_order_relaxed);
+    stats.overflow_bytes = overflow_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,387 @@
+#include "sharded_store.hpp"
+#include "database.hpp"
+#include "deadline.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string_view>
+
+static uint64_t hash_key(std::string_view key) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static std::string query_text(sqlite3* handle, const char* sql, std::string_view key) {
+    sqlite3_stmt* stmt;
+    std::string value;
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+    return value;
+}
+
+static std::string read_text(sqlite3_stmt* stmt, std::string_view key) {
+    std::string value;
+    sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_reset(stmt);
+    return value;
+}
+
+static void write_pair(sqlite3_stmt* stmt, std::string_view first, std::string_view second) {
+    sqlite3_bind_text(stmt, 1, first.data(), static_cast<int>(first.size()), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, second.data(), static_cast<int>(second.size()), SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cout << "Failed to write shard: " << sqlite3_errmsg(sqlite3_db_handle(stmt)) << std::endl;
+    }
+    sqlite3_reset(stmt);
+}
+
+static void add_shard(std::vector<size_t>& shards, size_t shard) {
+    auto it = std::lower_bound(shards.begin(), shards.end(), shard);
+    if (it == shards.end() || *it != shard) {
+        shards.insert(it, shard);
+    }
+}
+
+static const char* select_url_sql = "SELECT url FROM urls WHERE short_code = ?;";
+static const char* select_route_sql = "SELECT short_code FROM url_routes WHERE url = ?;";
+
+ShardedSqliteStore::~ShardedSqliteStore() {
+    close();
+}
+
+bool ShardedSqliteStore::open(const std::string& dir, size_t shard_count, const std::string& journal_mode) {
+    close();
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec || shard_count == 0) {
+        std::cout << "Failed to create shard directory: " << dir << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        std::string path = (std::filesystem::path(dir) / ("shard-" + std::to_string(i) + ".db")).string();
+        auto shard = std::make_unique<Shard>();
+        if (sqlite3_open(path.c_str(), &shard->writer) != SQLITE_OK) {
+            std::cout << "Failed to open shard: " << path << std::endl;
+            sqlite3_close(shard->writer);
+            close();
+            return false;
+        }
+        set_journal_mode(shard->writer, journal_mode);
+        sqlite3_busy_timeout(shard->writer, 5000);
+        const char* sql = "CREATE TABLE IF NOT EXISTS urls (short_code TEXT PRIMARY KEY, url TEXT);"
+                          "CREATE TABLE IF NOT EXISTS url_routes (url TEXT PRIMARY KEY, short_code TEXT);"
+                          "CREATE TABLE IF NOT EXISTS shard_info (shard_count INTEGER NOT NULL);";
+        char* err_msg = nullptr;
+        if (sqlite3_exec(shard->writer, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+            std::cout << "Failed to create tables: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+        }
+        std::string stored;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(shard->writer, "SELECT shard_count FROM shard_info;", -1, &stmt, nullptr) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                stored = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            }
+            sqlite3_finalize(stmt);
+        }
+        if (stored.empty()) {
+            std::string insert_sql = "INSERT INTO shard_info (shard_count) VALUES (" + std::to_string(shard_count) + ");";
+            sqlite3_exec(shard->writer, insert_sql.c_str(), nullptr, nullptr, nullptr);
+        } else if (stored != std::to_string(shard_count)) {
+            // Codes would be routed to the wrong files; resharding needs an offline copy.
+            std::cout << "Shard count mismatch: " << path << " was created with " << stored << " shards" << std::endl;
+            sqlite3_close(shard->writer);
+            close();
+            return false;
+        }
+        if (sqlite3_open_v2(path.c_str(), &shard->reader, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+            std::cout << "Failed to open shard: " << path << std::endl;
+            sqlite3_close(shard->reader);
+            sqlite3_close(shard->writer);
+            close();
+            return false;
+        }
+        sqlite3_busy_timeout(shard->reader, 5000);
+        watch_deadline(shard->writer);
+        watch_deadline(shard->reader);
+        sqlite3_prepare_v2(shard->writer, select_url_sql, -1, &shard->select_url, nullptr);
+        sqlite3_prepare_v2(shard->writer, select_route_sql, -1, &shard->select_route, nullptr);
+        sqlite3_prepare_v2(shard->writer, "INSERT OR REPLACE INTO urls (short_code, url) VALUES (?, ?);", -1, &shard->upsert_url, nullptr);
+        sqlite3_prepare_v2(shard->writer, "INSERT OR REPLACE INTO url_routes (url, short_code) VALUES (?, ?);", -1, &shard->upsert_route, nullptr);
+        sqlite3_prepare_v2(shard->writer, "DELETE FROM urls WHERE short_code = ? AND url = ?;", -1, &shard->delete_url, nullptr);
+        sqlite3_prepare_v2(shard->writer, "DELETE FROM url_routes WHERE url = ? AND short_code = ?;", -1, &shard->delete_route, nullptr);
+        shards_.push_back(std::move(shard));
+    }
+    return true;
+}
+
+void ShardedSqliteStore::close() {
+    for (auto& shard : shards_) {
+        for (sqlite3_stmt* stmt : {shard->select_url, shard->select_route, shard->upsert_url, shard->upsert_route, shard->delete_url, shard->delete_route}) {
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(shard->reader);
+        sqlite3_close(shard->writer);
+    }
+    shards_.clear();
+}
+
+size_t ShardedSqliteStore::shard_count() const {
+    return shards_.size();
+}
+
+size_t ShardedSqliteStore::shard_for_code(const ShortCode& short_code) const {
+    return hash_key(short_code.view()) % shards_.size();
+}
+
+size_t ShardedSqliteStore::shard_for_url(const std::string& url) const {
+    return hash_key(url) % shards_.size();
+}
+
+// Shards are always locked in ascending order so writers touching overlapping shards
+// cannot deadlock; callers pass a sorted, duplicate-free list.
+std::vector<std::unique_lock<std::mutex>> ShardedSqliteStore::lock_shards(const std::vector<size_t>& shards) {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (size_t shard : shards) {
+        locks.emplace_back(shards_[shard]->write_mutex);
+    }
+    return locks;
+}
+
+void ShardedSqliteStore::begin(const std::vector<size_t>& shards) {
+    for (size_t shard : shards) {
+        sqlite3_exec(shards_[shard]->writer, "BEGIN;", nullptr, nullptr, nullptr);
+    }
+}
+
+void ShardedSqliteStore::commit(const std::vector<size_t>& shards) {
+    for (size_t shard : shards) {
+        sqlite3_exec(shards_[shard]->writer, "COMMIT;", nullptr, nullptr, nullptr);
+    }
+}
+
+// Caller holds the locks of the code's shard, the URL's shard and the shards of the
+// mappings being replaced.
+void ShardedSqliteStore::insert_locked(const ShortCode& short_code, const std::string& url) {
+    Shard& code_shard = *shards_[shard_for_code(short_code)];
+    Shard& url_shard = *shards_[shard_for_url(url)];
+    std::string previous_url = read_text(code_shard.select_url, short_code.view());
+    std::string previous_code = read_text(url_shard.select_route, url);
+    if (!previous_url.empty() && previous_url != url) {
+        write_pair(shards_[shard_for_url(previous_url)]->delete_route, previous_url, short_code.view());
+    }
+    if (!previous_code.empty() && previous_code != short_code) {
+        write_pair(shards_[shard_for_code(previous_code)]->delete_url, previous_code, url);
+    }
+    write_pair(code_shard.upsert_url, short_code.view(), url);
+    write_pair(url_shard.upsert_route, url, short_code.view());
+}
+
+void ShardedSqliteStore::remove_locked(const ShortCode& short_code, const std::string& url) {
+    write_pair(shards_[shard_for_code(short_code)]->delete_url, short_code.view(), url);
+    write_pair(shards_[shard_for_url(url)]->delete_route, url, short_code.view());
+}
+
+void ShardedSqliteStore::insert(const ShortCode& short_code, const std::string& url) {
+    if (shards_.empty()) {
+        return;
+    }
+    std::vector<size_t> shards;
+    add_shard(shards, shard_for_code(short_code));
+    add_shard(shards, shard_for_url(url));
+    // Usually only the code's and the URL's shards are needed. Replacing a mapping also
+    // touches the shards of the old code or URL; if those are not held, start over with
+    // them included rather than locking out of order.
+    while (true) {
+        auto locks = lock_shards(shards);
+        std::string previous_url = read_text(shards_[shard_for_code(short_code)]->select_url, short_code.view());
+        std::string previous_code = read_text(shards_[shard_for_url(url)]->select_route, url);
+        size_t held = shards.size();
+        if (!previous_url.empty()) {
+            add_shard(shards, shard_for_url(previous_url));
+        }
+        if (!previous_code.empty()) {
+            add_shard(shards, shard_for_code(previous_code));
+        }
+        if (shards.size() == held) {
+            // One commit per shard touched, even when the code and URL share a shard.
+            begin(shards);
+            insert_locked(short_code, url);
+            commit(shards);
+            return;
+        }
+    }
+}
+
+bool ShardedSqliteStore::insert_new(const ShortCode& short_code, const std::string& url) {
+    if (shards_.empty()) {
+        return false;
+    }
+    // Nothing is replaced, so the code's and the URL's shards are all that is locked.
+    std::vector<size_t> shards;
+    add_shard(shards, shard_for_code(short_code));
+    add_shard(shards, shard_for_url(url));
+    auto locks = lock_shards(shards);
+    if (!read_text(shards_[shard_for_code(short_code)]->select_url, short_code.view()).empty()) {
+        return false;
+    }
+    // A route left behind by an interrupted insert does not count, as in get_by_url().
+    std::string routed_code = read_text(shards_[shard_for_url(url)]->select_route, url);
+    if (!routed_code.empty() && get(routed_code) == url) {
+        return false;
+    }
+    begin(shards);
+    insert_locked(short_code, url);
+    commit(shards);
+    return true;
+}
+
+std::string ShardedSqliteStore::get(const ShortCode& short_code) {
+    if (shards_.empty()) {
+        return "";
+    }
+    return query_text(shards_[shard_for_code(short_code)]->reader, select_url_sql, short_code.view());
+}
+
+ShortCode ShardedSqliteStore::get_by_url(const std::string& url) {
+    if (shards_.empty()) {
+        return "";
+    }
+    std::string short_code = query_text(shards_[shard_for_url(url)]->reader, select_route_sql, url);
+    // The route and the mapping are written to different files; only trust a route whose
+    // mapping agrees, so an insert interrupted between the two writes is never returned.
+    if (short_code.empty() || get(short_code) != url) {
+        return "";
+    }
+    return short_code;
+}
+
+void ShardedSqliteStore::remove(const ShortCode& short_code) {
+    if (shards_.empty()) {
+        return;
+    }
+    std::vector<size_t> shards = {shard_for_code(short_code)};
+    while (true) {
+        auto locks = lock_shards(shards);
+        std::string url = read_text(shards_[shard_for_code(short_code)]->select_url, short_code.view());
+        if (url.empty()) {
+            return;
+        }
+        size_t held = shards.size();
+        add_shard(shards, shard_for_url(url));
+        if (shards.size() == held) {
+            begin(shards);
+            remove_locked(short_code, url);
+            commit(shards);
+            return;
+        }
+    }
+}
+
+void ShardedSqliteStore::for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    for (auto& shard : shards_) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(shard->reader, "SELECT short_code, url FROM urls;", -1, &stmt, nullptr) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                callback(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                         reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+}
+
+void ShardedSqliteStore::for_each_with_prefix(const std::string& prefix,
+                                              const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    std::string bound = prefix_upper_bound(prefix);
+    const char* sql = bound.empty() ? "SELECT url, short_code FROM url_routes WHERE url >= ?;"
+                                    : "SELECT url, short_code FROM url_routes WHERE url >= ? AND url < ?;";
+    for (auto& shard : shards_) {
+        std::vector<std::pair<std::string, std::string>> routes;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(shard->reader, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            continue;
+        }
+        sqlite3_bind_text(stmt, 1, prefix.c_str(), -1, SQLITE_STATIC);
+        if (!bound.empty()) {
+            sqlite3_bind_text(stmt, 2, bound.c_str(), -1, SQLITE_STATIC);
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            routes.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+        }
+        sqlite3_finalize(stmt);
+        // Same check as get_by_url: a route counts only if its mapping agrees.
+        for (const auto& route : routes) {
+            if (get(route.second) == route.first) {
+                callback(route.second, route.first);
+            }
+        }
+    }
+}
+
+bool ShardedSqliteStore::has_url_index() {
+    return true;
+}
+
+void ShardedSqliteStore::insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) {
+    std::vector<size_t> all(shards_.size());
+    for (size_t i = 0; i < all.size(); ++i) {
+        all[i] = i;
+    }
+    auto locks = lock_shards(all);
+    begin(all);
+    for (const auto& entry : entries) {
+        insert_locked(entry.first, entry.second);
+    }
+    commit(all);
+}
+
+void ShardedSqliteStore::remove_batch(const std::vector<ShortCode>& short_codes) {
+    std::vector<size_t> all(shards_.size());
+    for (size_t i = 0; i < all.size(); ++i) {
+        all[i] = i;
+    }
+    auto locks = lock_shards(all);
+    begin(all);
+    for (const auto& short_code : short_codes) {
+        std::string url = read_text(shards_[shard_for_code(short_code)]->select_url, short_code.view());
+        if (!url.empty()) {
+            remove_locked(short_code, url);
+        }
+    }
+    commit(all);
+}
+
+bool ShardedSqliteStore::healthy() {
+    if (shards_.empty()) {
+        return false;
+    }
+    for (auto& shard : shards_) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(shard->reader, "SELECT 1 FROM urls LIMIT 1;", -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,134 @@
+#include "shutdown.hpp"
+#include "deadline.hpp"
+#include "logger.hpp"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// Requests can come back to back on keep-alive connections; drained means idle this long.
+static const uint64_t drain_quiet_us = 50000;
+
+static std::atomic<size_t> in_flight{0};
+static std::atomic<uint64_t> last_finished_us{0};
+static std::atomic<bool> draining{false};
+
+void request_started() {
+    in_flight.fetch_add(1);
+}
+
+void request_finished() {
+    last_finished_us = steady_time_us();
+    in_flight.fetch_sub(1);
+}
+
+size_t requests_in_flight() {
+    return in_flight.load();
+}
+
+bool shutdown_draining() {
+    return draining.load();
+}
+
+void reset_shutdown() {
+    draining = false;
+    last_finished_us = 0;
+}
+
+int listening_socket(uint16_t port) {
+    DIR* dir = opendir("/proc/self/fd");
+    if (!dir) {
+        return -1;
+    }
+    int found = -1;
+    while (dirent* entry = readdir(dir)) {
+        int fd = std::atoi(entry->d_name);
+        if (entry->d_name[0] == '.' || fd == dirfd(dir)) {
+            continue;
+        }
+        int listening = 0;
+        socklen_t length = sizeof(listening);
+        if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) != 0 || !listening) {
+            continue;
+        }
+        sockaddr_storage address;
+        length = sizeof(address);
+        if (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            continue;
+        }
+        uint16_t bound = 0;
+        if (address.ss_family == AF_INET) {
+            bound = ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+        } else if (address.ss_family == AF_INET6) {
+            bound = ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port);
+        }
+        if (bound == port) {
+            found = fd;
+            break;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+// Crow can only stop accepting together with stopping every connection. Putting an unbound
+// socket in place of the listening one closes the port while the descriptor number stays
+// valid for Crow to close later; the pending accept simply never completes.
+static bool stop_accepting(uint16_t port) {
+    int fd = listening_socket(port);
+    if (fd < 0) {
+        return false;
+    }
+    int placeholder = socket(AF_INET, SOCK_STREAM, 0);
+    if (placeholder < 0) {
+        return false;
+    }
+    bool replaced = dup2(placeholder, fd) == fd;
+    close(placeholder);
+    return replaced;
+}
+
+bool drain_requests(uint16_t port, int timeout_ms) {
+    draining = true;
+    if (!stop_accepting(port)) {
+        log("Failed to stop accepting on port " + std::to_string(port), "WARN");
+    }
+    uint64_t deadline = steady_time_us() + static_cast<uint64_t>(timeout_ms) * 1000;
+    while (true) {
+        uint64_t now = steady_time_us();
+        if (in_flight.load() == 0 && now - last_finished_us.load() >= drain_quiet_us) {
+            return true;
+        }
+        if (now >= deadline) {
+            log("Drain timed out with " + std::to_string(in_flight.load()) + " requests in flight", "WARN");
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+static sigset_t shutdown_signals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    return signals;
+}
+
+void block_shutdown_signals() {
+    sigset_t signals = shutdown_signals();
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+}
+
+int wait_for_shutdown_signal() {
+    sigset_t signals = shutdown_signals();
+    int signal_number = 0;
+    sigwait(&signals, &signal_number);
+    return signal_number;
+}
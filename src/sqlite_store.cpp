@@ -0,0 +1,211 @@
+#include "sqlite_store.hpp"
+#include "deadline.hpp"
+#include <iostream>
+
+SqliteStore::SqliteStore(sqlite3* handle) : handle_(handle) {
+    const char* sql = "CREATE TABLE IF NOT EXISTS urls (short_code TEXT PRIMARY KEY, url TEXT); CREATE UNIQUE INDEX IF NOT EXISTS idx_url ON urls(url);";
+    char* err_msg = nullptr;
+    if (sqlite3_exec(handle_, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cout << "Failed to create tables: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+    }
+    watch_deadline(handle_);
+}
+
+SqliteStore::~SqliteStore() {
+    sqlite3_close(batch_handle_);
+}
+
+void SqliteStore::insert(const ShortCode& short_code, const std::string& url) {
+    const char* sql = "INSERT OR REPLACE INTO urls (short_code, url) VALUES (?, ?);";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, short_code.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, url.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cout << "Failed to insert URL" << std::endl;
+        }
+        sqlite3_finalize(stmt);
+    }
+}
+
+bool SqliteStore::insert_new(const ShortCode& short_code, const std::string& url) {
+    // Without OR REPLACE the primary key and the unique URL index reject the row if either is taken.
+    const char* sql = "INSERT INTO urls (short_code, url) VALUES (?, ?);";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, short_code.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, url.c_str(), -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE && (rc & 0xFF) != SQLITE_CONSTRAINT) {
+        std::cout << "Failed to insert URL" << std::endl;
+    }
+    return rc == SQLITE_DONE;
+}
+
+std::string SqliteStore::get(const ShortCode& short_code) {
+    const char* sql = "SELECT url FROM urls WHERE short_code = ?;";
+    sqlite3_stmt* stmt;
+    std::string url;
+    if (sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, short_code.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            url = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+    return url;
+}
+
+ShortCode SqliteStore::get_by_url(const std::string& url) {
+    const char* sql = "SELECT short_code FROM urls WHERE url = ?;";
+    sqlite3_stmt* stmt;
+    ShortCode short_code;
+    if (sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, url.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            short_code = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+    return short_code;
+}
+
+void SqliteStore::remove(const ShortCode& short_code) {
+    const char* sql = "DELETE FROM urls WHERE short_code = ?;";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, short_code.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cout << "Failed to delete URL" << std::endl;
+        }
+        sqlite3_finalize(stmt);
+    }
+}
+
+void SqliteStore::for_each(const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    const char* sql = "SELECT short_code, url FROM urls;";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            callback(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                     reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+        }
+        sqlite3_finalize(stmt);
+    }
+}
+
+sqlite3* SqliteStore::batch_handle() {
+    const char* path = sqlite3_db_filename(handle_, "main");
+    if (path == nullptr || *path == '\0') {
+        return handle_;
+    }
+    if (!batch_handle_) {
+        if (sqlite3_open_v2(path, &batch_handle_, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+            std::cout << "Failed to open batch connection: " << path << std::endl;
+            sqlite3_close(batch_handle_);
+            batch_handle_ = nullptr;
+            return nullptr;
+        }
+        watch_deadline(batch_handle_);
+    }
+    return batch_handle_;
+}
+
+bool SqliteStore::run_batch(const char* sql, size_t count, const std::function<void(sqlite3_stmt*, size_t)>& bind) {
+    std::lock_guard<std::mutex> lock(batch_mutex_);
+    sqlite3* handle = batch_handle();
+    sqlite3_stmt* stmt;
+    if (!handle || sqlite3_prepare_v2(handle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    bool ok = sqlite3_exec(handle, "SAVEPOINT batch;", nullptr, nullptr, nullptr) == SQLITE_OK;
+    if (!ok) {
+        sqlite3_finalize(stmt);
+        std::cout << "Failed to begin batch: " << sqlite3_errmsg(handle) << std::endl;
+        return false;
+    }
+    for (size_t i = 0; ok && i < count; ++i) {
+        bind(stmt, i);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (ok && sqlite3_exec(handle, "RELEASE batch;", nullptr, nullptr, nullptr) == SQLITE_OK) {
+        return true;
+    }
+    std::cout << "Failed to write batch: " << sqlite3_errmsg(handle) << std::endl;
+    sqlite3_exec(handle, "ROLLBACK TO batch;", nullptr, nullptr, nullptr);
+    sqlite3_exec(handle, "RELEASE batch;", nullptr, nullptr, nullptr);
+    return false;
+}
+
+void SqliteStore::insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) {
+    run_batch("INSERT OR REPLACE INTO urls (short_code, url) VALUES (?, ?);", entries.size(),
+              [&entries](sqlite3_stmt* stmt, size_t i) {
+                  sqlite3_bind_text(stmt, 1, entries[i].first.c_str(), -1, SQLITE_STATIC);
+                  sqlite3_bind_text(stmt, 2, entries[i].second.c_str(), -1, SQLITE_STATIC);
+              });
+}
+
+std::vector<std::string> SqliteStore::get_batch(const std::vector<ShortCode>& short_codes) {
+    std::vector<std::string> urls(short_codes.size());
+    const char* sql = "SELECT url FROM urls WHERE short_code = ?;";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return urls;
+    }
+    for (size_t i = 0; i < short_codes.size(); ++i) {
+        sqlite3_bind_text(stmt, 1, short_codes[i].c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            urls[i] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return urls;
+}
+
+void SqliteStore::remove_batch(const std::vector<ShortCode>& short_codes) {
+    run_batch("DELETE FROM urls WHERE short_code = ?;", short_codes.size(), [&short_codes](sqlite3_stmt* stmt, size_t i) {
+        sqlite3_bind_text(stmt, 1, short_codes[i].c_str(), -1, SQLITE_STATIC);
+    });
+}
+
+bool SqliteStore::healthy() {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, "SELECT 1 FROM urls LIMIT 1;", -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_ROW || rc == SQLITE_DONE;
+}
+
+void SqliteStore::for_each_with_prefix(const std::string& prefix,
+                                       const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    // A range on idx_url instead of LIKE, which cannot use the index under the default collation.
+    std::string bound = prefix_upper_bound(prefix);
+    const char* sql = bound.empty() ? "SELECT short_code, url FROM urls WHERE url >= ?;"
+                                    : "SELECT short_code, url FROM urls WHERE url >= ? AND url < ?;";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return;
+    }
+    sqlite3_bind_text(stmt, 1, prefix.c_str(), -1, SQLITE_STATIC);
+    if (!bound.empty()) {
+        sqlite3_bind_text(stmt, 2, bound.c_str(), -1, SQLITE_STATIC);
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        callback(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                 reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+    }
+    sqlite3_finalize(stmt);
+}
+
+bool SqliteStore::has_url_index() {
+    return true;
+}
@@ -0,0 +1,307 @@
+#include "url_canon.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define URL_SCAN_X86 1
+#endif
+
+// Bytes a scan passes over unchanged. Everything else stops it: uppercase host letters are
+// lowercased, host delimiters end the host, '%' and non-ASCII bytes are rewritten, and the
+// rest makes the URL invalid.
+enum : unsigned char {
+    HostByte = 1,
+    PathByte = 2,
+};
+
+struct UrlByteClasses {
+    unsigned char classes[256] = {};
+    constexpr UrlByteClasses() {
+        for (int c = 0x21; c < 0x7F; ++c) {
+            classes[c] = PathByte;
+        }
+        classes[static_cast<unsigned char>('%')] = 0;
+        for (int c = 'a'; c <= 'z'; ++c) {
+            classes[c] |= HostByte;
+        }
+        for (int c = '0'; c <= '9'; ++c) {
+            classes[c] |= HostByte;
+        }
+        classes[static_cast<unsigned char>('.')] |= HostByte;
+        classes[static_cast<unsigned char>('-')] |= HostByte;
+        classes[static_cast<unsigned char>('_')] |= HostByte;
+    }
+};
+
+static constexpr UrlByteClasses url_bytes;
+
+// Each scan returns the offset of the first byte outside its class, or n.
+static size_t scan_host_scalar(const char* p, size_t n) {
+    size_t i = 0;
+    while (i < n && (url_bytes.classes[static_cast<unsigned char>(p[i])] & HostByte)) {
+        ++i;
+    }
+    return i;
+}
+
+static size_t scan_path_scalar(const char* p, size_t n) {
+    size_t i = 0;
+    while (i < n && (url_bytes.classes[static_cast<unsigned char>(p[i])] & PathByte)) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef URL_SCAN_X86
+// PCMPESTRI range mode: the index of the first byte that falls in none of the ranges.
+static const int range_mode = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT;
+
+__attribute__((target("sse4.2")))
+static size_t scan_host_sse42(const char* p, size_t n) {
+    const __m128i ranges = _mm_setr_epi8('a', 'z', '0', '9', '.', '.', '-', '-', '_', '_', 0, 0, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        int index = _mm_cmpestri(ranges, 10, block, 16, range_mode);
+        if (index < 16) {
+            return i + index;
+        }
+    }
+    return i + scan_host_scalar(p + i, n - i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t scan_path_sse42(const char* p, size_t n) {
+    const __m128i ranges = _mm_setr_epi8('!', '$', '&', '~', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        int index = _mm_cmpestri(ranges, 4, block, 16, range_mode);
+        if (index < 16) {
+            return i + index;
+        }
+    }
+    return i + scan_path_scalar(p + i, n - i);
+}
+
+// Signed byte compares: bytes of 0x80 and up are negative, so they fail every range below.
+__attribute__((target("avx2")))
+static inline __m256i in_range_avx2(__m256i v, char low, char high) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(static_cast<char>(low - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(high + 1)), v));
+}
+
+__attribute__((target("avx2")))
+static size_t scan_host_avx2(const char* p, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i ok = _mm256_or_si256(in_range_avx2(v, 'a', 'z'), in_range_avx2(v, '0', '9'));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        uint32_t stops = ~static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+        if (stops != 0) {
+            return i + __builtin_ctz(stops);
+        }
+    }
+    return i + scan_host_scalar(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_path_avx2(const char* p, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('%')), in_range_avx2(v, '!', '~'));
+        uint32_t stops = ~static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+        if (stops != 0) {
+            return i + __builtin_ctz(stops);
+        }
+    }
+    return i + scan_path_scalar(p + i, n - i);
+}
+#endif
+
+struct UrlScanners {
+    size_t (*host)(const char*, size_t);
+    size_t (*path)(const char*, size_t);
+};
+
+static const UrlScanners scanners[] = {
+    {scan_host_scalar, scan_path_scalar},
+#ifdef URL_SCAN_X86
+    {scan_host_sse42, scan_path_sse42},
+    {scan_host_avx2, scan_path_avx2},
+#endif
+};
+
+UrlScanLevel supported_url_scan_level() {
+#ifdef URL_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return UrlScanLevel::Avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return UrlScanLevel::Sse42;
+    }
+#endif
+    return UrlScanLevel::Scalar;
+}
+
+static std::atomic<int> active_level{static_cast<int>(supported_url_scan_level())};
+
+UrlScanLevel url_scan_level() {
+    return static_cast<UrlScanLevel>(active_level.load(std::memory_order_relaxed));
+}
+
+void set_url_scan_level(UrlScanLevel level) {
+    int supported = static_cast<int>(supported_url_scan_level());
+    active_level.store(std::min(static_cast<int>(level), supported), std::memory_order_relaxed);
+}
+
+const char* url_scan_level_name(UrlScanLevel level) {
+    switch (level) {
+        case UrlScanLevel::Avx2: return "avx2";
+        case UrlScanLevel::Sse42: return "sse4.2";
+        default: return "scalar";
+    }
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool unreserved(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+static void append_escape(unsigned char c, std::string& out) {
+    static const char hex[] = "0123456789ABCDEF";
+    out += '%';
+    out += hex[c >> 4];
+    out += hex[c & 0xF];
+}
+
+static bool scheme_is(std::string_view scheme, std::string_view lower) {
+    if (scheme.size() != lower.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < scheme.size(); ++i) {
+        if ((scheme[i] | 0x20) != lower[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool canonicalize_url(std::string_view url, std::string& out) {
+    out.clear();
+    if (url.size() < 5) {
+        return false;
+    }
+    size_t pos = url[4] == ':' ? 4 : 5;
+    if (url.size() < pos + 3 || url.compare(pos, 3, "://") != 0) {
+        return false;
+    }
+    bool https = pos == 5;
+    if (!scheme_is(url.substr(0, pos), https ? "https" : "http")) {
+        return false;
+    }
+    const UrlScanners& scan = scanners[active_level.load(std::memory_order_relaxed)];
+    const char* data = url.data();
+    size_t n = url.size();
+    out.reserve(n + 1);
+    out.append(https ? "https://" : "http://");
+    pos += 3;
+
+    size_t host_start = out.size();
+    if (pos < n && url[pos] == '[') {
+        size_t end = url.find(']', pos);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        for (; pos <= end; ++pos) {
+            char c = url[pos];
+            if (hex_digit(c) < 0 && c != ':' && c != '.' && c != '[' && c != ']') {
+                return false;
+            }
+            out += static_cast<char>(c >= 'A' && c <= 'F' ? c + 32 : c);
+        }
+    } else {
+        while (pos < n) {
+            size_t run = scan.host(data + pos, n - pos);
+            out.append(data + pos, run);
+            pos += run;
+            if (pos < n && url[pos] >= 'A' && url[pos] <= 'Z') {
+                out += static_cast<char>(url[pos++] + 32);
+                continue;
+            }
+            break;
+        }
+    }
+    if (out.size() == host_start) {
+        return false;
+    }
+
+    if (pos < n && url[pos] == ':') {
+        size_t start = ++pos;
+        unsigned port = 0;
+        while (pos < n && url[pos] >= '0' && url[pos] <= '9') {
+            port = port * 10 + (url[pos++] - '0');
+            if (port > 65535) {
+                return false;
+            }
+        }
+        if (pos > start) {
+            if (port == 0) {
+                return false;
+            }
+            if (port != (https ? 443u : 80u)) {
+                out += ':';
+                out += std::to_string(port);
+            }
+        }
+    }
+    if (pos < n && url[pos] != '/' && url[pos] != '?' && url[pos] != '#') {
+        return false;
+    }
+    if (pos == n || url[pos] != '/') {
+        out += '/';
+    }
+
+    while (pos < n) {
+        size_t run = scan.path(data + pos, n - pos);
+        out.append(data + pos, run);
+        pos += run;
+        if (pos == n) {
+            break;
+        }
+        unsigned char c = static_cast<unsigned char>(url[pos]);
+        if (c == '%') {
+            int high = pos + 2 < n ? hex_digit(url[pos + 1]) : -1;
+            int low = pos + 2 < n ? hex_digit(url[pos + 2]) : -1;
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            unsigned char decoded = static_cast<unsigned char>(high << 4 | low);
+            if (unreserved(decoded)) {
+                out += static_cast<char>(decoded);
+            } else {
+                append_escape(decoded, out);
+            }
+            pos += 3;
+        } else if (c >= 0x80) {
+            append_escape(c, out);
+            ++pos;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,225 @@
+#include "url_dictionary.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <unordered_map>
+
+// Encoded values start with marker. Token codes are the control bytes after it and all bytes
+// from 0x80; a literal byte from that range is written after escape.
+static const char marker = 0x02;
+static const char escape = 0x01;
+static const char* const file_header = "url_dictionary 1";
+
+// Fragments are joined from up to this many adjacent pieces.
+static const size_t max_pieces = 4;
+static const size_t min_token_length = 3;
+static const size_t max_token_length = 64;
+
+static unsigned char code_for_token(size_t id) {
+    return static_cast<unsigned char>(id < 29 ? 0x03 + id : 0x80 + (id - 29));
+}
+
+static bool needs_escape(unsigned char c) {
+    return c < 0x20 || c >= 0x80;
+}
+
+static bool printable(std::string_view text) {
+    for (char c : text) {
+        if (c <= 0x20 || c >= 0x7F) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Splits a URL into the scheme ("https://") and pieces that start at a '/', '?', '&', '#' or
+// '.'. A piece ends at the next delimiter but keeps a closing '=', so query keys come out as
+// "&utm_source=" and their values as separate pieces.
+static std::vector<std::string_view> split_pieces(std::string_view url) {
+    std::vector<std::string_view> pieces;
+    size_t start = 0;
+    size_t scheme_end = url.find("://");
+    if (scheme_end != std::string_view::npos) {
+        start = scheme_end + 3;
+        pieces.push_back(url.substr(0, start));
+    }
+    size_t pos = start;
+    while (pos < url.size()) {
+        size_t end = url.find_first_of("/?&#.=", pos + 1);
+        if (end == std::string_view::npos) {
+            end = url.size();
+        } else if (url[end] == '=') {
+            ++end;
+        }
+        pieces.push_back(url.substr(pos, end - pos));
+        pos = end;
+    }
+    return pieces;
+}
+
+UrlDictionary UrlDictionary::train(const std::vector<std::string>& urls) {
+    std::unordered_map<std::string_view, size_t> counts;
+    for (const auto& url : urls) {
+        auto pieces = split_pieces(url);
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            const char* begin = pieces[i].data();
+            for (size_t k = i; k < pieces.size() && k < i + max_pieces; ++k) {
+                size_t length = pieces[k].data() + pieces[k].size() - begin;
+                if (length > max_token_length) {
+                    break;
+                }
+                if (length >= min_token_length) {
+                    ++counts[std::string_view(begin, length)];
+                }
+            }
+        }
+    }
+
+    std::vector<std::pair<size_t, std::string_view>> candidates;
+    for (const auto& entry : counts) {
+        if (entry.second > 1 && printable(entry.first)) {
+            candidates.emplace_back(entry.second * (entry.first.size() - 1), entry.first);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    UrlDictionary dictionary;
+    std::vector<size_t> chosen_counts;
+    for (const auto& candidate : candidates) {
+        if (dictionary.tokens_.size() == max_tokens) {
+            break;
+        }
+        size_t count = counts[candidate.second];
+        // A fragment that almost only occurs inside a longer chosen token saves nothing more.
+        bool covered = false;
+        for (size_t i = 0; i < dictionary.tokens_.size() && !covered; ++i) {
+            covered = count * 10 <= chosen_counts[i] * 11 &&
+                      dictionary.tokens_[i].find(candidate.second) != std::string::npos;
+        }
+        if (!covered) {
+            dictionary.tokens_.emplace_back(candidate.second);
+            chosen_counts.push_back(count);
+        }
+    }
+    dictionary.index();
+    return dictionary;
+}
+
+void UrlDictionary::index() {
+    for (auto& ids : by_first_) {
+        ids.clear();
+    }
+    std::fill(std::begin(token_for_code_), std::end(token_for_code_), -1);
+    for (size_t id = 0; id < tokens_.size(); ++id) {
+        by_first_[static_cast<unsigned char>(tokens_[id][0])].push_back(static_cast<uint8_t>(id));
+        token_for_code_[code_for_token(id)] = static_cast<int16_t>(id);
+    }
+    for (auto& ids : by_first_) {
+        std::stable_sort(ids.begin(), ids.end(), [this](uint8_t a, uint8_t b) {
+            return tokens_[a].size() > tokens_[b].size();
+        });
+    }
+}
+
+bool UrlDictionary::load(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != file_header) {
+        return false;
+    }
+    tokens_.clear();
+    while (std::getline(file, line) && tokens_.size() < max_tokens) {
+        if (!line.empty()) {
+            tokens_.push_back(line);
+        }
+    }
+    index();
+    return true;
+}
+
+bool UrlDictionary::save(const std::string& path) const {
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file << file_header << '\n';
+        for (const auto& token : tokens_) {
+            file << token << '\n';
+        }
+        if (!file.good()) {
+            return false;
+        }
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool UrlDictionary::is_encoded(const std::string& value) {
+    return !value.empty() && value[0] == marker;
+}
+
+std::string UrlDictionary::encode(const std::string& url) const {
+    if (tokens_.empty()) {
+        return url;
+    }
+    std::string out;
+    out.reserve(url.size() + 1);
+    out += marker;
+    size_t n = url.size();
+    for (size_t i = 0; i < n;) {
+        unsigned char c = static_cast<unsigned char>(url[i]);
+        bool matched = false;
+        for (uint8_t id : by_first_[c]) {
+            const std::string& token = tokens_[id];
+            if (token.size() <= n - i && std::memcmp(url.data() + i, token.data(), token.size()) == 0) {
+                out += static_cast<char>(code_for_token(id));
+                i += token.size();
+                matched = true;
+                break;
+            }
+        }
+        if (!matched) {
+            if (needs_escape(c)) {
+                out += escape;
+            }
+            out += static_cast<char>(c);
+            ++i;
+        }
+    }
+    return out.size() < url.size() ? out : url;
+}
+
+std::string UrlDictionary::decode(const std::string& value) const {
+    if (!is_encoded(value)) {
+        return value;
+    }
+    // Sized first, so the output is allocated once.
+    size_t length = 0;
+    for (size_t i = 1; i < value.size(); ++i) {
+        int id = token_for_code_[static_cast<unsigned char>(value[i])];
+        if (id >= 0) {
+            length += tokens_[id].size();
+        } else {
+            i += value[i] == escape && i + 1 < value.size();
+            ++length;
+        }
+    }
+    std::string out(length, '\0');
+    char* dest = &out[0];
+    for (size_t i = 1; i < value.size(); ++i) {
+        int id = token_for_code_[static_cast<unsigned char>(value[i])];
+        if (id >= 0) {
+            std::memcpy(dest, tokens_[id].data(), tokens_[id].size());
+            dest += tokens_[id].size();
+        } else {
+            i += value[i] == escape && i + 1 < value.size();
+            *dest++ = value[i];
+        }
+    }
+    return out;
+}
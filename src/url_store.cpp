@@ -0,0 +1,96 @@
+#include "url_store.hpp"
+#include <algorithm>
+#include <cstring>
+
+static const size_t rewrite_batch_size = 1000;
+
+void UrlStore::insert_batch(const std::vector<std::pair<ShortCode, std::string>>& entries) {
+    for (const auto& entry : entries) {
+        insert(entry.first, entry.second);
+    }
+}
+
+std::vector<std::string> UrlStore::get_batch(const std::vector<ShortCode>& short_codes) {
+    std::vector<std::string> urls;
+    urls.reserve(short_codes.size());
+    for (const auto& short_code : short_codes) {
+        urls.push_back(get(short_code));
+    }
+    return urls;
+}
+
+void UrlStore::remove_batch(const std::vector<ShortCode>& short_codes) {
+    for (const auto& short_code : short_codes) {
+        remove(short_code);
+    }
+}
+
+bool UrlStore::healthy() {
+    return true;
+}
+
+bool UrlStore::get_cached(const ShortCode&, std::string&) {
+    return false;
+}
+
+void UrlStore::for_each_with_prefix(const std::string& prefix,
+                                    const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    for_each([&prefix, &callback](const ShortCode& short_code, const std::string& url) {
+        if (url.compare(0, prefix.size(), prefix) == 0) {
+            callback(short_code, url);
+        }
+    });
+}
+
+bool UrlStore::has_url_index() {
+    return false;
+}
+
+void UrlStore::for_each_on_host(const std::string& host,
+                                const std::function<void(const ShortCode&, const std::string&)>& callback) {
+    for (const char* scheme : {"http://", "https://"}) {
+        std::string prefix = scheme + host;
+        for_each_with_prefix(prefix, [&prefix, &callback](const ShortCode& short_code, const std::string& url) {
+            // "example.com" must not match "example.com.evil.org".
+            if (url.size() == prefix.size() || std::strchr("/:?#", url[prefix.size()]) != nullptr) {
+                callback(short_code, url);
+            }
+        });
+    }
+}
+
+size_t rewrite_values(UrlStore& store, const std::function<bool(const std::string&)>& needs_rewrite,
+                      const std::function<std::string(const std::string&)>& rewrite) {
+    // Engines hold locks or statements open during for_each, so rows are collected first.
+    std::vector<std::pair<ShortCode, std::string>> rows;
+    store.for_each([&rows, &needs_rewrite](const ShortCode& short_code, const std::string& value) {
+        if (needs_rewrite(value)) {
+            rows.emplace_back(short_code, value);
+        }
+    });
+    size_t rewritten = 0;
+    for (size_t start = 0; start < rows.size(); start += rewrite_batch_size) {
+        size_t end = std::min(rows.size(), start + rewrite_batch_size);
+        std::vector<std::pair<ShortCode, std::string>> batch;
+        for (size_t i = start; i < end; ++i) {
+            std::string value = rewrite(rows[i].second);
+            if (value != rows[i].second) {
+                batch.emplace_back(rows[i].first, std::move(value));
+            }
+        }
+        store.insert_batch(batch);
+        rewritten += batch.size();
+    }
+    return rewritten;
+}
+
+std::string prefix_upper_bound(const std::string& prefix) {
+    std::string bound = prefix;
+    while (!bound.empty() && static_cast<unsigned char>(bound.back()) == 0xFF) {
+        bound.pop_back();
+    }
+    if (!bound.empty()) {
+        bound.back() = static_cast<char>(static_cast<unsigned char>(bound.back()) + 1);
+    }
+    return bound;
+}
@@ -1,21 +1,39 @@
 #include "utils.hpp"
+#include "code_checksum.hpp"
+#include "code_sequence.hpp"
 #include "database.hpp"
+#include <algorithm>
+#include <random>
 
-std::string generate_short(int short_code_length) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, 61);
-    const std::string chars = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
-
-    std::string short_code;
-    for (int i = 0; i < short_code_length; ++i) {
-        short_code += chars[dis(gen)];
+ShortCode random_short(int short_code_length) {
+    thread_local std::mt19937_64 gen(std::random_device{}());
+    bool checksum = code_checksum_enabled();
+    size_t length = static_cast<size_t>(std::clamp<int>(short_code_length, checksum ? 2 : 1, ShortCode::max_length));
+    size_t random_length = checksum ? length - 1 : length;
+    char chars[ShortCode::max_length];
+    for (size_t i = 0; i < random_length; ++i) {
+        chars[i] = base62_digits[gen() % 62];
     }
-    while (!get_url(short_code).empty()) {
-        short_code = "";
-        for (int i = 0; i < short_code_length; ++i) {
-            short_code += chars[dis(gen)];
-        }
+    if (checksum) {
+        chars[random_length] = code_check_char(chars, random_length);
     }
+    ShortCode short_code;
+    ShortCode::parse(std::string_view(chars, length), short_code);
+    return short_code;
+}
+
+ShortCode candidate_short(int short_code_length) {
+    ShortCode short_code;
+    if (next_sequence_code(short_code)) {
+        return short_code;
+    }
+    return random_short(short_code_length);
+}
+
+ShortCode generate_short(int short_code_length) {
+    ShortCode short_code;
+    do {
+        short_code = candidate_short(short_code_length);
+    } while (!get_url(short_code).empty());
     return short_code;
-}
\ No newline at end of file
+}
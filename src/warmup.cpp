@@ -0,0 +1,112 @@
+#include "warmup.hpp"
+#include "logger.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+static const size_t warmup_batch_size = 256;
+
+static std::atomic<bool> warmed_up{false};
+static std::atomic<bool> warmup_stopping{false};
+static std::thread warmup_thread;
+
+static std::mutex snapshot_mutex;
+static std::condition_variable snapshot_cv;
+static bool snapshot_running = false;
+static std::thread snapshot_thread;
+
+bool save_hot_set(CachedStore& cache, const std::string& path, size_t count) {
+    auto codes = cache.hottest(count);
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        for (const auto& code : codes) {
+            file << code << '\n';
+        }
+        if (!file.good()) {
+            return false;
+        }
+    }
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+std::vector<ShortCode> load_hot_set(const std::string& path) {
+    std::vector<ShortCode> codes;
+    std::ifstream file(path);
+    std::string line;
+    ShortCode code;
+    while (std::getline(file, line)) {
+        if (ShortCode::parse(line, code)) {
+            codes.push_back(code);
+        }
+    }
+    return codes;
+}
+
+void start_hot_set_snapshots(CachedStore& cache, const std::string& path, size_t count, int interval_seconds) {
+    stop_hot_set_snapshots();
+    snapshot_running = true;
+    snapshot_thread = std::thread([&cache, path, count, interval_seconds] {
+        std::unique_lock<std::mutex> lock(snapshot_mutex);
+        while (snapshot_running) {
+            snapshot_cv.wait_for(lock, std::chrono::seconds(interval_seconds), [] { return !snapshot_running; });
+            lock.unlock();
+            // Until warm-up finishes the cache holds the previous snapshot, not live traffic.
+            if (warmed_up.load() && !save_hot_set(cache, path, count)) {
+                log("Failed to save hot set: " + path, "WARN");
+            }
+            lock.lock();
+        }
+    });
+}
+
+void stop_hot_set_snapshots() {
+    if (!snapshot_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex);
+        snapshot_running = false;
+    }
+    snapshot_cv.notify_all();
+    snapshot_thread.join();
+}
+
+void start_warmup(UrlStore& store, const std::string& path) {
+    stop_warmup();
+    warmed_up = false;
+    warmup_stopping = false;
+    warmup_thread = std::thread([&store, path] {
+        auto start = std::chrono::steady_clock::now();
+        auto codes = load_hot_set(path);
+        size_t loaded = 0;
+        for (size_t i = 0; i < codes.size() && !warmup_stopping.load(); i += warmup_batch_size) {
+            std::vector<ShortCode> batch(codes.begin() + i, codes.begin() + std::min(codes.size(), i + warmup_batch_size));
+            for (const auto& url : store.get_batch(batch)) {
+                loaded += url.empty() ? 0 : 1;
+            }
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        log("Warm-up loaded " + std::to_string(loaded) + " of " + std::to_string(codes.size()) +
+            " hot codes in " + std::to_string(elapsed.count()) + " ms");
+        warmed_up = true;
+    });
+}
+
+void stop_warmup() {
+    warmup_stopping = true;
+    if (warmup_thread.joinable()) {
+        warmup_thread.join();
+    }
+}
+
+bool warmup_complete() {
+    return warmed_up.load();
+}
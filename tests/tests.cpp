@@ -1,8 +1,41 @@
 #include <gtest/gtest.h>
+#include <filesystem>
 #include <fstream>
 #include <random>
+#include <set>
 #include "../include/database.hpp"
 #include "../include/config.hpp"
+#include "../include/access_log.hpp"
+#include "../include/aliases.hpp"
+#include "../include/logger.hpp"
+#include "../include/clock.hpp"
+#include "../include/code_checksum.hpp"
+#include "../include/code_pool.hpp"
+#include "../include/code_sequence.hpp"
+#include "../include/health.hpp"
+#include "../include/cached_store.hpp"
+#include "../include/compressed_store.hpp"
+#include "../include/interned_store.hpp"
+#include "../include/lsm_store.hpp"
+#include "../include/mmap_store.hpp"
+#include "../include/rate_limiter.hpp"
+#include "../include/request_arena.hpp"
+#include "../include/admission.hpp"
+#include "../include/deadline.hpp"
+#include "../include/fast_json.hpp"
+#include "../include/url_canon.hpp"
+#include "../include/utils.hpp"
+#include "../include/handlers.hpp"
+#include "../include/shutdown.hpp"
+#include "../include/hot_restart.hpp"
+#include "../include/sharded_store.hpp"
+#include "../include/sqlite_store.hpp"
+#include "../include/warmup.hpp"
+#include <thread>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 class UrlShortenerTest : public ::testing::Test {
 protected:
@@ -75,6 +108,1744 @@ TEST_F(UrlShortenerTest, DatabasePersistence) {
     std::remove(test_db.c_str());
 }
 
+TEST_F(UrlShortenerTest, LoadSettingsFromFile) {
+    // Not config.txt, which the repository tracks.
+    std::ofstream file("test_config.txt");
+    file << "short_code_length=7" << std::endl;
+    file << "access_log_dir=/tmp/access" << std::endl;
+    file << "access_log_max_segments=3" << std::endl;
+    file << "rate_limit.shorten=5/20" << std::endl;
+    file << "rate_limit.redirect=100" << std::endl;
+    file << "db_path=" << std::endl;
+    file << "hot_restart_socket=hot_restart.sock" << std::endl;
+    file.close();
+    Config config = load_settings("test_config.txt");
+    EXPECT_EQ(config.short_code_length, 7);
+    EXPECT_EQ(config.access_log_dir, "/tmp/access");
+    EXPECT_EQ(config.access_log_max_segments, 3);
+    EXPECT_EQ(config.rate_limits["shorten"], std::make_pair(5.0, 20.0));
+    EXPECT_EQ(config.rate_limits["redirect"], std::make_pair(100.0, 100.0));
+    EXPECT_EQ(config.db_path, Config().db_path);
+    EXPECT_EQ(config.hot_restart_socket, "hot_restart.sock");
+    EXPECT_EQ(Config().hot_restart_socket, "");
+    std::remove("test_config.txt");
+}
+
+TEST_F(UrlShortenerTest, AccessLogWriteAndRead) {
+    std::string dir = "test_access_logs";
+    std::filesystem::remove_all(dir);
+    {
+        AccessLog log;
+        ASSERT_TRUE(log.open(dir, 1024 * 1024, 4));
+        log.write(AccessEvent::Redirect, 302, "abc123", "10.0.0.1, 172.16.0.1", "curl/8.0");
+        log.write(AccessEvent::RedirectNotFound, 404, "zzz", "unknown", "");
+        log.write(AccessEvent::Shortened, 200, "def456", "2001:db8::1", "curl/8.0");
+    }
+
+    auto segments = list_access_log_segments(dir);
+    ASSERT_EQ(segments.size(), 1u);
+    auto records = read_access_log_segment(segments[0]);
+    ASSERT_EQ(records.size(), 3u);
+    auto user_agents = read_user_agents(dir);
+
+    EXPECT_EQ(static_cast<AccessEvent>(records[0].event), AccessEvent::Redirect);
+    EXPECT_EQ(records[0].status, 302);
+    EXPECT_EQ(std::string(records[0].code, records[0].code_length), "abc123");
+    EXPECT_EQ(format_access_ip(records[0].ip), "10.0.0.1");
+    EXPECT_EQ(format_access_ip(records[1].ip), "unknown");
+    EXPECT_EQ(format_access_ip(records[2].ip), "2001:db8::1");
+    EXPECT_EQ(records[0].user_agent_id, records[2].user_agent_id);
+    EXPECT_EQ(records[1].user_agent_id, 0u);
+
+    std::string csv = access_record_to_csv(records[0], user_agents);
+    EXPECT_NE(csv.find(",redirect,302,abc123,10.0.0.1,curl/8.0"), std::string::npos);
+    std::string json = access_record_to_json(records[2], user_agents);
+    EXPECT_NE(json.find("\"code\":\"def456\""), std::string::npos);
+    EXPECT_NE(json.find("\"user_agent\":\"curl/8.0\""), std::string::npos);
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_F(UrlShortenerTest, AccessLogBoundsUserAgents) {
+    std::string dir = "test_access_logs_ua";
+    std::filesystem::remove_all(dir);
+    {
+        AccessLog log;
+        ASSERT_TRUE(log.open(dir, 1024 * 1024, 4));
+        log.write(AccessEvent::Redirect, 302, "abc123", "10.0.0.1", std::string(1000, 'a'));
+        log.write(AccessEvent::Redirect, 302, "abc123", "10.0.0.1", std::string(300, 'a'));
+        log.write(AccessEvent::Redirect, 302, "abc123", "10.0.0.1", "curl/8.0");
+    }
+    auto records = read_access_log_segment(list_access_log_segments(dir)[0]);
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[0].user_agent_id, records[1].user_agent_id);
+    auto user_agents = read_user_agents(dir);
+    ASSERT_EQ(user_agents.size(), 3u);
+    EXPECT_EQ(user_agents[records[0].user_agent_id], std::string(256, 'a'));
+    EXPECT_EQ(user_agents[records[2].user_agent_id], "curl/8.0");
+    std::filesystem::remove_all(dir);
+}
+
+TEST_F(UrlShortenerTest, AccessLogRotation) {
+    std::string dir = "test_access_logs_rotation";
+    std::filesystem::remove_all(dir);
+    size_t segment_size = sizeof(AccessLogSegmentHeader) + 10 * sizeof(AccessRecord);
+    {
+        AccessLog log;
+        ASSERT_TRUE(log.open(dir, segment_size, 2));
+        for (int i = 0; i < 25; ++i) {
+            log.write(AccessEvent::Redirect, 302, "code" + std::to_string(i), "127.0.0.1", "agent");
+        }
+    }
+
+    auto segments = list_access_log_segments(dir);
+    ASSERT_EQ(segments.size(), 2u);
+    EXPECT_EQ(read_access_log_segment(segments[0]).size(), 10u);
+    auto last = read_access_log_segment(segments[1]);
+    ASSERT_EQ(last.size(), 5u);
+    EXPECT_EQ(std::string(last[4].code, last[4].code_length), "code24");
+
+    std::filesystem::remove_all(dir);
+}
+
+static int count_rows(sqlite3* handle, const char* sql) {
+    sqlite3_stmt* stmt;
+    int count = -1;
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            count = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return count;
+}
+
+TEST_F(UrlShortenerTest, LogsWrittenToSeparateDatabase) {
+    ASSERT_TRUE(open_log_db(":memory:", "MEMORY", 100));
+    log_to_db("INFO", "first", "127.0.0.1", "agent");
+    log_to_db("WARN", "second");
+    flush_log_queue();
+    EXPECT_EQ(count_rows(log_db, "SELECT COUNT(*) FROM logs;"), 2);
+    EXPECT_EQ(count_rows(db, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'logs';"), 0);
+    close_log_db();
+    EXPECT_EQ(log_db, nullptr);
+}
+
+TEST_F(UrlShortenerTest, SynchronousLogWriterWhenQueueDisabled) {
+    ASSERT_TRUE(open_log_db(":memory:", "MEMORY", 0));
+    log_to_db("INFO", "message");
+    EXPECT_EQ(count_rows(log_db, "SELECT COUNT(*) FROM logs;"), 1);
+    close_log_db();
+}
+
+TEST_F(UrlShortenerTest, CountsEntriesDroppedWhenLogQueueIsFull) {
+    std::string path = "test_log_drops.db";
+    std::remove(path.c_str());
+    ASSERT_TRUE(open_log_db(path, "WAL", 2));
+    // The writer blocks on another connection's write lock, so the queue cannot drain.
+    sqlite3* other;
+    sqlite3_open(path.c_str(), &other);
+    ASSERT_EQ(sqlite3_exec(other, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr), SQLITE_OK);
+    uint64_t before = log_entries_dropped();
+    log_to_db("INFO", "taken by the writer");
+    while (log_queue_depth() != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (int i = 0; i < 5; ++i) {
+        log_to_db("INFO", "entry " + std::to_string(i));
+    }
+    EXPECT_EQ(log_entries_dropped() - before, 3u);
+    EXPECT_EQ(health_status().log_dropped - before, 3u);
+
+    sqlite3_exec(other, "COMMIT;", nullptr, nullptr, nullptr);
+    sqlite3_close(other);
+    flush_log_queue();
+    EXPECT_EQ(count_rows(log_db, "SELECT COUNT(*) FROM logs;"), 3);
+    close_log_db();
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+TEST_F(UrlShortenerTest, LogLevelFiltering) {
+    set_min_log_level(LogLevel::Warn);
+    EXPECT_FALSE(log_enabled("DEBUG"));
+    EXPECT_FALSE(log_enabled("INFO"));
+    EXPECT_TRUE(log_enabled("WARN"));
+    EXPECT_TRUE(log_enabled("ERROR"));
+    set_min_log_level(LogLevel::Info);
+    EXPECT_TRUE(log_enabled("INFO"));
+}
+
+TEST_F(UrlShortenerTest, AccessLogSampling) {
+    std::string dir = "test_access_logs_sampling";
+    std::filesystem::remove_all(dir);
+    ASSERT_TRUE(open_access_log(dir, 1024 * 1024, 1));
+    set_access_sample_rate(AccessEvent::Redirect, 0.0);
+    set_access_sample_rate(AccessEvent::RedirectNotFound, 0.5);
+    EXPECT_EQ(access_sample_rate(AccessEvent::Redirect), 0.0);
+    EXPECT_EQ(access_sample_rate(AccessEvent::Deleted), 1.0);
+
+    int redirects = 0;
+    int not_found = 0;
+    for (int i = 0; i < 10000; ++i) {
+        redirects += access_log_sampled(AccessEvent::Redirect);
+        not_found += access_log_sampled(AccessEvent::RedirectNotFound);
+    }
+    EXPECT_EQ(redirects, 0);
+    EXPECT_GT(not_found, 4000);
+    EXPECT_LT(not_found, 6000);
+    EXPECT_TRUE(access_log_sampled(AccessEvent::Deleted));
+    EXPECT_EQ(parse_access_event("redirect_not_found"), AccessEvent::RedirectNotFound);
+
+    set_access_sample_rate(AccessEvent::Redirect, 1.0);
+    set_access_sample_rate(AccessEvent::RedirectNotFound, 1.0);
+    close_access_log();
+    EXPECT_FALSE(access_log_sampled(AccessEvent::Deleted));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_F(UrlShortenerTest, FormatTimestamp) {
+    char buffer[timestamp_length];
+    EXPECT_EQ(std::string(buffer, format_timestamp(1700000000123456ULL, buffer)), "2023-11-14 22:13:20.123");
+    EXPECT_EQ(std::string(buffer, format_timestamp(1700000000999000ULL, buffer)), "2023-11-14 22:13:20.999");
+    EXPECT_EQ(std::string(buffer, format_timestamp(1700000001005000ULL, buffer)), "2023-11-14 22:13:21.005");
+    EXPECT_EQ(current_timestamp().size(), timestamp_length);
+}
+
+class UrlStoreTest : public ::testing::TestWithParam<std::string> {
+protected:
+    void SetUp() override {
+        std::filesystem::remove_all(dir);
+        sqlite3_open(":memory:", &db);
+        Config config;
+        config.storage_engine = GetParam();
+        config.mmap_dir = dir;
+        config.mmap_initial_capacity = 16;
+        config.lsm_dir = dir;
+        config.lsm_memtable_bytes = 4096;
+        config.shard_dir = dir;
+        store = create_store(config);
+        ASSERT_NE(store, nullptr);
+    }
+
+    void TearDown() override {
+        store.reset();
+        sqlite3_close(db);
+        std::filesystem::remove_all(dir);
+    }
+
+    std::string dir = "test_store";
+    std::unique_ptr<UrlStore> store;
+};
+
+TEST_P(UrlStoreTest, InsertAndGetUrl) {
+    store->insert("abc123", "http://example.com");
+    EXPECT_EQ(store->get("abc123"), "http://example.com");
+    EXPECT_EQ(store->get("missing"), "");
+}
+
+TEST_P(UrlStoreTest, GetByUrl) {
+    store->insert("def456", "http://test.com");
+    EXPECT_EQ(store->get_by_url("http://test.com"), "def456");
+    EXPECT_EQ(store->get_by_url("http://other.com"), "");
+}
+
+TEST_P(UrlStoreTest, DeleteUrl) {
+    store->insert("ghi789", "http://delete.com");
+    EXPECT_EQ(store->get("ghi789"), "http://delete.com");
+    store->remove("ghi789");
+    EXPECT_EQ(store->get("ghi789"), "");
+    EXPECT_EQ(store->get_by_url("http://delete.com"), "");
+}
+
+TEST_P(UrlStoreTest, ReplaceKeepsCodesAndUrlsUnique) {
+    store->insert("code1", "http://one.com");
+    store->insert("code1", "http://two.com");
+    EXPECT_EQ(store->get("code1"), "http://two.com");
+    EXPECT_EQ(store->get_by_url("http://one.com"), "");
+    store->insert("code2", "http://two.com");
+    EXPECT_EQ(store->get("code1"), "");
+    EXPECT_EQ(store->get_by_url("http://two.com"), "code2");
+}
+
+TEST_P(UrlStoreTest, InsertNewNeverReplaces) {
+    EXPECT_TRUE(store->insert_new("code1", "http://one.com"));
+    EXPECT_FALSE(store->insert_new("code1", "http://two.com"));
+    EXPECT_FALSE(store->insert_new("code2", "http://one.com"));
+    EXPECT_EQ(store->get("code1"), "http://one.com");
+    EXPECT_EQ(store->get("code2"), "");
+    EXPECT_EQ(store->get_by_url("http://two.com"), "");
+    store->remove("code1");
+    EXPECT_TRUE(store->insert_new("code2", "http://one.com"));
+    EXPECT_EQ(store->get_by_url("http://one.com"), "code2");
+}
+
+TEST_P(UrlStoreTest, BatchOperationsAndIteration) {
+    std::vector<std::pair<ShortCode, std::string>> entries;
+    for (int i = 0; i < 1000; ++i) {
+        entries.emplace_back("b" + std::to_string(i), "http://batch.com/" + std::to_string(i));
+    }
+    store->insert_batch(entries);
+    auto urls = store->get_batch({"b0", "missing", "b999"});
+    ASSERT_EQ(urls.size(), 3u);
+    EXPECT_EQ(urls[0], "http://batch.com/0");
+    EXPECT_EQ(urls[1], "");
+    EXPECT_EQ(urls[2], "http://batch.com/999");
+
+    store->remove_batch({"b0", "b1"});
+    size_t count = 0;
+    store->for_each([&](const ShortCode& short_code, const std::string& url) {
+        EXPECT_EQ(url, "http://batch.com/" + short_code.str().substr(1));
+        ++count;
+    });
+    EXPECT_EQ(count, 998u);
+}
+
+TEST_P(UrlStoreTest, PrefixScanFindsExactlyTheMatchingUrls) {
+    store->insert("a", "https://host.example/1");
+    store->insert("b", "http://host.example:8080/2");
+    store->insert("c", "https://host.example.evil.org/3");
+    store->insert("d", "https://other.example/4");
+    std::set<std::string> codes;
+    store->for_each_on_host("host.example", [&codes](const ShortCode& short_code, const std::string&) {
+        codes.insert(short_code.str());
+    });
+    EXPECT_EQ(codes, (std::set<std::string>{"a", "b"}));
+    // Only engines with an index on URLs avoid a full scan.
+    EXPECT_EQ(store->has_url_index(), GetParam() != "mmap");
+}
+
+TEST_P(UrlStoreTest, FreeFunctionsUseCurrentStore) {
+    set_store(std::move(store));
+    insert_url("free1", "http://free.com");
+    EXPECT_EQ(get_url("free1"), "http://free.com");
+    EXPECT_EQ(get_short_code("http://free.com"), "free1");
+    delete_url("free1");
+    EXPECT_EQ(get_url("free1"), "");
+    set_store(nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines, UrlStoreTest, ::testing::Values("sqlite", "mmap", "lsm", "sharded"));
+
+TEST(MmapStoreTest, GrowsAndPersists) {
+    std::string dir = "test_mmap_store";
+    std::filesystem::remove_all(dir);
+    {
+        MmapStore store;
+        ASSERT_TRUE(store.open(dir, 16));
+        for (int i = 0; i < 5000; ++i) {
+            store.insert("c" + std::to_string(i), "http://example.com/" + std::to_string(i));
+        }
+        for (int i = 0; i < 5000; i += 2) {
+            store.remove("c" + std::to_string(i));
+        }
+    }
+    MmapStore store;
+    ASSERT_TRUE(store.open(dir, 16));
+    EXPECT_EQ(store.size(), 2500u);
+    for (int i = 0; i < 5000; ++i) {
+        std::string expected = i % 2 ? "http://example.com/" + std::to_string(i) : "";
+        EXPECT_EQ(store.get("c" + std::to_string(i)), expected);
+    }
+    EXPECT_EQ(store.get_by_url("http://example.com/4999"), "c4999");
+    store.close();
+    std::filesystem::remove_all(dir);
+}
+
+// Overwrites size bytes at offset of path, which must exist.
+static void overwrite_bytes(const std::string& path, std::streamoff offset, const void* data, size_t size) {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offset);
+    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+}
+
+TEST(MmapStoreTest, RefusesInconsistentFiles) {
+    std::string dir = "test_mmap_store_corrupt";
+    std::string index_path = dir + "/index.bin";
+    std::string heap_path = dir + "/heap.bin";
+    auto create = [&dir] {
+        std::filesystem::remove_all(dir);
+        MmapStore store;
+        ASSERT_TRUE(store.open(dir, 16));
+        store.insert("kept", "http://kept.com");
+    };
+    MmapStore store;
+
+    create();
+    uint64_t capacity = 1000;
+    overwrite_bytes(index_path, 8, &capacity, sizeof(capacity));
+    EXPECT_FALSE(store.open(dir, 16));
+    capacity = 0;
+    overwrite_bytes(index_path, 8, &capacity, sizeof(capacity));
+    EXPECT_FALSE(store.open(dir, 16));
+
+    create();
+    std::filesystem::remove(heap_path);
+    EXPECT_FALSE(store.open(dir, 16));
+    EXPECT_FALSE(std::filesystem::exists(heap_path));
+
+    create();
+    overwrite_bytes(heap_path, 0, "XXXXXXXX", 8);
+    EXPECT_FALSE(store.open(dir, 16));
+
+    create();
+    ASSERT_TRUE(store.open(dir, 16));
+    EXPECT_EQ(store.get("kept"), "http://kept.com");
+    store.close();
+    std::filesystem::remove_all(dir);
+}
+
+TEST(MmapStoreTest, ReadsWhileWriting) {
+    std::string dir = "test_mmap_store_concurrent";
+    std::filesystem::remove_all(dir);
+    MmapStore store;
+    ASSERT_TRUE(store.open(dir, 16));
+    store.insert("stable", "http://stable.com");
+    std::atomic<bool> done{false};
+    std::atomic<int> misses{0};
+    std::thread reader([&] {
+        while (!done.load()) {
+            if (store.get("stable") != "http://stable.com") {
+                ++misses;
+            }
+        }
+    });
+    for (int i = 0; i < 20000; ++i) {
+        store.insert("w" + std::to_string(i), "http://example.com/" + std::to_string(i));
+    }
+    done.store(true);
+    reader.join();
+    EXPECT_EQ(misses.load(), 0);
+    EXPECT_EQ(store.get("w19999"), "http://example.com/19999");
+    store.close();
+    std::filesystem::remove_all(dir);
+}
+
+TEST(LsmStoreTest, FlushCompactAndReopen) {
+    std::string dir = "test_lsm_store";
+    std::filesystem::remove_all(dir);
+    LsmStore::Options options;
+    options.memtable_bytes = 8192;
+    options.compaction_trigger = 3;
+    {
+        LsmStore store;
+        ASSERT_TRUE(store.open(dir, options));
+        for (int i = 0; i < 5000; ++i) {
+            store.insert("c" + std::to_string(i), "http://example.com/" + std::to_string(i));
+        }
+        for (int i = 0; i < 5000; i += 2) {
+            store.remove("c" + std::to_string(i));
+        }
+        store.flush();
+        EXPECT_GT(store.segment_count(), 0u);
+        store.insert("c0", "http://example.com/again");
+    }
+    LsmStore store;
+    ASSERT_TRUE(store.open(dir, options));
+    for (int i = 1; i < 5000; ++i) {
+        std::string expected = i % 2 ? "http://example.com/" + std::to_string(i) : "";
+        EXPECT_EQ(store.get("c" + std::to_string(i)), expected);
+    }
+    EXPECT_EQ(store.get("c0"), "http://example.com/again");
+    EXPECT_EQ(store.get_by_url("http://example.com/4999"), "c4999");
+    EXPECT_EQ(store.get_by_url("http://example.com/4998"), "");
+    size_t count = 0;
+    store.for_each([&](const ShortCode&, const std::string&) { ++count; });
+    EXPECT_EQ(count, 2501u);
+    // The range spans segments, and removed URLs stay hidden.
+    std::set<std::string> in_range, expected;
+    store.for_each_with_prefix("http://example.com/49", [&](const ShortCode& code, const std::string& url) {
+        EXPECT_EQ(url, "http://example.com/" + code.str().substr(1));
+        in_range.insert(code.str());
+    });
+    for (int i = 1; i < 5000; i += 2) {
+        if (std::to_string(i).compare(0, 2, "49") == 0) {
+            expected.insert("c" + std::to_string(i));
+        }
+    }
+    EXPECT_EQ(in_range, expected);
+    store.close();
+    std::filesystem::remove_all(dir);
+}
+
+TEST(LsmStoreTest, ReplaysWriteAheadLog) {
+    std::string dir = "test_lsm_store_wal";
+    std::filesystem::remove_all(dir);
+    {
+        LsmStore store;
+        ASSERT_TRUE(store.open(dir, LsmStore::Options()));
+        store.insert("walcode", "http://wal.com");
+        store.insert("gone", "http://gone.com");
+        store.remove("gone");
+    }
+    std::ofstream(dir + "/" + "wal-00000000000000000001.log", std::ios::app) << "torn";
+    LsmStore store;
+    ASSERT_TRUE(store.open(dir, LsmStore::Options()));
+    EXPECT_EQ(store.segment_count(), 0u);
+    EXPECT_EQ(store.get("walcode"), "http://wal.com");
+    EXPECT_EQ(store.get("gone"), "");
+    store.close();
+    std::filesystem::remove_all(dir);
+}
+
+TEST(ShardedStoreTest, RoutesAcrossShardsAndChecksShardCount) {
+    std::string dir = "test_sharded_store";
+    std::filesystem::remove_all(dir);
+    {
+        ShardedSqliteStore store;
+        ASSERT_TRUE(store.open(dir, 4, "WAL"));
+        std::vector<int> per_shard(4);
+        for (int i = 0; i < 200; ++i) {
+            std::string code = "s" + std::to_string(i);
+            store.insert(code, "http://shard.com/" + std::to_string(i));
+            ++per_shard[store.shard_for_code(code)];
+        }
+        for (int count : per_shard) {
+            EXPECT_GT(count, 0);
+        }
+        // Moving a URL to a new code updates routes that may live in other shards.
+        store.insert("moved", "http://shard.com/7");
+        EXPECT_EQ(store.get("s7"), "");
+        EXPECT_EQ(store.get_by_url("http://shard.com/7"), "moved");
+    }
+    ShardedSqliteStore wrong_count;
+    EXPECT_FALSE(wrong_count.open(dir, 8, "WAL"));
+    ShardedSqliteStore store;
+    ASSERT_TRUE(store.open(dir, 4, "WAL"));
+    EXPECT_EQ(store.get("s199"), "http://shard.com/199");
+    EXPECT_EQ(store.get_by_url("http://shard.com/0"), "s0");
+    store.close();
+    std::filesystem::remove_all(dir);
+}
+
+TEST(ShardedStoreTest, ConcurrentWritersKeepUrlsUnique) {
+    std::string dir = "test_sharded_store_concurrent";
+    std::filesystem::remove_all(dir);
+    ShardedSqliteStore store;
+    ASSERT_TRUE(store.open(dir, 4, "WAL"));
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&store, t] {
+            for (int i = 0; i < 100; ++i) {
+                store.insert("t" + std::to_string(t) + "x" + std::to_string(i), "http://race.com/" + std::to_string(i));
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    size_t count = 0;
+    store.for_each([&](const ShortCode& short_code, const std::string& url) {
+        EXPECT_EQ(store.get_by_url(url), short_code);
+        ++count;
+    });
+    EXPECT_EQ(count, 100u);
+    store.close();
+    std::filesystem::remove_all(dir);
+}
+
+TEST(ShortCodeTest, AcceptsOnlyBase62UpToSixteenCharacters) {
+    static_assert(ShortCode::valid("Ab9") && !ShortCode::valid("a-b") && base62_values['z'] == 61);
+    ShortCode code("abc123");
+    EXPECT_EQ(code.size(), 6u);
+    EXPECT_STREQ(code.c_str(), "abc123");
+    EXPECT_EQ(code, "abc123");
+    EXPECT_EQ(ShortCode("0123456789abcdef").view(), "0123456789abcdef");
+    EXPECT_TRUE(ShortCode("0123456789abcdefg").empty());
+    EXPECT_TRUE(ShortCode("abc/12").empty());
+    EXPECT_TRUE(ShortCode("").empty());
+
+    // Equal codes hash alike; a prefix is a different code.
+    EXPECT_EQ(ShortCode(std::string("abc123")).hash(), code.hash());
+    EXPECT_NE(ShortCode("abc12"), code);
+    EXPECT_TRUE(ShortCode("abc12") < code);
+    std::unordered_map<ShortCode, int> counts;
+    for (int i = 0; i < 1000; ++i) {
+        ++counts[ShortCode("c" + std::to_string(i % 100))];
+    }
+    EXPECT_EQ(counts.size(), 100u);
+    EXPECT_EQ(counts["c7"], 10);
+
+    EXPECT_EQ(generate_short(6).size(), 6u);
+    EXPECT_EQ(generate_short(40).size(), ShortCode::max_length);
+}
+
+TEST_F(UrlShortenerTest, ChecksummedCodesRejectTyposWithoutStorage) {
+    configure_code_checksum(7, "secret", 6);
+    ShortCode code = generate_short(7);
+    ASSERT_EQ(code.size(), 7u);
+    EXPECT_TRUE(code_may_exist(code));
+
+    // Every other check character, and most single-character typos, are rejected.
+    std::string text = code.str();
+    size_t rejected = 0;
+    for (char c : std::string_view(base62_digits)) {
+        for (size_t position : {size_t(0), size_t(6)}) {
+            std::string typo = text;
+            typo[position] = c;
+            if (typo != text) {
+                EXPECT_TRUE(position == 0 || !code_may_exist(typo));
+                rejected += !code_may_exist(typo);
+            }
+        }
+    }
+    EXPECT_GT(rejected, 115u);
+    EXPECT_FALSE(code_may_exist(text.substr(0, 5)));
+    EXPECT_FALSE(code_may_exist(text + "0"));
+    EXPECT_TRUE(code_may_exist("abc123"));
+
+    // The check character depends on the key.
+    size_t same = 0;
+    for (int i = 0; i < 100; ++i) {
+        std::string body = generate_short(6).str();
+        configure_code_checksum(7, "other", 6);
+        char other = code_check_char(body.data(), 6);
+        configure_code_checksum(7, "secret", 6);
+        same += other == code_check_char(body.data(), 6);
+    }
+    EXPECT_LT(same, 20u);
+
+    configure_code_checksum(0, "", 0);
+    EXPECT_FALSE(code_checksum_enabled());
+    EXPECT_TRUE(code_may_exist(text.substr(0, 5)));
+}
+
+TEST_F(UrlShortenerTest, AliasesAreClaimedByTheirLink) {
+    EXPECT_FALSE(alias_valid("sale2024"));
+    ASSERT_TRUE(open_aliases(db, 6, 7));
+    EXPECT_TRUE(alias_valid("sale2024"));
+    EXPECT_FALSE(alias_valid("abc123"));
+    EXPECT_FALSE(alias_valid("abc1234"));
+    EXPECT_FALSE(alias_valid("sale-2024"));
+    EXPECT_FALSE(alias_valid(""));
+
+    // The link decides: neither an existing code nor a URL that has one is replaced.
+    insert_url("old20240", "https://example.com/old");
+    EXPECT_FALSE(insert_new_url("old20240", "https://example.com/new"));
+    EXPECT_EQ(get_url("old20240"), "https://example.com/old");
+    ASSERT_TRUE(insert_new_url("sale2024", "https://example.com/a"));
+    EXPECT_FALSE(insert_new_url("other2024", "https://example.com/a"));
+    EXPECT_EQ(get_url("sale2024"), "https://example.com/a");
+    EXPECT_EQ(get_url("other2024"), "");
+
+    EXPECT_FALSE(alias_known("sale2024"));
+    EXPECT_TRUE(record_alias("sale2024"));
+    EXPECT_TRUE(record_alias("sale2024"));
+    EXPECT_TRUE(alias_known("sale2024"));
+
+    // Aliases another process records or releases show up on the next reload.
+    sqlite3_exec(db, "DELETE FROM aliases; INSERT INTO aliases (alias) VALUES ('next2024');", nullptr, nullptr, nullptr);
+    ASSERT_TRUE(open_aliases(db, 6, 7));
+    EXPECT_TRUE(alias_known("next2024"));
+    EXPECT_FALSE(alias_known("sale2024"));
+
+    release_alias("next2024");
+    EXPECT_FALSE(alias_known("next2024"));
+    close_aliases();
+    EXPECT_FALSE(record_alias("last2024"));
+}
+
+TEST(CachedStoreTest, InvalidatesOnWritesAndBoundsSize) {
+    sqlite3* handle;
+    sqlite3_open(":memory:", &handle);
+    CachedStore cache(std::make_unique<SqliteStore>(handle), 64);
+    cache.insert("hot", "http://one.com");
+    EXPECT_EQ(cache.get("hot"), "http://one.com");
+    cache.insert("hot", "http://two.com");
+    EXPECT_EQ(cache.get("hot"), "http://two.com");
+    cache.insert("other", "http://two.com");
+    EXPECT_EQ(cache.get("hot"), "");
+    cache.remove("other");
+    EXPECT_EQ(cache.get("other"), "");
+
+    for (int i = 0; i < 1000; ++i) {
+        cache.insert("c" + std::to_string(i), "http://example.com/" + std::to_string(i));
+        EXPECT_EQ(cache.get("c" + std::to_string(i)), "http://example.com/" + std::to_string(i));
+    }
+    EXPECT_LE(cache.size(), 64u);
+    sqlite3_close(handle);
+}
+
+TEST(CachedStoreTest, ReloadsEntriesOlderThanTheTtl) {
+    sqlite3* handle;
+    sqlite3_open(":memory:", &handle);
+    auto backend = std::make_unique<SqliteStore>(handle);
+    SqliteStore& other_process = *backend;
+    CachedStore cache(std::move(backend), 64, 50);
+    cache.insert("ttl", "http://one.com");
+    EXPECT_EQ(cache.get("ttl"), "http://one.com");
+    // A write that bypasses the cache, as one from another process does.
+    other_process.remove("ttl");
+    std::string url;
+    EXPECT_TRUE(cache.get_cached("ttl", url));
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    EXPECT_FALSE(cache.get_cached("ttl", url));
+    EXPECT_EQ(cache.get("ttl"), "");
+    sqlite3_close(handle);
+}
+
+static std::vector<std::string> campaign_urls(size_t count) {
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < count; ++i) {
+        urls.push_back("https://www.example.com/articles/" + std::to_string(i) +
+                       "/index.html?utm_source=newsletter&utm_medium=email&utm_campaign=spring" + std::to_string(i % 7));
+    }
+    return urls;
+}
+
+TEST(UrlDictionaryTest, TrainsRoundTripsAndReloads) {
+    auto urls = campaign_urls(500);
+    UrlDictionary dictionary = UrlDictionary::train(urls);
+    ASSERT_GT(dictionary.size(), 0u);
+    size_t raw = 0, encoded = 0;
+    for (const auto& url : urls) {
+        std::string value = dictionary.encode(url);
+        EXPECT_TRUE(UrlDictionary::is_encoded(value));
+        EXPECT_EQ(dictionary.decode(value), url);
+        raw += url.size();
+        encoded += value.size();
+    }
+    EXPECT_LT(encoded * 3, raw);
+
+    std::string odd = "https://www.example.com/caf\xc3\xa9\x01\x02/index.html";
+    EXPECT_EQ(dictionary.decode(dictionary.encode(odd)), odd);
+    EXPECT_EQ(dictionary.decode("https://other.org/"), "https://other.org/");
+    EXPECT_EQ(dictionary.encode("ab"), "ab");
+
+    std::string path = (std::filesystem::temp_directory_path() / "test_url_dictionary.txt").string();
+    ASSERT_TRUE(dictionary.save(path));
+    UrlDictionary loaded;
+    ASSERT_TRUE(loaded.load(path));
+    EXPECT_EQ(loaded.tokens(), dictionary.tokens());
+    EXPECT_EQ(loaded.encode(urls[42]), dictionary.encode(urls[42]));
+    std::filesystem::remove(path);
+}
+
+TEST(CompressedStoreTest, CompressesExistingRowsAndDedupsEncoded) {
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    std::string path = (std::filesystem::temp_directory_path() / "test_compressed_store_dictionary.txt").string();
+    std::filesystem::remove(path);
+    auto urls = campaign_urls(200);
+    {
+        auto backend = std::make_unique<SqliteStore>(handle);
+        for (size_t i = 0; i < urls.size(); ++i) {
+            backend->insert("c" + std::to_string(i), urls[i]);
+        }
+        auto store = open_compressed_store(std::move(backend), path, 100);
+        auto* compressed = dynamic_cast<CompressedStore*>(store.get());
+        ASSERT_NE(compressed, nullptr);
+        EXPECT_TRUE(UrlDictionary::is_encoded(compressed->backend().get("c7")));
+        EXPECT_EQ(store->get("c7"), urls[7]);
+        EXPECT_EQ(store->get_by_url(urls[9]), "c9");
+        store->insert("new", "https://www.example.com/articles/new/index.html?utm_source=newsletter");
+        EXPECT_GT(url_compression_stats().raw_bytes, url_compression_stats().stored_bytes);
+    }
+    auto store = open_compressed_store(std::make_unique<SqliteStore>(handle), path, 100);
+    EXPECT_EQ(store->get("new"), "https://www.example.com/articles/new/index.html?utm_source=newsletter");
+    EXPECT_EQ(store->get_batch({"c1", "c2"}), (std::vector<std::string>{urls[1], urls[2]}));
+    std::string plain = "https://www.example.com/articles/plain/index.html?utm_source=newsletter";
+    dynamic_cast<CompressedStore&>(*store).backend().insert("plain", plain);
+    EXPECT_EQ(store->get_by_url(plain), "plain");
+    EXPECT_FALSE(store->insert_new("dup", plain));
+    // Encoded rows have no URL order, so prefix scans go over every row.
+    EXPECT_FALSE(store->has_url_index());
+    std::vector<std::string> plain_codes;
+    store->for_each_with_prefix("https://www.example.com/articles/plain/", [&plain_codes](const ShortCode& code, const std::string&) {
+        plain_codes.push_back(code.str());
+    });
+    EXPECT_EQ(plain_codes, std::vector<std::string>{"plain"});
+
+    std::filesystem::remove(path);
+    EXPECT_EQ(open_compressed_store(std::make_unique<SqliteStore>(handle), path, 100), nullptr);
+    sqlite3_close(handle);
+}
+
+static std::vector<std::string> codes_on_host(UrlStore& store, const std::string& host) {
+    std::vector<std::string> codes;
+    store.for_each_on_host(host, [&codes](const ShortCode& short_code, const std::string&) {
+        codes.push_back(short_code.str());
+    });
+    std::sort(codes.begin(), codes.end());
+    return codes;
+}
+
+TEST(InternedStoreTest, InternsPrefixesAndQueriesByHost) {
+    sqlite3* handle = nullptr;
+    ASSERT_EQ(sqlite3_open(":memory:", &handle), SQLITE_OK);
+    auto backend = std::make_unique<SqliteStore>(handle);
+    backend->insert("old", "https://shop.example/products/1");
+    backend->insert("evil", "https://shop.example.evil.org/products/1");
+    EXPECT_EQ(codes_on_host(*backend, "shop.example"), std::vector<std::string>{"old"});
+
+    auto store = open_interned_store(std::move(backend), handle, 3);
+    ASSERT_NE(store, nullptr);
+    auto& interned = dynamic_cast<InternedStore&>(*store);
+    std::string raw_old = interned.backend().get("old");
+    EXPECT_EQ(raw_old.size(), 5u);
+    EXPECT_EQ(raw_old[0], 0x03);
+    EXPECT_EQ(store->get("old"), "https://shop.example/products/1");
+
+    store->insert("p2", "https://shop.example/products/2?color=red");
+    store->insert("home", "https://shop.example/");
+    store->insert("port", "http://shop.example:8080/x");
+    // The table holds 3 prefixes, so this one is stored whole.
+    store->insert("other", "https://other.example/a/b");
+    EXPECT_EQ(interned.prefix_count(), 3u);
+    EXPECT_EQ(interned.backend().get("other"), "https://other.example/a/b");
+    EXPECT_EQ(store->get("p2"), "https://shop.example/products/2?color=red");
+    EXPECT_EQ(store->get_by_url("https://shop.example/products/2?color=red"), "p2");
+    EXPECT_EQ(store->get_by_url("https://other.example/a/b"), "other");
+    EXPECT_EQ(store->get_by_url("https://shop.example/products/3"), "");
+
+    EXPECT_EQ(codes_on_host(*store, "shop.example"), (std::vector<std::string>{"home", "old", "p2", "port"}));
+    EXPECT_EQ(codes_on_host(*store, "other.example"), std::vector<std::string>{"other"});
+    std::vector<std::string> products;
+    store->for_each_with_prefix("https://shop.example/products/2", [&products](const ShortCode& code, const std::string& url) {
+        products.push_back(code.str() + " " + url);
+    });
+    EXPECT_EQ(products, std::vector<std::string>{"p2 https://shop.example/products/2?color=red"});
+
+    // A row stored whole while interning was off is still found by its URL.
+    interned.backend().insert("whole", "https://shop.example/products/whole");
+    EXPECT_EQ(store->get_by_url("https://shop.example/products/whole"), "whole");
+    EXPECT_FALSE(store->insert_new("dup", "https://shop.example/products/whole"));
+    store.reset();
+
+    auto reopened = open_interned_store(std::make_unique<SqliteStore>(handle), handle, 3);
+    EXPECT_EQ(dynamic_cast<InternedStore&>(*reopened).prefix_count(), 3u);
+    EXPECT_EQ(reopened->get("port"), "http://shop.example:8080/x");
+
+    // Over an engine without a URL index, one full pass answers the same query.
+    auto unindexed = std::make_unique<MmapStore>();
+    std::string mmap_dir = "test_interned_mmap";
+    std::filesystem::remove_all(mmap_dir);
+    ASSERT_TRUE(unindexed->open(mmap_dir, 16));
+    auto over_mmap = open_interned_store(std::move(unindexed), handle, 3);
+    over_mmap->insert("old", "https://shop.example/products/1");
+    over_mmap->insert("home", "https://shop.example/");
+    over_mmap->insert("evil", "https://shop.example.evil.org/products/1");
+    EXPECT_FALSE(over_mmap->has_url_index());
+    EXPECT_EQ(codes_on_host(*over_mmap, "shop.example"), (std::vector<std::string>{"home", "old"}));
+    over_mmap.reset();
+    std::filesystem::remove_all(mmap_dir);
+    sqlite3_close(handle);
+}
+
+TEST(WarmupTest, SnapshotsHottestCodesAndPreloadsThem) {
+    sqlite3* handle;
+    sqlite3_open(":memory:", &handle);
+    std::string path = "test_hot_codes.txt";
+    {
+        CachedStore cache(std::make_unique<SqliteStore>(handle), 1000);
+        for (int i = 0; i < 100; ++i) {
+            cache.insert("c" + std::to_string(i), "http://example.com/" + std::to_string(i));
+            for (int hit = 0; hit <= i % 10; ++hit) {
+                cache.get("c" + std::to_string(i));
+            }
+        }
+        ASSERT_TRUE(save_hot_set(cache, path, 20));
+    }
+    auto codes = load_hot_set(path);
+    ASSERT_EQ(codes.size(), 20u);
+    EXPECT_EQ(codes[0].view().back(), '9');
+
+    CachedStore cache(std::make_unique<SqliteStore>(handle), 1000);
+    EXPECT_EQ(cache.size(), 0u);
+    start_warmup(cache, path);
+    for (int i = 0; i < 500 && !warmup_complete(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    stop_warmup();
+    EXPECT_TRUE(warmup_complete());
+    EXPECT_EQ(cache.size(), 20u);
+    std::remove(path.c_str());
+    sqlite3_close(handle);
+}
+
+TEST(CodePoolTest, QueueHandsOutEachCodeOnce) {
+    CodeQueue queue(1000);
+    EXPECT_EQ(queue.capacity(), 1024u);
+    std::atomic<bool> done{false};
+    std::vector<std::vector<std::string>> popped(2);
+    std::vector<std::thread> consumers;
+    for (int t = 0; t < 2; ++t) {
+        consumers.emplace_back([&queue, &done, &popped, t] {
+            ShortCode code;
+            while (true) {
+                if (queue.pop(code)) {
+                    popped[t].push_back(code.str());
+                } else if (done) {
+                    if (!queue.pop(code)) {
+                        break;
+                    }
+                    popped[t].push_back(code.str());
+                }
+            }
+        });
+    }
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 2; ++t) {
+        producers.emplace_back([&queue, t] {
+            for (int i = 0; i < 5000; ++i) {
+                while (!queue.push("p" + std::to_string(t) + "x" + std::to_string(i))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    done = true;
+    for (auto& consumer : consumers) {
+        consumer.join();
+    }
+    std::set<std::string> unique(popped[0].begin(), popped[0].end());
+    unique.insert(popped[1].begin(), popped[1].end());
+    EXPECT_EQ(popped[0].size() + popped[1].size(), 10000u);
+    EXPECT_EQ(unique.size(), 10000u);
+    EXPECT_EQ(queue.popped(), 10000u);
+}
+
+static CodePoolStats wait_for_pool(size_t available) {
+    CodePoolStats stats = code_pool_stats();
+    for (int i = 0; i < 500 && stats.available < available; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        stats = code_pool_stats();
+    }
+    return stats;
+}
+
+TEST(CodePoolTest, ReservesCodesAndRecoversUnusedOnRestart) {
+    std::string path = "test_code_pool.db";
+    std::remove(path.c_str());
+    sqlite3_open(path.c_str(), &db);
+    set_journal_mode(db, "WAL");
+    init_db();
+
+    uint64_t misses = code_pool_stats().misses;
+    ASSERT_TRUE(start_code_pool(path, 6, 100, 20, 50));
+    ASSERT_EQ(wait_for_pool(100).available, 100u);
+    std::set<std::string> taken, stored;
+    for (int i = 0; i < 30; ++i) {
+        ShortCode code = next_short_code(6);
+        EXPECT_EQ(code.size(), 6u);
+        EXPECT_TRUE(taken.insert(code.str()).second);
+        if (i < 10) {
+            insert_url(code, "https://example.com/" + std::to_string(i));
+            stored.insert(code.str());
+        }
+    }
+    stop_code_pool();
+    EXPECT_EQ(code_pool_stats().misses, misses);
+
+    // Another pool's rows: one still under lease, one whose owner let the lease run out.
+    std::string lease = std::to_string(current_time_us() / 1000000 + 60);
+    sqlite3_exec(db, ("INSERT INTO code_reservations VALUES ('live01', 42, 1, " + lease + "), ('gone01', 43, 1, 1);").c_str(),
+                 nullptr, nullptr, nullptr);
+
+    // The 70 codes left in the pool, the 20 taken but never stored and the expired row come back.
+    uint64_t recovered = code_pool_stats().recovered;
+    ASSERT_TRUE(start_code_pool(path, 6, 100, 20, 50));
+    wait_for_pool(91);
+    EXPECT_EQ(code_pool_stats().recovered - recovered, 91u);
+    std::set<std::string> again;
+    for (int i = 0; i < 91; ++i) {
+        again.insert(next_short_code(6).str());
+    }
+    stop_code_pool();
+    EXPECT_EQ(again.size(), 91u);
+    EXPECT_EQ(again.count("gone01"), 1u);
+    EXPECT_EQ(again.count("live01"), 0u);
+    for (const auto& code : taken) {
+        EXPECT_EQ(again.count(code), 1u - stored.count(code));
+    }
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_prepare_v2(db, "SELECT owner FROM code_reservations WHERE short_code = 'live01';", -1, &stmt, nullptr),
+              SQLITE_OK);
+    ASSERT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    EXPECT_EQ(sqlite3_column_int64(stmt, 0), 42);
+    sqlite3_finalize(stmt);
+
+    set_store(nullptr);
+    sqlite3_close(db);
+    db = nullptr;
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+TEST(CodeSequenceTest, IdsMapToDistinctCodes) {
+    std::set<std::string> codes;
+    for (uint64_t id = 0; id < sequence_capacity(2); ++id) {
+        ShortCode code = sequence_code(id, 2);
+        EXPECT_EQ(code.size(), 2u);
+        codes.insert(code.str());
+    }
+    EXPECT_EQ(codes.size(), 62u * 62u);
+    EXPECT_EQ(sequence_code(7, 12).size(), 12u);
+    EXPECT_NE(sequence_code(1, 6), sequence_code(2, 6));
+}
+
+TEST(CodeSequenceTest, WaitsForTheNextBlockInsteadOfFallingBehind) {
+    std::string path = "test_code_sequence_wait.db";
+    std::remove(path.c_str());
+    uint64_t behind = code_sequence_stats().behind;
+    ASSERT_TRUE(start_code_sequence(path, 6, 4));
+    std::set<std::string> codes;
+    ShortCode code;
+    for (int i = 0; i < 200; ++i) {
+        ASSERT_TRUE(next_sequence_code(code));
+        codes.insert(code.str());
+    }
+    EXPECT_EQ(codes.size(), 200u);
+    EXPECT_EQ(code_sequence_stats().behind, behind);
+
+    // While another process holds the database, a request gives up at its deadline, and one
+    // without a deadline waits until the lease goes through.
+    sqlite3* other;
+    sqlite3_open(path.c_str(), &other);
+    sqlite3_busy_timeout(other, 5000);
+    ASSERT_EQ(sqlite3_exec(other, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr), SQLITE_OK);
+    bool gave_up = false;
+    for (int i = 0; i < 20 && !gave_up; ++i) {
+        uint64_t start = steady_time_us();
+        set_request_deadline(start + 20000);
+        gave_up = !next_sequence_code(code);
+        EXPECT_LT(steady_time_us() - start, 1000000u);
+    }
+    set_request_deadline(0);
+    EXPECT_TRUE(gave_up);
+    EXPECT_EQ(code_sequence_stats().behind, behind + 1);
+    std::thread release([other] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        sqlite3_exec(other, "COMMIT;", nullptr, nullptr, nullptr);
+    });
+    EXPECT_TRUE(next_sequence_code(code));
+    release.join();
+    sqlite3_close(other);
+    stop_code_sequence();
+    std::remove(path.c_str());
+}
+
+TEST(CodeSequenceTest, ProcessesSharingADatabaseNeverIssueTheSameCode) {
+    std::string path = "test_code_sequence.db";
+    std::remove(path.c_str());
+    const int processes = 4;
+    const int codes_per_process = 300;
+    std::vector<pid_t> children;
+    for (int p = 0; p < processes; ++p) {
+        pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            // Blocks of 10 make every process lease 30 times, interleaved with the others. Until
+            // the next block is leased, no code is issued.
+            std::ofstream out(path + "." + std::to_string(p));
+            if (start_code_sequence(path, 6, 10)) {
+                ShortCode code;
+                for (int i = 0, tries = 0; i < codes_per_process && tries < 1000000; ++tries) {
+                    if (next_sequence_code(code)) {
+                        out << code << '\n';
+                        ++i;
+                    } else {
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    }
+                }
+                stop_code_sequence();
+            }
+            out.close();
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    std::set<std::string> codes;
+    size_t total = 0;
+    for (int p = 0; p < processes; ++p) {
+        std::ifstream in(path + "." + std::to_string(p));
+        std::string line;
+        while (std::getline(in, line)) {
+            codes.insert(line);
+            ++total;
+        }
+        std::remove((path + "." + std::to_string(p)).c_str());
+    }
+    EXPECT_EQ(total, static_cast<size_t>(processes * codes_per_process));
+    EXPECT_EQ(codes.size(), total);
+
+    sqlite3* handle;
+    sqlite3_open(path.c_str(), &handle);
+    uint64_t start = 0;
+    ASSERT_TRUE(lease_id_block(handle, 10, start));
+    EXPECT_GE(start, total);
+    sqlite3_close(handle);
+    std::remove(path.c_str());
+}
+
+class UnhealthyStore : public SqliteStore {
+public:
+    using SqliteStore::SqliteStore;
+    bool healthy() override {
+        return false;
+    }
+};
+
+static HealthStatus wait_for_probe(bool storage) {
+    HealthStatus status = health_status();
+    for (int i = 0; i < 200 && status.storage != storage; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        status = health_status();
+    }
+    return status;
+}
+
+TEST(HealthTest, ReadinessFollowsStorageProbeAndWarmup) {
+    sqlite3* handle;
+    sqlite3_open(":memory:", &handle);
+    set_store(std::make_unique<SqliteStore>(handle));
+    start_warmup(*current_store(), "missing_hot_codes.txt");
+    stop_warmup();
+
+    start_health_probe(5, 500, 0.9);
+    HealthStatus status = wait_for_probe(true);
+    EXPECT_TRUE(status.storage);
+    EXPECT_TRUE(status.warmed_up);
+    EXPECT_TRUE(status.ready);
+    stop_health_probe();
+
+    set_store(std::make_unique<UnhealthyStore>(handle));
+    start_health_probe(5, 500, 0.9);
+    status = wait_for_probe(false);
+    EXPECT_FALSE(status.storage);
+    EXPECT_FALSE(status.ready);
+    stop_health_probe();
+    set_store(nullptr);
+    sqlite3_close(handle);
+}
+
+TEST(RateLimiterTest, BurstThenRefill) {
+    RateLimiter limiter(1024);
+    limiter.set_limit(RateLimitRoute::Shorten, 2, 3);
+    uint64_t now = 1700000000000000ULL;
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(limiter.acquire("10.0.0.1", RateLimitRoute::Shorten, now), 0u);
+    }
+    EXPECT_EQ(limiter.acquire("10.0.0.1", RateLimitRoute::Shorten, now), 1u);
+    EXPECT_EQ(limiter.acquire("10.0.0.2", RateLimitRoute::Shorten, now), 0u);
+    EXPECT_EQ(limiter.acquire("10.0.0.1", RateLimitRoute::Redirect, now), 0u);
+    EXPECT_EQ(limiter.acquire("10.0.0.1", RateLimitRoute::Shorten, now + 500000), 0u);
+    EXPECT_NE(limiter.acquire("10.0.0.1", RateLimitRoute::Shorten, now + 500000), 0u);
+}
+
+TEST(RateLimiterTest, EvictsIdleClientsWhenFull) {
+    RateLimiter limiter(8);
+    limiter.set_limit(RateLimitRoute::Redirect, 1, 1);
+    uint64_t now = 1700000000000000ULL;
+    EXPECT_EQ(limiter.acquire("busy", RateLimitRoute::Redirect, now), 0u);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(limiter.acquire("client" + std::to_string(i), RateLimitRoute::Redirect, now + 1000 + i * 1000), 0u);
+    }
+    // The table holds 8 buckets; the busy client's was the least recently used and is gone.
+    EXPECT_EQ(limiter.acquire("busy", RateLimitRoute::Redirect, now + 200000), 0u);
+}
+
+TEST(RateLimiterTest, ClassifiesRoutes) {
+    crow::request req;
+    req.method = "POST"_method;
+    req.url = "/shorten";
+    EXPECT_EQ(classify_rate_limit_route(req), RateLimitRoute::Shorten);
+    req.method = "GET"_method;
+    req.url = "/abc123";
+    EXPECT_EQ(classify_rate_limit_route(req), RateLimitRoute::Redirect);
+    req.url = "/readyz";
+    EXPECT_EQ(classify_rate_limit_route(req), RateLimitRoute::None);
+    req.method = "DELETE"_method;
+    req.url = "/delete/abc123";
+    EXPECT_EQ(classify_rate_limit_route(req), RateLimitRoute::Delete);
+}
+
+TEST(AdmissionTest, ShedsWritesBeforeReadsAndRecovers) {
+    configure_admission(1, 1, 20);
+    {
+        StorageAdmission stalled(AdmissionClass::Read);
+        ASSERT_TRUE(stalled.admitted());
+        // Every waiter times out behind the stalled request, so the delay stays above target.
+        for (int i = 0; i < 20 && admission_shed_level() < 2; ++i) {
+            StorageAdmission waiting(AdmissionClass::Read);
+            EXPECT_FALSE(waiting.admitted());
+            if (admission_shed_level() == 1) {
+                auto start = std::chrono::steady_clock::now();
+                StorageAdmission write(AdmissionClass::Write);
+                EXPECT_FALSE(write.admitted());
+                EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(5));
+            }
+        }
+        EXPECT_EQ(admission_shed_level(), 2);
+        auto start = std::chrono::steady_clock::now();
+        StorageAdmission read(AdmissionClass::Read);
+        EXPECT_FALSE(read.admitted());
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(5));
+    }
+    // Free slots are never refused, and their zero delay lowers the level again.
+    for (int i = 0; i < 50 && admission_shed_level() > 0; ++i) {
+        StorageAdmission write(AdmissionClass::Write);
+        EXPECT_TRUE(write.admitted());
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(admission_shed_level(), 0);
+    configure_admission(0, 5, 100);
+}
+
+TEST(AdmissionTest, WaiterGetsReleasedSlot) {
+    configure_admission(1, 50, 500);
+    auto holder = std::make_unique<StorageAdmission>(AdmissionClass::Write);
+    std::thread release([&holder] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        holder.reset();
+    });
+    StorageAdmission waiting(AdmissionClass::Write);
+    EXPECT_TRUE(waiting.admitted());
+    release.join();
+    EXPECT_EQ(admission_shed_level(), 0);
+    configure_admission(0, 5, 100);
+}
+
+TEST(DeadlineTest, ProgressHandlerInterruptsLongStatement) {
+    sqlite3* handle;
+    sqlite3_open(":memory:", &handle);
+    watch_deadline(handle);
+    const char* sql = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) SELECT count(*) FROM c;";
+    set_request_deadline(steady_time_us() + 20000);
+    uint64_t start = steady_time_us();
+    EXPECT_EQ(sqlite3_exec(handle, sql, nullptr, nullptr, nullptr), SQLITE_INTERRUPT);
+    EXPECT_LT(steady_time_us() - start, 1000000u);
+    EXPECT_TRUE(deadline_interrupted());
+    set_request_deadline(0);
+    EXPECT_FALSE(deadline_interrupted());
+    EXPECT_EQ(sqlite3_exec(handle, "SELECT 1;", nullptr, nullptr, nullptr), SQLITE_OK);
+    sqlite3_close(handle);
+}
+
+TEST(SqliteStoreTest, BatchesCommitWholeOnTheirOwnConnection) {
+    std::string path = "test_sqlite_batches.db";
+    std::remove(path.c_str());
+    sqlite3* handle;
+    sqlite3_open(path.c_str(), &handle);
+    SqliteStore store(handle);
+    std::vector<std::pair<ShortCode, std::string>> entries;
+    for (int i = 0; i < 100; ++i) {
+        entries.emplace_back("b" + std::to_string(i), "http://batch.com/" + std::to_string(i));
+    }
+
+    // A transaction someone left open on the shared connection neither blocks the batch nor
+    // takes it in: rolling it back keeps the batch.
+    ASSERT_EQ(sqlite3_exec(handle, "SAVEPOINT other;", nullptr, nullptr, nullptr), SQLITE_OK);
+    store.insert_batch({entries.begin(), entries.begin() + 50});
+    sqlite3_exec(handle, "ROLLBACK TO other; RELEASE other;", nullptr, nullptr, nullptr);
+    EXPECT_EQ(store.get("b49"), "http://batch.com/49");
+
+    // A batch that cannot finish before its deadline leaves nothing behind.
+    sqlite3* other;
+    sqlite3_open(path.c_str(), &other);
+    ASSERT_EQ(sqlite3_exec(other, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr), SQLITE_OK);
+    set_request_deadline(steady_time_us() + 20000);
+    store.insert_batch({entries.begin() + 50, entries.end()});
+    store.remove_batch({"b0", "b1"});
+    set_request_deadline(0);
+    sqlite3_exec(other, "COMMIT;", nullptr, nullptr, nullptr);
+    sqlite3_close(other);
+    EXPECT_EQ(store.get("b50"), "");
+    EXPECT_EQ(store.get("b0"), "http://batch.com/0");
+
+    store.insert_batch({entries.begin() + 50, entries.end()});
+    store.remove_batch({"b0", "b1"});
+    EXPECT_EQ(store.get("b99"), "http://batch.com/99");
+    EXPECT_EQ(store.get("b1"), "");
+    sqlite3_close(handle);
+    std::remove(path.c_str());
+}
+
+TEST_F(UrlShortenerTest, ExpiredDeadlineSkipsStorage) {
+    insert_url("abc123", "https://example.com");
+    set_request_deadline(steady_time_us() + 60000000);
+    EXPECT_EQ(get_url("abc123"), "https://example.com");
+    EXPECT_FALSE(deadline_interrupted());
+    set_request_deadline(1);
+    insert_url("def456", "https://example.org");
+    EXPECT_EQ(get_url("abc123"), "");
+    EXPECT_TRUE(deadline_interrupted());
+    set_request_deadline(0);
+    EXPECT_EQ(get_url("def456"), "");
+    EXPECT_EQ(get_url("abc123"), "https://example.com");
+}
+
+TEST(FastJsonTest, ParsesShortenRequests) {
+    ShortenRequest plain;
+    std::string body = R"({"url": "https://example.com/a", "tags": ["x", {"y": null}], "n": -1.5e3})";
+    ASSERT_TRUE(parse_shorten_request(body, plain));
+    EXPECT_EQ(plain.url, "https://example.com/a");
+    EXPECT_EQ(plain.url.data(), body.data() + 9);
+
+    ShortenRequest escaped;
+    ASSERT_TRUE(parse_shorten_request(R"({"u\u0072l":"https:\/\/example.com\/\u00e9\ud83d\ude00"})", escaped));
+    EXPECT_EQ(escaped.url, "https://example.com/\xc3\xa9\xf0\x9f\x98\x80");
+    EXPECT_FALSE(escaped.has_alias);
+
+    ShortenRequest aliased;
+    ASSERT_TRUE(parse_shorten_request(R"({"alias": "sale2024", "url": "https://example.com/a"})", aliased));
+    EXPECT_TRUE(aliased.has_alias);
+    EXPECT_EQ(aliased.alias, "sale2024");
+    EXPECT_EQ(aliased.url, "https://example.com/a");
+
+    ShortenRequest rejected;
+    EXPECT_FALSE(parse_shorten_request(R"({"url": 42})", rejected));
+    EXPECT_FALSE(parse_shorten_request(R"({"other": "https://example.com"})", rejected));
+    EXPECT_FALSE(parse_shorten_request(R"({"url": "https://example.com")", rejected));
+    EXPECT_FALSE(parse_shorten_request(R"({"url": "https://example.com"} x)", rejected));
+    EXPECT_FALSE(parse_shorten_request(R"({"url": "https://example.com", "n": 01})", rejected));
+    EXPECT_FALSE(parse_shorten_request(R"({"url": "bad\q"})", rejected));
+    EXPECT_FALSE(parse_shorten_request(std::string(100, '[') + std::string(100, ']'), rejected));
+}
+
+TEST(FastJsonTest, WriterEscapesAndDetectsOverflow) {
+    JsonWriter<64> writer;
+    writer.field("short_url", "http://localhost:8080/", std::string("ab\"c\n"));
+    EXPECT_EQ(writer.finish(), R"({"short_url":"http://localhost:8080/ab\"c\u000a"})");
+
+    JsonWriter<8> small;
+    small.field("short_url", "abcdef");
+    EXPECT_TRUE(small.finish().empty());
+}
+
+TEST(FastJsonTest, BuilderNestsAndEscapes) {
+    std::pmr::string body;
+    JsonBuilder json(body);
+    json.begin_object().key("host").value("a\"b").key("links").value(3).key("ready").value(false);
+    json.key("codes").begin_array().value("x").value("y").end_array();
+    json.key("fill").value(0.5).key("empty").begin_object().end_object().end_object();
+    EXPECT_EQ(body, R"({"host":"a\"b","links":3,"ready":false,"codes":["x","y"],"fill":0.5,"empty":{}})");
+}
+
+TEST(RequestArenaTest, ServesRequestsAndRewinds) {
+    set_request_arena_size(1024);
+    EXPECT_EQ(request_memory(), std::pmr::new_delete_resource());
+    RequestArenaStats before = request_arena_stats();
+
+    begin_request_arena();
+    EXPECT_NE(request_memory(), std::pmr::new_delete_resource());
+    auto first = request_string();
+    first.assign(200, 'a');
+    const char* start = first.data();
+    end_request_arena();
+    EXPECT_EQ(request_memory(), std::pmr::new_delete_resource());
+
+    // The next request gets the same memory back; one that outgrows the buffer is counted.
+    begin_request_arena();
+    auto second = request_string();
+    second.assign(200, 'b');
+    EXPECT_EQ(second.data(), start);
+    second.assign(4096, 'c');
+    end_request_arena();
+    RequestArenaStats after = request_arena_stats();
+    EXPECT_EQ(after.requests - before.requests, 2u);
+    EXPECT_EQ(after.overflows - before.overflows, 1u);
+    EXPECT_GE(after.overflow_bytes - before.overflow_bytes, 4096u);
+
+    set_request_arena_size(0);
+    begin_request_arena();
+    EXPECT_EQ(request_memory(), std::pmr::new_delete_resource());
+    end_request_arena();
+    set_request_arena_size(16 * 1024);
+}
+
+TEST(UrlCanonTest, EquivalentSpellingsShareOneForm) {
+    const std::string long_path = "/articles/2024/05/" + std::string(70, 'x') + "/index.html";
+    for (int level = 0; level <= static_cast<int>(supported_url_scan_level()); ++level) {
+        set_url_scan_level(static_cast<UrlScanLevel>(level));
+        std::string a, b;
+        ASSERT_TRUE(canonicalize_url("HTTP://Example.COM", a));
+        ASSERT_TRUE(canonicalize_url("http://example.com:80/", b));
+        EXPECT_EQ(a, "http://example.com/");
+        EXPECT_EQ(a, b);
+        ASSERT_TRUE(canonicalize_url("https://WWW.Example-Site.co.uk:443" + long_path + "?q=%7e%2fa%zz", a) == false);
+        ASSERT_TRUE(canonicalize_url("https://WWW.Example-Site.co.uk:443" + long_path + "?q=%7e%2fa#Top", a));
+        EXPECT_EQ(a, "https://www.example-site.co.uk" + long_path + "?q=~%2Fa#Top");
+        ASSERT_TRUE(canonicalize_url("https://example.com:8443?x=\xc3\xa9", a));
+        EXPECT_EQ(a, "https://example.com:8443/?x=%C3%A9");
+        ASSERT_TRUE(canonicalize_url("http://[2001:DB8::1]:8080/a", a));
+        EXPECT_EQ(a, "http://[2001:db8::1]:8080/a");
+
+        for (const char* bad : {"ftp://example.com/", "http:/example.com", "http://", "http://user@example.com/",
+                                "http://exa mple.com/", "http://example.com:99999/", "http://example.com:0/",
+                                "https://example.com/a b", "https://example.com/%4", "https://ex%41mple.com/"}) {
+            EXPECT_FALSE(canonicalize_url(bad, a)) << bad;
+        }
+        std::string with_control = "https://example.com" + long_path;
+        with_control[40] = '\t';
+        EXPECT_FALSE(canonicalize_url(with_control, a));
+    }
+    set_url_scan_level(supported_url_scan_level());
+}
+
+TEST(UrlCanonTest, ScanLevelsAgree) {
+    std::mt19937 rng(7);
+    const std::string alphabet = "abcXYZ019.-_/?#&=%~:@ \t\x7f\xc3";
+    for (int i = 0; i < 2000; ++i) {
+        std::string url = i % 2 ? "HTTPS://" : "http://";
+        if (i % 4 != 0) {
+            url += "Example.com/";
+        }
+        size_t length = rng() % 120;
+        for (size_t j = 0; j < length; ++j) {
+            url += alphabet[rng() % alphabet.size()];
+        }
+        std::string expected, actual;
+        set_url_scan_level(UrlScanLevel::Scalar);
+        bool valid = canonicalize_url(url, expected);
+        for (int level = 1; level <= static_cast<int>(supported_url_scan_level()); ++level) {
+            set_url_scan_level(static_cast<UrlScanLevel>(level));
+            ASSERT_EQ(canonicalize_url(url, actual), valid) << url;
+            if (valid) {
+                EXPECT_EQ(actual, expected);
+            }
+        }
+    }
+    set_url_scan_level(supported_url_scan_level());
+}
+
+TEST(HotRestartTest, HandsOverListeningSocket) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    ASSERT_EQ(listen(listener, 16), 0);
+    socklen_t length = sizeof(address);
+    getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+    uint16_t port = ntohs(address.sin_port);
+    EXPECT_EQ(listening_socket(port), listener);
+
+    std::string path = "/tmp/test_hot_restart.sock";
+    EXPECT_EQ(request_listen_socket(path).listen_fd, -1);
+    std::atomic<bool> saved{false};
+    std::atomic<bool> ready{false};
+    ASSERT_TRUE(start_handoff_listener(path, port, [&saved] { saved = true; }, [&ready] { ready = true; }));
+
+    HotRestartHandoff handoff = request_listen_socket(path);
+    ASSERT_GE(handoff.listen_fd, 0);
+    EXPECT_TRUE(saved.load());
+    EXPECT_NE(handoff.listen_fd, listener);
+    sockaddr_in received{};
+    length = sizeof(received);
+    getsockname(handoff.listen_fd, reinterpret_cast<sockaddr*>(&received), &length);
+    EXPECT_EQ(ntohs(received.sin_port), port);
+
+    // The old side closes the connection once it is done, which ends the handoff.
+    std::thread old_instance([&ready] {
+        while (!ready.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        stop_handoff_listener();
+        close_handoff_connection();
+    });
+    EXPECT_TRUE(finish_handoff(handoff, 5000));
+    old_instance.join();
+    EXPECT_TRUE(std::filesystem::exists(path));
+
+    // A connection made after the old side closed its copy is accepted on the handed-over one.
+    close(listener);
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    address.sin_port = htons(port);
+    EXPECT_EQ(connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    int accepted = accept(handoff.listen_fd, nullptr, nullptr);
+    EXPECT_GE(accepted, 0);
+    close(accepted);
+    close(client);
+    close(handoff.listen_fd);
+    std::filesystem::remove(path);
+}
+
+// Minimal HTTP/1.0 request; returns the raw response, empty if the connection failed.
+static std::string http_request(uint16_t port, const std::string& method, const std::string& path, const std::string& body,
+                                const std::string& headers = "") {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    std::string response;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        std::string request = method + " " + path + " HTTP/1.0\r\n" + headers +
+                              "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+            char buffer[4096];
+            ssize_t n;
+            while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+                response.append(buffer, n);
+            }
+        }
+    }
+    close(fd);
+    return response;
+}
+
+static std::string http_post(uint16_t port, const std::string& path, const std::string& body) {
+    return http_request(port, "POST", path, body);
+}
+
+TEST(AdminLoggingTest, RejectsInvalidSettingsWithoutApplyingAny) {
+    const uint16_t port = 18091;
+    App app;
+    app.loglevel(crow::LogLevel::Warning);
+    setup_admin_routes(app, "t");
+    auto server = app.port(port).signal_clear().run_async();
+    app.wait_for_server_start();
+    LogLevel level = min_log_level();
+    double rate = access_sample_rate(AccessEvent::Redirect);
+    auto put = [port](const std::string& body) {
+        return http_request(port, "PUT", "/admin/logging", body, "X-Admin-Token: t\r\n").substr(9, 3);
+    };
+
+    EXPECT_EQ(put("{\"level\": \"LOUD\"}"), "400");
+    EXPECT_EQ(put("{\"level\": 3}"), "400");
+    EXPECT_EQ(put("{\"sample_rates\": {\"redirect\": 0.5, \"nonsense\": 1}}"), "400");
+    EXPECT_EQ(put("{\"sample_rates\": {\"redirect\": \"half\"}}"), "400");
+    EXPECT_EQ(put("{\"sample_rates\": {\"redirect\": 2}}"), "400");
+    EXPECT_EQ(put("{\"level\": \"error\", \"sample_rates\": []}"), "400");
+    EXPECT_EQ(min_log_level(), level);
+    EXPECT_EQ(access_sample_rate(AccessEvent::Redirect), rate);
+
+    EXPECT_EQ(put("{\"level\": \"error\", \"sample_rates\": {\"redirect\": 0.5}}"), "200");
+    EXPECT_EQ(min_log_level(), LogLevel::Error);
+    EXPECT_EQ(access_sample_rate(AccessEvent::Redirect), 0.5);
+
+    set_min_log_level(level);
+    set_access_sample_rate(AccessEvent::Redirect, rate);
+    app.stop();
+    server.get();
+}
+
+TEST(CodePoolTest, ShortenSkipsPoolCodesStoredMeanwhile) {
+    std::string path = "test_code_pool_shorten.db";
+    std::remove(path.c_str());
+    sqlite3_open(path.c_str(), &db);
+    set_journal_mode(db, "WAL");
+    init_db();
+    ASSERT_TRUE(start_code_pool(path, 6, 5, 0, 5));
+    ASSERT_EQ(wait_for_pool(5).available, 5u);
+
+    // Someone who ignores reservations stores links under every code in the pool.
+    std::set<std::string> reserved;
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_prepare_v2(db, "SELECT short_code FROM code_reservations;", -1, &stmt, nullptr), SQLITE_OK);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        std::string code = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        insert_url(code, "https://example.com/" + code);
+        reserved.insert(code);
+    }
+    sqlite3_finalize(stmt);
+    ASSERT_EQ(reserved.size(), 5u);
+
+    const uint16_t port = 18090;
+    App app;
+    app.loglevel(crow::LogLevel::Warning);
+    setup_routes(app, 6);
+    auto server = app.port(port).signal_clear().run_async();
+    app.wait_for_server_start();
+    std::string response = http_post(port, "/shorten", "{\"url\":\"https://example.com/new\"}");
+    app.stop();
+    server.get();
+    stop_code_pool();
+
+    ASSERT_EQ(response.compare(9, 3, "200"), 0);
+    ShortCode code = get_short_code("https://example.com/new");
+    EXPECT_EQ(reserved.count(code.str()), 0u);
+    EXPECT_NE(response.find("localhost:8080/" + code.str()), std::string::npos);
+    for (const auto& taken : reserved) {
+        EXPECT_EQ(get_url(taken), "https://example.com/" + taken);
+    }
+
+    set_store(nullptr);
+    sqlite3_close(db);
+    db = nullptr;
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+TEST(GracefulShutdownTest, NoAcknowledgedShortenIsLost) {
+    std::string dir = "/tmp/test_graceful_shutdown";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    std::string path = dir + "/urls.db";
+    sqlite3_open(path.c_str(), &db);
+    set_journal_mode(db, "WAL");
+    init_db();
+
+    const uint16_t port = 18089;
+    App app;
+    app.loglevel(crow::LogLevel::Warning);
+    setup_routes(app, 8);
+    auto server = app.port(port).concurrency(4).signal_clear().run_async();
+    app.wait_for_server_start();
+
+    std::mutex acked_mutex;
+    std::vector<std::pair<std::string, std::string>> acked;
+    std::atomic<bool> stopped{false};
+    std::vector<std::thread> clients;
+    for (int c = 0; c < 4; ++c) {
+        clients.emplace_back([&, c] {
+            for (int i = 0; !stopped.load(); ++i) {
+                std::string url = "https://example.com/" + std::to_string(c) + "/" + std::to_string(i);
+                std::string response = http_post(port, "/shorten", "{\"url\":\"" + url + "\"}");
+                auto start = response.find("localhost:8080/");
+                if (response.size() > 12 && response.compare(9, 3, "200") == 0 && start != std::string::npos) {
+                    start += 15;
+                    std::string code = response.substr(start, response.find('"', start) - start);
+                    std::lock_guard<std::mutex> lock(acked_mutex);
+                    acked.emplace_back(code, url);
+                }
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_TRUE(drain_requests(port, 5000));
+    EXPECT_TRUE(shutdown_draining());
+    EXPECT_EQ(requests_in_flight(), 0u);
+    app.stop();
+    server.get();
+    stopped = true;
+    for (auto& client : clients) {
+        client.join();
+    }
+    checkpoint_wal(db);
+    sqlite3_close(db);
+
+    ASSERT_FALSE(acked.empty());
+    sqlite3_open(path.c_str(), &db);
+    init_db();
+    for (const auto& entry : acked) {
+        EXPECT_EQ(get_url(entry.first), entry.second);
+    }
+    sqlite3_close(db);
+    db = nullptr;
+    std::filesystem::remove_all(dir);
+    reset_shutdown();
+    EXPECT_FALSE(shutdown_draining());
+}
+
+// The sequence main() runs on SIGTERM, in a child process: wait for the signal, drain, stop the
+// server, flush the log queue and checkpoint both databases.
+static int serve_until_sigterm(const std::string& dir, uint16_t port) {
+    block_shutdown_signals();
+    sqlite3_open((dir + "/urls.db").c_str(), &db);
+    set_journal_mode(db, "WAL");
+    init_db();
+    if (!open_log_db(dir + "/logs.db", "WAL", 1024)) {
+        return 1;
+    }
+    App app;
+    app.loglevel(crow::LogLevel::Warning);
+    setup_routes(app, 8);
+    auto server = app.port(port).concurrency(4).signal_clear().run_async();
+    std::thread shutdown_thread([&app, port] {
+        int signal_number = wait_for_shutdown_signal();
+        log("Received signal " + std::to_string(signal_number) + ", draining requests", "WARN");
+        log(drain_requests(port, 5000) ? "All requests drained" : "Stopping with requests still in flight", "WARN");
+        app.stop();
+    });
+    server.get();
+    shutdown_thread.join();
+    close_log_db();
+    set_store(nullptr);
+    bool checkpointed = checkpoint_wal(db);
+    sqlite3_close(db);
+    return checkpointed ? 0 : 1;
+}
+
+TEST(GracefulShutdownTest, SigtermDrainsFlushesLogsAndCheckpoints) {
+    std::string dir = "/tmp/test_sigterm_shutdown";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    const uint16_t port = 18092;
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        _exit(serve_until_sigterm(dir, port));
+    }
+
+    auto shorten = [port](const std::string& url, std::string& code) {
+        std::string response = http_post(port, "/shorten", "{\"url\":\"" + url + "\"}");
+        auto start = response.find("localhost:8080/");
+        if (response.size() < 12 || response.compare(9, 3, "200") != 0 || start == std::string::npos) {
+            return false;
+        }
+        start += 15;
+        code = response.substr(start, response.find('"', start) - start);
+        return true;
+    };
+    std::vector<std::pair<std::string, std::string>> acked;
+    std::string code;
+    for (int i = 0; i < 500 && !shorten("https://example.com/first", code); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    acked.emplace_back(code, "https://example.com/first");
+    std::atomic<bool> signalled{false};
+    std::thread client([&] {
+        for (int i = 0; i < 100000; ++i) {
+            std::string url = "https://example.com/" + std::to_string(i);
+            if (shorten(url, code)) {
+                acked.emplace_back(code, url);
+            } else if (signalled.load()) {
+                break;
+            }
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    kill(child, SIGTERM);
+    signalled = true;
+    int status = 0;
+    waitpid(child, &status, 0);
+    client.join();
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // Checkpointed with TRUNCATE: nothing is left in either WAL.
+    for (const char* name : {"/urls.db-wal", "/logs.db-wal"}) {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(dir + name, ec);
+        EXPECT_TRUE(ec || size == 0) << name;
+    }
+    sqlite3_open((dir + "/urls.db").c_str(), &db);
+    init_db();
+    for (const auto& entry : acked) {
+        EXPECT_EQ(get_url(entry.first), entry.second);
+    }
+    set_store(nullptr);
+    sqlite3_close(db);
+    db = nullptr;
+    sqlite3* logs;
+    sqlite3_open((dir + "/logs.db").c_str(), &logs);
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_prepare_v2(logs, "SELECT message FROM logs ORDER BY id;", -1, &stmt, nullptr), SQLITE_OK);
+    std::vector<std::string> messages;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        messages.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(logs);
+    ASSERT_GE(messages.size(), 2u);
+    EXPECT_EQ(messages[messages.size() - 2], "Received signal " + std::to_string(SIGTERM) + ", draining requests");
+    EXPECT_EQ(messages.back(), "All requests drained");
+    std::filesystem::remove_all(dir);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
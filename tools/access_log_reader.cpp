@@ -0,0 +1,38 @@
+#include "access_log.hpp"
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <access_log_dir> [csv|json]" << std::endl;
+        return 1;
+    }
+    std::string dir = argv[1];
+    std::string format = argc > 2 ? argv[2] : "csv";
+    if (format != "csv" && format != "json") {
+        std::cerr << "Unknown format: " << format << std::endl;
+        return 1;
+    }
+
+    auto user_agents = read_user_agents(dir);
+    if (format == "csv") {
+        std::cout << "timestamp,event,status,code,ip,user_agent\n";
+    } else {
+        std::cout << "[";
+    }
+    bool first = true;
+    for (const auto& segment : list_access_log_segments(dir)) {
+        for (const auto& record : read_access_log_segment(segment)) {
+            if (format == "csv") {
+                std::cout << access_record_to_csv(record, user_agents) << '\n';
+            } else {
+                std::cout << (first ? "\n" : ",\n") << access_record_to_json(record, user_agents);
+            }
+            first = false;
+        }
+    }
+    if (format == "json") {
+        std::cout << "\n]\n";
+    }
+    return 0;
+}